@@ -31,21 +31,61 @@
 #include "linux/string.h"
 #include "atl_msg_queue.h"
 
-signed int ATL_MsgQueueCreate(struct MsgQueueHandle *pHandle)
+static const unsigned int au32RingDepth[MSG_PRIO_MAX] = {
+	MSG_QUEUE_DEPTH_HIGH,
+	MSG_QUEUE_DEPTH_NORMAL,
+};
+
+static inline struct Message *msg_ring_slot(struct MsgQueueHandle *pHandle,
+					    struct MsgRing *pstrRing,
+					    unsigned int u32Idx)
 {
+	return (struct Message *)&pstrRing->pu8Slots[u32Idx * pHandle->u32SlotSize];
+}
+
+signed int ATL_MsgQueueCreate(struct MsgQueueHandle *pHandle,
+			      unsigned int u32MsgSize,
+			      enum MSG_PRIO (*pfPrio)(const void *pvBuffer))
+{
+	struct MsgRing *pstrRing;
+	int i;
+
 	spin_lock_init(&pHandle->strCriticalSection);
 	sema_init(&pHandle->hSem, 0);
 
-	pHandle->pstrMessageList = NULL;
+	memset(pHandle->astrRing, 0, sizeof(pHandle->astrRing));
 	pHandle->u32ReceiversCount = 0;
 	pHandle->bExiting = false;
+	pHandle->pfPrio = pfPrio;
+	pHandle->u32MsgSize = u32MsgSize;
+	pHandle->u32SlotSize = ALIGN(sizeof(struct Message) + u32MsgSize,
+				     sizeof(unsigned long));
+
+	for (i = 0; i < MSG_PRIO_MAX; i++) {
+		pstrRing = &pHandle->astrRing[i];
+		pstrRing->u32Depth = au32RingDepth[i];
+		pstrRing->pu8Slots = kcalloc(pstrRing->u32Depth,
+					     pHandle->u32SlotSize, GFP_KERNEL);
+		if (pstrRing->pu8Slots == NULL)
+			goto _fail_;
+	}
 
 	return ATL_SUCCESS;
+
+_fail_:
+	while (i-- > 0) {
+		kfree(pHandle->astrRing[i].pu8Slots);
+		pHandle->astrRing[i].pu8Slots = NULL;
+	}
+	return ATL_NO_MEM;
 }
 EXPORT_SYMBOL(ATL_MsgQueueCreate);
 
 signed int ATL_MsgQueueDestroy(struct MsgQueueHandle *pHandle)
 {
+	unsigned long flags;
+	int i;
+
 	pHandle->bExiting = true;
 
 	/* Release any waiting receiver thread.*/
@@ -54,12 +94,13 @@ signed int ATL_MsgQueueDestroy(struct MsgQueueHandle *pHandle)
 		pHandle->u32ReceiversCount--;
 	}
 
-	while (NULL != pHandle->pstrMessageList) {
-		struct Message *pstrMessge = pHandle->pstrMessageList->pstrNext;
-
-		kfree(pHandle->pstrMessageList);
-		pHandle->pstrMessageList = pstrMessge;
+	spin_lock_irqsave(&pHandle->strCriticalSection, flags);
+	for (i = 0; i < MSG_PRIO_MAX; i++) {
+		kfree(pHandle->astrRing[i].pu8Slots);
+		pHandle->astrRing[i].pu8Slots = NULL;
+		pHandle->astrRing[i].u32Count = 0;
 	}
+	spin_unlock_irqrestore(&pHandle->strCriticalSection, flags);
 
 	return ATL_SUCCESS;
 }
@@ -71,63 +112,80 @@ signed int ATL_MsgQueueSend(struct MsgQueueHandle *pHandle,
 {
 	signed int s32RetStatus = ATL_SUCCESS;
 	unsigned long flags;
-	struct Message *pstrMessage = NULL;
+	enum MSG_PRIO enuPrio = MSG_PRIO_NORMAL;
+	struct MsgRing *pstrRing;
+	struct Message *pstrMessage;
+	unsigned int u32Limit;
 
 	if ((NULL == pHandle)
 			|| (u32SendBufferSize == 0)
 			|| (pvSendBuffer == NULL))
 		ATL_ERRORREPORT(s32RetStatus, ATL_INVALID_ARGUMENT);
 
+	if (u32SendBufferSize > pHandle->u32MsgSize)
+		ATL_ERRORREPORT(s32RetStatus, ATL_BUFFER_OVERFLOW);
+
 	if (pHandle->bExiting == true)
 		ATL_ERRORREPORT(s32RetStatus, ATL_FAIL);
 
+	if (pHandle->pfPrio != NULL)
+		enuPrio = pHandle->pfPrio(pvSendBuffer);
+	if (enuPrio == MSG_PRIO_BULK) {
+		pstrRing = &pHandle->astrRing[MSG_PRIO_NORMAL];
+		u32Limit = pstrRing->u32Depth - MSG_QUEUE_RESERVED;
+	} else {
+		pstrRing = &pHandle->astrRing[enuPrio];
+		u32Limit = pstrRing->u32Depth;
+	}
+
 	spin_lock_irqsave(&pHandle->strCriticalSection, flags);
 
-	/* construct a new message */
-	pstrMessage = kmalloc(sizeof(struct Message), GFP_ATOMIC);
-	ATL_NULLCHECK(s32RetStatus, pstrMessage);
-	pstrMessage->u32Length = u32SendBufferSize;
-	pstrMessage->pstrNext = NULL;
-	pstrMessage->pvBuffer = kmalloc(u32SendBufferSize, GFP_ATOMIC);
-	ATL_NULLCHECK(s32RetStatus, pstrMessage->pvBuffer);
-	memcpy(pstrMessage->pvBuffer, pvSendBuffer, u32SendBufferSize);
+	if (pstrRing->pu8Slots == NULL) {
+		spin_unlock_irqrestore(&pHandle->strCriticalSection, flags);
+		ATL_ERRORREPORT(s32RetStatus, ATL_FAIL);
+	}
 
+	if (pstrRing->u32Count >= u32Limit) {
+		pstrRing->u32Dropped++;
+		spin_unlock_irqrestore(&pHandle->strCriticalSection, flags);
+		ATL_ERRORREPORT(s32RetStatus, ATL_FULL);
+	}
 
-	/* add it to the message queue */
-	if (NULL == pHandle->pstrMessageList) {
-		pHandle->pstrMessageList  = pstrMessage;
-	} else {
-		struct Message *pstrTailMsg = pHandle->pstrMessageList;
+	/* copy the message into the tail slot */
+	pstrMessage = msg_ring_slot(pHandle, pstrRing,
+				    (pstrRing->u32Head + pstrRing->u32Count) %
+				    pstrRing->u32Depth);
+	pstrMessage->u32Length = u32SendBufferSize;
+	pstrMessage->tEnqueued = ktime_get();
+	memcpy(pstrMessage->au8Buffer, pvSendBuffer, u32SendBufferSize);
 
-		while (NULL != pstrTailMsg->pstrNext)
-			pstrTailMsg = pstrTailMsg->pstrNext;
-		pstrTailMsg->pstrNext = pstrMessage;
-	}
+	pstrRing->u32Count++;
+	pstrRing->u32Sent++;
+	if (pstrRing->u32Count > pstrRing->u32MaxCount)
+		pstrRing->u32MaxCount = pstrRing->u32Count;
 
 	spin_unlock_irqrestore(&pHandle->strCriticalSection, flags);
 
 	up(&pHandle->hSem);
 
 	ATL_CATCH(s32RetStatus){
-		/* error occured, free any allocations */
-		if (NULL != pstrMessage) {
-			kfree(pstrMessage->pvBuffer);
-			kfree(pstrMessage);
-		}
 	}
 
 	return s32RetStatus;
 }
 EXPORT_SYMBOL(ATL_MsgQueueSend);
-	
+
 signed int ATL_MsgQueueRecv(struct MsgQueueHandle *pHandle,
 			   void *pvRecvBuffer, unsigned int u32RecvBufferSize,
 			   unsigned int *pu32ReceivedLength)
 {
 
 	struct Message *pstrMessage;
+	struct MsgRing *pstrRing = NULL;
 	signed int s32RetStatus = ATL_SUCCESS;
 	unsigned long flags;
+	unsigned int u32LatUs;
+	int i;
 
 	if ((NULL == pHandle) || (u32RecvBufferSize == 0)
 	    || (NULL == pvRecvBuffer) || (NULL == pu32ReceivedLength))
@@ -150,11 +208,17 @@ signed int ATL_MsgQueueRecv(struct MsgQueueHandle *pHandle,
 
 	spin_lock_irqsave(&pHandle->strCriticalSection, flags);
 
-	pstrMessage = pHandle->pstrMessageList;
-	if (NULL == pstrMessage) {
+	for (i = 0; i < MSG_PRIO_MAX; i++) {
+		if (pHandle->astrRing[i].u32Count != 0) {
+			pstrRing = &pHandle->astrRing[i];
+			break;
+		}
+	}
+	if (NULL == pstrRing) {
 		spin_unlock_irqrestore(&pHandle->strCriticalSection, flags);
 		ATL_ERRORREPORT(s32RetStatus, ATL_FAIL);
 	}
+	pstrMessage = msg_ring_slot(pHandle, pstrRing, pstrRing->u32Head);
 
 	/* check buffer size */
 	if (u32RecvBufferSize < pstrMessage->u32Length) {
@@ -165,14 +229,16 @@ signed int ATL_MsgQueueRecv(struct MsgQueueHandle *pHandle,
 
 	/* consume the message */
 	pHandle->u32ReceiversCount--;
-	memcpy(pvRecvBuffer, pstrMessage->pvBuffer, pstrMessage->u32Length);
+	memcpy(pvRecvBuffer, pstrMessage->au8Buffer, pstrMessage->u32Length);
 	*pu32ReceivedLength = pstrMessage->u32Length;
 
-	pHandle->pstrMessageList = pstrMessage->pstrNext;
-
-	kfree(pstrMessage->pvBuffer);
-	kfree(pstrMessage);
+	u32LatUs = (unsigned int)ktime_us_delta(ktime_get(), pstrMessage->tEnqueued);
+	pstrRing->u64LatTotalUs += u32LatUs;
+	if (u32LatUs > pstrRing->u32LatMaxUs)
+		pstrRing->u32LatMaxUs = u32LatUs;
 
+	pstrRing->u32Head = (pstrRing->u32Head + 1) % pstrRing->u32Depth;
+	pstrRing->u32Count--;
 
 	spin_unlock_irqrestore(&pHandle->strCriticalSection, flags);
 
@@ -181,4 +247,35 @@ signed int ATL_MsgQueueRecv(struct MsgQueueHandle *pHandle,
 	}
 	return s32RetStatus;
 }
-EXPORT_SYMBOL(ATL_MsgQueueRecv);
\ No newline at end of file
+EXPORT_SYMBOL(ATL_MsgQueueRecv);
+
+int ATL_MsgQueueStats(struct MsgQueueHandle *pHandle, char *pcBuf, int s32Size)
+{
+	static const char * const apcPrioName[MSG_PRIO_MAX] = {"high", "normal"};
+	struct MsgRing strRing;
+	unsigned long flags;
+	u64 u64AvgUs;
+	int i, s32Len = 0;
+
+	for (i = 0; i < MSG_PRIO_MAX; i++) {
+		spin_lock_irqsave(&pHandle->strCriticalSection, flags);
+		strRing = pHandle->astrRing[i];
+		spin_unlock_irqrestore(&pHandle->strCriticalSection, flags);
+
+		u64AvgUs = strRing.u64LatTotalUs;
+		if (strRing.u32Sent > strRing.u32Count)
+			do_div(u64AvgUs, strRing.u32Sent - strRing.u32Count);
+		else
+			u64AvgUs = 0;
+
+		s32Len += scnprintf(pcBuf + s32Len, s32Size - s32Len,
+				    "%-6s depth %u/%u max %u sent %u dropped %u lat avg %llu max %u us\n",
+				    apcPrioName[i], strRing.u32Count,
+				    strRing.u32Depth, strRing.u32MaxCount,
+				    strRing.u32Sent, strRing.u32Dropped,
+				    u64AvgUs, strRing.u32LatMaxUs);
+	}
+
+	return s32Len;
+}
+EXPORT_SYMBOL(ATL_MsgQueueStats);
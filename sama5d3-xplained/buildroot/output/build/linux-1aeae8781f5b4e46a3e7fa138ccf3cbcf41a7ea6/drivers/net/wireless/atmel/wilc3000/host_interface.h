@@ -114,6 +114,26 @@ struct tstrStatistics {
 	unsigned int u32TxFailureCount;
 };
 
+/*
+ * Read-mostly WIDs kept per interface and served from memory while
+ * younger than the cache TTL. The statistics WIDs must stay contiguous.
+ */
+enum tenuWidCacheIdx {
+	WID_CACHE_LINKSPEED	= 0,
+	WID_CACHE_RSSI,
+	WID_CACHE_TX_COUNT,
+	WID_CACHE_RX_COUNT,
+	WID_CACHE_TX_FAIL_COUNT,
+	WID_CACHE_CHNL,
+	WID_CACHE_MAX
+};
+
+struct tstrWidCacheEntry {
+	unsigned int u32Val;
+	unsigned long ulStamp;
+	bool bValid;
+};
+
 enum tenuHostIFstate {
 	HOST_IF_IDLE				= 0,
 	HOST_IF_SCANNING			= 1,
@@ -242,6 +262,8 @@ typedef void (*tWILCpfRemainOnChanReady)(void *);
 
 typedef void (*tWILCpfFrmToLinux)(u8 *, unsigned int, unsigned int);
 typedef void (*tWILCpfFreeEAPBuffParams)(void *);
+/* Periodic link statistics sample while connected */
+typedef void (*tWILCpfRssiSample)(struct tstrStatistics *, void *);
 
 /* unsigned int WFIDrvHandle; */
 struct WFIDrvHandle {
@@ -313,10 +335,6 @@ struct tstrHostIfSetMacAddress {
 	u8 u8MacAddress[ETH_ALEN];
 };
 
-struct tstrHostIfGetMacAddress {
-	u8 *u8MacAddress;
-};
-
 struct tstrHostIfBASessionInfo {
 	u8 au8Bssid[ETH_ALEN];
 	u8 u8Ted;
@@ -379,10 +397,9 @@ struct WILC_WFIDrv {
 	struct semaphore hSemTestKeyBlock;
 
 	struct semaphore hSemTestDisconnectBlock;
-	struct semaphore hSemGetRSSI;
-	struct semaphore hSemGetLINKSPEED;
-	struct semaphore hSemGetCHNL;
-	struct semaphore hSemInactiveTime;
+
+	spinlock_t strWidCacheLock;
+	struct tstrWidCacheEntry astrWidCache[WID_CACHE_MAX];
 
 	struct timer_list hScanTimer;
 	struct timer_list hConnectTimer;
@@ -392,6 +409,13 @@ struct WILC_WFIDrv {
 
 	bool IFC_UP;
 	int driver_handler_id;
+
+	/* link monitor fed from the periodic statistics refresh */
+	tWILCpfRssiSample pfRssiSample;
+	void *pvRssiUserArg;
+
+	/* listen interval in use before the PS policy overrode it, 0 if none */
+	u8 u8SavedListenInterval;
 };
 
 /*
@@ -747,6 +771,13 @@ signed int host_int_edit_station(struct WFIDrvHandle *hWFIDrv,
 signed int host_int_set_power_mgmt(struct WFIDrvHandle *hWFIDrv,
 				   bool bIsEnabled, unsigned int u32Timeout);
 
+/*
+ * Set the firmware power save mode, and the listen interval if non zero,
+ * without changing the power management state seen by the policy engine
+ */
+signed int host_int_set_power_mode(struct WFIDrvHandle *hWFIDrv,
+				   s8 s8PowerMode, u8 u8ListenInterval);
+
 /*
  * Set the multicast filter paramters
  */
@@ -816,9 +847,12 @@ static int host_int_addBASession(struct WFIDrvHandle *hWFIDrv, char *pBSSID,
 				 short int SessionTimeout, void *drvHandler);
 
 void host_int_freeJoinParams(void *pJoinParams);
+void *host_int_dupJoinParams(void *pJoinParams, void *pDest);
 
 signed int host_int_get_statistics(struct WFIDrvHandle *hWFIDrv,
 				   struct tstrStatistics *pstrStatistics);
+void host_int_set_rssi_monitor(struct WFIDrvHandle *hWFIDrv,
+			       tWILCpfRssiSample pfRssiSample, void *pvUserArg);
 
 void resolve_disconnect_aberration(void *drvHandler);
 
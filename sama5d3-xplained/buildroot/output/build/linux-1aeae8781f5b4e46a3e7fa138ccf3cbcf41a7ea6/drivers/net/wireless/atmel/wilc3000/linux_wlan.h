@@ -42,5 +42,7 @@ void frmw_to_linux(uint8_t *buff, uint32_t size, uint32_t pkt_offset);
 int linux_wlan_set_bssid(struct net_device *wilc_netdev, uint8_t *pBSSID);
 int wilc_wlan_init(struct net_device *dev, struct perInterface_wlan *p_nic);
 void linux_wlan_enable_irq(void);
+void wilc_ps_policy_enable(struct WILC_WFIDrv *drv, bool enabled);
+void wilc_ps_policy_stop(void);
 
 #endif /* WILC_LINUX_WLAN_H */
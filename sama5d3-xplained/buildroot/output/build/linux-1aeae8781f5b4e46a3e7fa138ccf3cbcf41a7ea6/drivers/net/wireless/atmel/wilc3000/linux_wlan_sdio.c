@@ -21,6 +21,7 @@
 #include <linux/mmc/sdio_ids.h>
 #include <linux/mmc/sdio.h>
 #include <linux/mmc/host.h>
+#include <linux/mmc/core.h>
 
 #include "linux_wlan_sdio.h"
 #include "linux_wlan_common.h"
@@ -76,13 +77,52 @@ static void wilc_sdio_interrupt(struct sdio_func *func)
 #endif /* WILC_SDIO_IRQ_GPIO */
 }
 
+/*
+ * Task holding the host for a whole HIF transaction, i.e. between
+ * acquire_bus() and release_bus(). Commands issued by that task skip
+ * their own claim/release.
+ */
+static struct task_struct *sdio_xact_owner;
+
+static uint32_t sdio_crc_errors;
+
+static inline void linux_sdio_claim(struct sdio_func *func)
+{
+	if (sdio_xact_owner != current)
+		sdio_claim_host(func);
+}
+
+static inline void linux_sdio_release(struct sdio_func *func)
+{
+	if (sdio_xact_owner != current)
+		sdio_release_host(func);
+}
+
+void linux_sdio_xact_begin(void)
+{
+	if ((NULL == local_sdio_func) || (sdio_xact_owner == current))
+		return;
+
+	sdio_claim_host(local_sdio_func);
+	sdio_xact_owner = current;
+}
+
+void linux_sdio_xact_end(void)
+{
+	if (sdio_xact_owner != current)
+		return;
+
+	sdio_xact_owner = NULL;
+	sdio_release_host(local_sdio_func);
+}
+
 int linux_sdio_cmd52(struct sdio_cmd52_t *cmd)
 {
 	struct sdio_func *func = local_sdio_func;
 	int ret;
 	u8 data;
 
-	sdio_claim_host(func);
+	linux_sdio_claim(func);
 
 	func->num = cmd->function;
 	if (cmd->read_write) {
@@ -98,9 +138,11 @@ int linux_sdio_cmd52(struct sdio_cmd52_t *cmd)
 		cmd->data = data;
 	}
 
-	sdio_release_host(func);
+	linux_sdio_release(func);
 
 	if (ret < 0) {
+		if (ret == -EILSEQ)
+			sdio_crc_errors++;
 		PRINT_ER("wilc_sdio_cmd52..failed, err(%d)\n", ret);
 		return 0;
 	}
@@ -112,7 +154,7 @@ int linux_sdio_cmd53(struct sdio_cmd53_t *cmd)
 	struct sdio_func *func = local_sdio_func;
 	int size, ret;
 
-	sdio_claim_host(func);
+	linux_sdio_claim(func);
 
 	func->num = cmd->function;
 	func->cur_blksize = cmd->block_size;
@@ -133,9 +175,11 @@ int linux_sdio_cmd53(struct sdio_cmd53_t *cmd)
 					 size);
 	}
 
-	sdio_release_host(func);
+	linux_sdio_release(func);
 
 	if (ret < 0) {
+		if (ret == -EILSEQ)
+			sdio_crc_errors++;
 		PRINT_ER("wilc_sdio_cmd53..failed, err(%d)\n", ret);
 		return 0;
 	}
@@ -143,6 +187,91 @@ int linux_sdio_cmd53(struct sdio_cmd53_t *cmd)
 	return 1;
 }
 
+/*
+ * Issue one CMD53 whose data phase is described by an sg list.
+ * Unlike linux_sdio_cmd53() this builds the mmc_request directly, so the
+ * function number and block size of the sdio_func are left untouched and
+ * a transfer made of several buffers goes out as a single command.
+ */
+int linux_sdio_cmd53_sg(struct sdio_cmd53_t *cmd, struct scatterlist *sg,
+			unsigned int sg_len)
+{
+	struct sdio_func *func = local_sdio_func;
+	struct mmc_card *card = func->card;
+	struct mmc_host *host = card->host;
+	struct mmc_request mrq;
+	struct mmc_command cmd53;
+	struct mmc_data data;
+	unsigned int blksz, blocks;
+	int ret;
+
+	if (cmd->block_mode) {
+		blksz = cmd->block_size;
+		blocks = cmd->count;
+	} else {
+		blksz = cmd->count;
+		blocks = 1;
+	}
+
+	if ((sg_len > host->max_segs) || (blocks > host->max_blk_count) ||
+	    (blksz > host->max_blk_size) ||
+	    ((blksz * blocks) > host->max_req_size)) {
+		PRINT_ER("wilc_sdio_cmd53_sg..request exceeds host limits\n");
+		return 0;
+	}
+
+	memset(&mrq, 0, sizeof(struct mmc_request));
+	memset(&cmd53, 0, sizeof(struct mmc_command));
+	memset(&data, 0, sizeof(struct mmc_data));
+
+	mrq.cmd = &cmd53;
+	mrq.data = &data;
+
+	cmd53.opcode = SD_IO_RW_EXTENDED;
+	cmd53.arg = cmd->read_write ? 0x80000000 : 0x00000000;
+	cmd53.arg |= cmd->function << 28;
+	cmd53.arg |= cmd->block_mode ? 0x08000000 : 0;
+	cmd53.arg |= cmd->increment ? 0x04000000 : 0;
+	cmd53.arg |= cmd->address << 9;
+	cmd53.arg |= cmd->count & 0x1ff;
+	cmd53.flags = MMC_RSP_SPI_R5 | MMC_RSP_R5 | MMC_CMD_ADTC;
+
+	data.blksz = blksz;
+	data.blocks = blocks;
+	data.flags = cmd->read_write ? MMC_DATA_WRITE : MMC_DATA_READ;
+	data.sg = sg;
+	data.sg_len = sg_len;
+
+	linux_sdio_claim(func);
+	mmc_set_data_timeout(&data, card);
+	mmc_wait_for_req(host, &mrq);
+	linux_sdio_release(func);
+
+	if (cmd53.error)
+		ret = cmd53.error;
+	else if (data.error)
+		ret = data.error;
+	else if (mmc_host_is_spi(host))
+		ret = 0;
+	else if (cmd53.resp[0] & R5_ERROR)
+		ret = -EIO;
+	else if (cmd53.resp[0] & R5_FUNCTION_NUMBER)
+		ret = -EINVAL;
+	else if (cmd53.resp[0] & R5_OUT_OF_RANGE)
+		ret = -ERANGE;
+	else
+		ret = 0;
+
+	if (ret < 0) {
+		if (ret == -EILSEQ)
+			sdio_crc_errors++;
+		PRINT_ER("wilc_sdio_cmd53_sg..failed, err(%d)\n", ret);
+		return 0;
+	}
+
+	return 1;
+}
+
 volatile int probe = 0;
 static int linux_sdio_probe(struct sdio_func *func,
 			    const struct sdio_device_id *id)
@@ -284,20 +413,49 @@ void disable_sdio_interrupt(void)
 }
 EXPORT_SYMBOL(disable_sdio_interrupt);
 
-static int linux_sdio_set_speed(int speed)
+/*
+ * Set the bus clock, clamped to what the host and the card support.
+ * Returns the clock actually programmed, 0 on failure.
+ */
+int linux_sdio_set_speed(int speed)
 {
-#if 0
-	struct mmc_ios ios;
-	sdio_claim_host(local_sdio_func);
-	
-	memcpy((void *)&ios,(void *)&local_sdio_func->card->host->ios,sizeof(struct mmc_ios));
-	local_sdio_func->card->host->ios.clock = speed;
-	ios.clock = speed;
-	local_sdio_func->card->host->ops->set_ios(local_sdio_func->card->host,&ios);
-	sdio_release_host(local_sdio_func);
-	PRINT_D(INIT_DBG,"@@@@@@@@@@@@ change SDIO speed to %d @@@@@@@@@\n", speed);
-#endif
-	return 1;
+	struct sdio_func *func = local_sdio_func;
+	struct mmc_host *host;
+	unsigned int max_dtr;
+
+	if (NULL == func)
+		return 0;
+
+	host = func->card->host;
+	max_dtr = host->f_max;
+	/* without high speed timing the CIS limit applies */
+	if ((host->ios.timing != MMC_TIMING_SD_HS) &&
+	    func->card->cis.max_dtr && (func->card->cis.max_dtr < max_dtr))
+		max_dtr = func->card->cis.max_dtr;
+
+	if ((unsigned int)speed > max_dtr)
+		speed = max_dtr;
+	if ((unsigned int)speed < host->f_min)
+		speed = host->f_min;
+
+	linux_sdio_claim(func);
+	host->ios.clock = speed;
+	host->ops->set_ios(host, &host->ios);
+	linux_sdio_release(func);
+
+	PRINT_D(INIT_DBG, "SDIO clock %d Hz, %s timing, %d-bit bus\n", speed,
+		(host->ios.timing == MMC_TIMING_SD_HS) ? "high speed" : "default",
+		(host->ios.bus_width == MMC_BUS_WIDTH_4) ? 4 : 1);
+
+	return speed;
+}
+
+/*
+ * Number of transfers that failed with a CRC error since probe.
+ */
+uint32_t linux_sdio_crc_errors(void)
+{
+	return sdio_crc_errors;
 }
 
 int linux_sdio_init(void *pv)
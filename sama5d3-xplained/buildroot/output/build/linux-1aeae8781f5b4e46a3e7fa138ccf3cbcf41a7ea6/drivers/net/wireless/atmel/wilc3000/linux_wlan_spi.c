@@ -194,3 +194,19 @@ int linux_spi_write_read(u8 *wb, u8 *rb, unsigned int rlen)
 
 	return ret;
 }
+
+/*
+ * Set the clock used by the following transfers, clamped to the
+ * device tree limit. Returns the clock actually used.
+ */
+int linux_spi_set_speed(uint32_t speed)
+{
+	if ((NULL != wilc_spi_dev) && (wilc_spi_dev->max_speed_hz) &&
+	    (speed > wilc_spi_dev->max_speed_hz))
+		speed = wilc_spi_dev->max_speed_hz;
+
+	SPEED = speed;
+	PRINT_D(BUS_DBG, "SPI clock %d Hz\n", SPEED);
+
+	return SPEED;
+}
@@ -24,9 +24,19 @@ struct wilc_spi {
 	int (*spi_tx)(uint8_t *, uint32_t);
 	int (*spi_rx)(uint8_t *, uint32_t);
 	int (*spi_trx)(uint8_t *, uint8_t *, uint32_t);
+	int (*spi_set_speed)(uint32_t);
+	/* crc7 on commands */
 	int crc_off;
+	/* crc16 on data packets */
+	int crc16_off;
 	int nint;
 	int has_thrpt_enh;
+	uint32_t crc_err_cnt;
+	/* index into spi_train_speeds, -1 until trained */
+	int speed_idx;
+	int max_speed_idx;
+	uint32_t err_cnt;
+	uint32_t clean_cnt;
 };
 
 static struct wilc_spi g_spi;
@@ -34,6 +44,24 @@ static struct wilc_spi g_spi;
 static int spi_read(uint32_t, uint8_t *, uint32_t);
 static int spi_write(uint32_t, uint8_t *, uint32_t);
 
+/*
+ * Clocks tried by link training, slowest first. The linux layer clamps
+ * them to the device tree limit.
+ */
+static const uint32_t spi_train_speeds[] = {
+	12000000, 16000000, 20000000, 24000000,
+	30000000, 36000000, 40000000, 48000000,
+};
+
+#define SPI_TRAIN_ADDR		WILC_AHB_DATA_MEM_BASE
+#define SPI_TRAIN_LEN		(4 * 1024)
+#define SPI_TRAIN_ROUNDS	2
+/* errors, without SPI_CLEAN_STEP_UP clean commands between them,
+ * before stepping the clock down */
+#define SPI_ERR_STEP_DOWN	3
+/* clean commands before trying one step faster again */
+#define SPI_CLEAN_STEP_UP	20000
+
 /*
  * Crc7
  */
@@ -84,6 +112,64 @@ static uint8_t crc7(uint8_t crc, const uint8_t *buffer, uint32_t len)
 	return crc;
 }
 
+/*
+ * Crc16 (ITU-T, poly 0x1021) on data packets, slice-by-4.
+ * Tables are built once, by the first spi_init().
+ */
+static uint16_t crc16_table[4][256];
+
+static void crc16_init_table(void)
+{
+	uint16_t crc;
+	int i, j;
+
+	/* entry 1 is the polynomial once built */
+	if (crc16_table[0][1])
+		return;
+
+	for (i = 0; i < 256; i++) {
+		crc = i << 8;
+		for (j = 0; j < 8; j++)
+			crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+		crc16_table[0][i] = crc;
+	}
+
+	for (j = 1; j < 4; j++)
+		for (i = 0; i < 256; i++)
+			crc16_table[j][i] = (crc16_table[j - 1][i] << 8) ^
+				crc16_table[0][crc16_table[j - 1][i] >> 8];
+}
+
+static uint16_t crc16(uint16_t crc, const uint8_t *buffer, uint32_t len)
+{
+	while (len >= 4) {
+		crc = crc16_table[3][buffer[0] ^ (crc >> 8)] ^
+		      crc16_table[2][buffer[1] ^ (crc & 0xff)] ^
+		      crc16_table[1][buffer[2]] ^
+		      crc16_table[0][buffer[3]];
+		buffer += 4;
+		len -= 4;
+	}
+
+	while (len--)
+		crc = (crc << 8) ^ crc16_table[0][(crc >> 8) ^ *buffer++];
+
+	return crc;
+}
+
+/*
+ * Returns 0 if the crc sent by the chip doesn't match the data.
+ */
+static int spi_crc16_check(const uint8_t *b, uint32_t sz, const uint8_t *crc)
+{
+	if ((((uint16_t)crc[0] << 8) | crc[1]) == crc16(0xffff, b, sz))
+		return 1;
+
+	g_spi.crc_err_cnt++;
+	PRINT_WRN(BUS_DBG, "Data crc16 error, %d so far\n", g_spi.crc_err_cnt);
+	return 0;
+}
+
 #define CMD_DMA_WRITE		0xc1
 #define CMD_DMA_READ		0xc2
 #define CMD_INTERNAL_WRITE	0xc3
@@ -105,6 +191,12 @@ static uint8_t crc7(uint8_t crc, const uint8_t *buffer, uint32_t len)
 #define DATA_PKT_SZ_4K		(4 * 1024)
 #define DATA_PKT_SZ_8K		(8 * 1024)
 #define DATA_PKT_SZ		DATA_PKT_SZ_8K
+/* commands redone after a data crc16 error */
+#define SPI_CRC_RETRY		3
+/* the slave answers a DMA write's data with a token, then a state byte */
+#define SPI_DATA_RSP_START	0xc0
+#define SPI_DATA_RSP_TOKEN	0xc3
+#define SPI_DATA_RSP_LEN	4
 
 static int spi_cmd(uint8_t cmd, uint32_t adr,
 		   uint32_t data, uint32_t sz, uint8_t clockless)
@@ -263,8 +355,8 @@ _fail_:
 	return result;
 }
 
-static int spi_cmd_complete(uint8_t cmd, uint32_t adr,
-			    uint8_t *b, uint32_t sz, uint8_t clockless)
+static int spi_cmd_xfer(uint8_t cmd, uint32_t adr,
+			uint8_t *b, uint32_t sz, uint8_t clockless)
 {
 	uint8_t wb[32], rb[32];
 	uint8_t wix, rix;
@@ -380,7 +472,7 @@ static int spi_cmd_complete(uint8_t cmd, uint32_t adr,
 	    (cmd == CMD_REPEAT)) {
 		len2 = len + (NUM_SKIP_BYTES + NUM_RSP_BYTES + NUM_DUMMY_BYTES);
 	} else if ((cmd == CMD_INTERNAL_READ) || (cmd == CMD_SINGLE_READ)) {
-		if (!g_spi.crc_off) {
+		if (!g_spi.crc16_off) {
 			len2 = len + (NUM_RSP_BYTES + NUM_DATA_HDR_BYTES
 				      + NUM_DATA_BYTES + NUM_CRC_BYTES
 				      + NUM_DUMMY_BYTES);
@@ -485,7 +577,7 @@ static int spi_cmd_complete(uint8_t cmd, uint32_t adr,
 				return result;
 			}
 
-			if (!g_spi.crc_off) {
+			if (!g_spi.crc16_off) {
 				/*
 				 * Read Crc
 				 */
@@ -497,6 +589,9 @@ static int spi_cmd_complete(uint8_t cmd, uint32_t adr,
 					result = N_FAIL;
 					return result;
 				}
+
+				if (!spi_crc16_check(b, 4, crc))
+					result = N_RETRY;
 			}
 		} else if ((cmd == CMD_DMA_READ) || (cmd == CMD_DMA_EXT_READ)) {
 			int ix;
@@ -530,12 +625,18 @@ static int spi_cmd_complete(uint8_t cmd, uint32_t adr,
 				/*
 				 * Read Crc
 				 */
-				if (!g_spi.crc_off) {
+				if (!g_spi.crc16_off) {
 					if (!g_spi.spi_rx(crc, 2)) {
 						PRINT_ER("crc read err\n");
 						result = N_FAIL;
 						goto _error_;
 					}
+					/*
+					 * keep draining the rest on error,
+					 * the read is redone as a whole
+					 */
+					if (!spi_crc16_check(b, ix + nbytes, crc))
+						result = N_RETRY;
 				}
 
 				ix += nbytes;
@@ -586,12 +687,14 @@ static int spi_cmd_complete(uint8_t cmd, uint32_t adr,
 				/*
 				 * Read Crc
 				 */
-				if (!g_spi.crc_off) {
+				if (!g_spi.crc16_off) {
 					if (!g_spi.spi_rx(crc, 2)) {
 						PRINT_ER("crc rx error\n");
 						result = N_FAIL;
 						break;
 					}
+					if (!spi_crc16_check(&b[ix], nbytes, crc))
+						result = N_RETRY;
 				}
 
 				ix += nbytes;
@@ -604,6 +707,53 @@ _error_:
 	return result;
 }
 
+/*
+ * Track command and response errors. Repeated errors step the clock
+ * down; a long clean run steps it back up, never past the trained clock.
+ */
+static void spi_link_account(int ok)
+{
+	if ((NULL == g_spi.spi_set_speed) || (g_spi.speed_idx < 0))
+		return;
+
+	if (ok) {
+		if (++g_spi.clean_cnt < SPI_CLEAN_STEP_UP)
+			return;
+		g_spi.clean_cnt = 0;
+		g_spi.err_cnt = 0;
+		if (g_spi.speed_idx < g_spi.max_speed_idx) {
+			g_spi.speed_idx++;
+			PRINT_D(BUS_DBG, "SPI link clean, clock up to %d Hz\n",
+				g_spi.spi_set_speed(spi_train_speeds[g_spi.speed_idx]));
+		}
+		return;
+	}
+
+	g_spi.clean_cnt = 0;
+	if (++g_spi.err_cnt < SPI_ERR_STEP_DOWN)
+		return;
+	g_spi.err_cnt = 0;
+	if (g_spi.speed_idx > 0) {
+		g_spi.speed_idx--;
+		PRINT_WRN(BUS_DBG, "SPI link errors, clock down to %d Hz\n",
+			  g_spi.spi_set_speed(spi_train_speeds[g_spi.speed_idx]));
+	}
+}
+
+static int spi_cmd_complete(uint8_t cmd, uint32_t adr,
+			    uint8_t *b, uint32_t sz, uint8_t clockless)
+{
+	int result;
+	int retry = SPI_CRC_RETRY;
+
+	do {
+		result = spi_cmd_xfer(cmd, adr, b, sz, clockless);
+		spi_link_account(result == N_OK);
+	} while ((result == N_RETRY) && (retry-- > 0));
+
+	return result;
+}
+
 static int spi_data_read(uint8_t *b, uint32_t sz)
 {
 	int retry, ix, nbytes;
@@ -656,12 +806,14 @@ static int spi_data_read(uint8_t *b, uint32_t sz)
 		/*
 		 * Read Crc
 		 */
-		if (!g_spi.crc_off) {
+		if (!g_spi.crc16_off) {
 			if (!g_spi.spi_rx(crc, 2)) {
 				PRINT_ER("crc rx error\n");
 				result = N_FAIL;
 				break;
 			}
+			if (!spi_crc16_check(&b[ix], nbytes, crc))
+				result = N_RETRY;
 		}
 
 		ix += nbytes;
@@ -676,7 +828,8 @@ static int spi_data_write(uint8_t *b, uint32_t sz)
 {
 	int ix, nbytes;
 	int result = 1;
-	uint8_t cmd, order, crc[2] = {0};
+	uint8_t cmd, order, crc[2];
+	uint16_t crc16_val;
 
 	/*
 	 * Data
@@ -722,7 +875,10 @@ static int spi_data_write(uint8_t *b, uint32_t sz)
 		/*
 		 * Write Crc
 		 */
-		if (!g_spi.crc_off) {
+		if (!g_spi.crc16_off) {
+			crc16_val = crc16(0xffff, &b[ix], nbytes);
+			crc[0] = (uint8_t)(crc16_val >> 8);
+			crc[1] = (uint8_t)crc16_val;
 			if (!g_spi.spi_tx(crc, 2)) {
 				PRINT_ER("crc write error\n");
 				result = N_FAIL;
@@ -737,6 +893,39 @@ static int spi_data_write(uint8_t *b, uint32_t sz)
 	return result;
 }
 
+/*
+ * Data response of a DMA write: a start byte (0xc in the high nibble,
+ * 0xc3 for the last packet) then the slave's state, zero if the data
+ * passed its crc16 check. Only the final packet's response is read, so
+ * leftover bytes of earlier responses, plus the byte the slave may take
+ * to turn around, can precede it; SPI_DATA_RSP_LEN bytes always contain
+ * the whole response and the last start byte found is the one that
+ * counts. No token at all means the data phase was never acknowledged.
+ */
+static int spi_data_rsp(void)
+{
+	uint8_t rsp[SPI_DATA_RSP_LEN];
+	int i;
+
+	if (!g_spi.spi_rx(rsp, sizeof(rsp))) {
+		PRINT_ER("data resp rx error\n");
+		return N_FAIL;
+	}
+
+	for (i = sizeof(rsp) - 2; i >= 0; i--)
+		if ((rsp[i] & 0xf0) == SPI_DATA_RSP_START)
+			break;
+
+	if ((i < 0) || (rsp[i] != SPI_DATA_RSP_TOKEN) || (rsp[i + 1] != 0)) {
+		g_spi.crc_err_cnt++;
+		PRINT_WRN(BUS_DBG, "Data write not acked (%02x %02x %02x %02x), %d so far\n",
+			  rsp[0], rsp[1], rsp[2], rsp[3], g_spi.crc_err_cnt);
+		return N_RETRY;
+	}
+
+	return N_OK;
+}
+
 /*
  * Spi Internal Read/Write Function
  */
@@ -853,6 +1042,7 @@ static int spi_write_reg(uint32_t addr, uint32_t data)
 static int spi_write(uint32_t addr, uint8_t *buf, uint32_t size)
 {
 	int result;
+	int retry = SPI_CRC_RETRY;
 	uint8_t cmd = CMD_DMA_EXT_WRITE;
 
 	/*
@@ -861,6 +1051,8 @@ static int spi_write(uint32_t addr, uint8_t *buf, uint32_t size)
 	if (size <= 4)
 		return 0;
 
+	/* the whole command is redone if the slave rejects the data */
+_retry_:
 #if defined USE_OLD_SPI_SW
 	/*
 	 * Command
@@ -888,8 +1080,17 @@ static int spi_write(uint32_t addr, uint8_t *buf, uint32_t size)
 	 * Data
 	 */
 	result = spi_data_write(buf, size);
-	if (result != N_OK)
+	if ((result == N_OK) && !g_spi.crc16_off)
+		result = spi_data_rsp();
+	if (result == N_RETRY) {
+		spi_link_account(0);
+		if (retry-- > 0)
+			goto _retry_;
+	}
+	if (result != N_OK) {
 		PRINT_ER("Failed block data write\n");
+		return 0;
+	}
 
 	return 1;
 }
@@ -1040,6 +1241,71 @@ static int spi_sync(void)
 	return 1;
 }
 
+/*
+ * Ramp the clock up while a pattern loops intact through chip data
+ * memory, then settle one step below the first clock that failed.
+ * Runs with crc on commands and data, before the firmware is downloaded.
+ */
+static void spi_train_link(void)
+{
+	uint8_t *tx, *rx;
+	int i, k, round, ok = 1;
+	int best = -1, speed, prev_speed = 0;
+
+	if (NULL == g_spi.spi_set_speed)
+		return;
+
+	tx = kmalloc(SPI_TRAIN_LEN * 2, GFP_KERNEL);
+	if (NULL == tx) {
+		PRINT_ER("Can't allocate spi training buffer\n");
+		return;
+	}
+	rx = tx + SPI_TRAIN_LEN;
+
+	for (i = 0; i < ARRAY_SIZE(spi_train_speeds); i++) {
+		speed = g_spi.spi_set_speed(spi_train_speeds[i]);
+		/* clamped, nothing faster to try */
+		if (speed == prev_speed)
+			break;
+		prev_speed = speed;
+
+		for (round = 0; ok && (round < SPI_TRAIN_ROUNDS); round++) {
+			for (k = 0; k < SPI_TRAIN_LEN; k++)
+				tx[k] = (uint8_t)(k + round) ^
+					((k & 1) ? 0xaa : 0x55);
+
+			if (!spi_write(SPI_TRAIN_ADDR, tx, SPI_TRAIN_LEN) ||
+			    !spi_read(SPI_TRAIN_ADDR, rx, SPI_TRAIN_LEN) ||
+			    memcmp(tx, rx, SPI_TRAIN_LEN))
+				ok = 0;
+		}
+		if (!ok) {
+			PRINT_D(BUS_DBG, "SPI %d Hz: pattern mismatch\n", speed);
+			break;
+		}
+		best = i;
+	}
+
+	kfree(tx);
+
+	/*
+	 * margin: one step below the fastest clock that passed, only when a
+	 * mismatch ended training; a clamp or the end of the table is no
+	 * sign of a marginal link.
+	 */
+	if (!ok && (best > 0))
+		best--;
+	if (best < 0) {
+		PRINT_ER("SPI link training failed, using slowest clock\n");
+		best = 0;
+	}
+
+	g_spi.max_speed_idx = best;
+	g_spi.speed_idx = best;
+	PRINT_D(INIT_DBG, "SPI link trained to %d Hz\n",
+		g_spi.spi_set_speed(spi_train_speeds[best]));
+}
+
 static int spi_init(struct wilc_wlan_inp *inp)
 {
 	uint32_t reg;
@@ -1056,6 +1322,7 @@ static int spi_init(struct wilc_wlan_inp *inp)
 	}
 
 	memset(&g_spi, 0, sizeof(struct wilc_spi));
+	crc16_init_table();
 
 	g_spi.os_context = inp->os_context.os_private;
 	if (inp->io_func.io_init) {
@@ -1070,11 +1337,14 @@ static int spi_init(struct wilc_wlan_inp *inp)
 	g_spi.spi_tx = inp->io_func.u.spi.spi_tx;
 	g_spi.spi_rx = inp->io_func.u.spi.spi_rx;
 	g_spi.spi_trx = inp->io_func.u.spi.spi_trx;
+	g_spi.spi_set_speed = inp->io_func.u.spi.spi_set_speed;
+	g_spi.speed_idx = -1;
 
 	/*
 	 * configure protocol
 	 */
 	g_spi.crc_off = 0;
+	g_spi.crc16_off = 0;
 
 	/*
 	 * TODO: We can remove the CRC trials if there is a definite way
@@ -1082,32 +1352,39 @@ static int spi_init(struct wilc_wlan_inp *inp)
 	 */
 	if (!spi_internal_read(WILC_SPI_PROTOCOL_OFFSET, &reg)) {
 		/*
-		 * Read failed. Try with CRC off.
-		 * This might happen when module is removed but
-		 * chip isn't reset
+		 * Read failed. Try with crc7 only, as left by a previous
+		 * load of this driver when the chip wasn't reset.
 		 */
-		g_spi.crc_off = 1;
-		PRINT_ER("internal read err with CRC on,retyring with CRC off\n");
+		g_spi.crc16_off = 1;
+		PRINT_ER("internal read err with CRC on,retyring with crc7 only\n");
 		if (!spi_internal_read(WILC_SPI_PROTOCOL_OFFSET, &reg)) {
 			/*
-			 * Read failed with both CRC on and off,
-			 * something went bad
+			 * Read failed. Try with CRC off.
 			 */
-			PRINT_ER("Failed internal read protocol\n");
-			return 0;
+			g_spi.crc_off = 1;
+			PRINT_ER("internal read err with crc7,retyring with CRC off\n");
+			if (!spi_internal_read(WILC_SPI_PROTOCOL_OFFSET, &reg)) {
+				/*
+				 * Read failed with every CRC setting,
+				 * something went bad
+				 */
+				PRINT_ER("Failed internal read protocol\n");
+				return 0;
+			}
 		}
 	}
 
-	if (g_spi.crc_off == 0)	{
-		reg &= ~0xc;    /* disable crc checking */
-		reg &= ~0x70;
-		reg |= (0x5 << 4);
-		if (!spi_internal_write(WILC_SPI_PROTOCOL_OFFSET, reg)) {
-			PRINT_ER("Failed internal write reg\n");
-			return 0;
-		}
-		g_spi.crc_off = 1;
+	reg |= 0xc;	/* crc7 on commands, crc16 on data */
+	reg &= ~0x70;
+	reg |= (0x5 << 4);
+	if (!spi_internal_write(WILC_SPI_PROTOCOL_OFFSET, reg)) {
+		PRINT_ER("Failed internal write reg\n");
+		return 0;
 	}
+	g_spi.crc_off = 0;
+	g_spi.crc16_off = 0;
+
+	spi_train_link();
 
 	/*
 	 * make sure can read back chip id correctly
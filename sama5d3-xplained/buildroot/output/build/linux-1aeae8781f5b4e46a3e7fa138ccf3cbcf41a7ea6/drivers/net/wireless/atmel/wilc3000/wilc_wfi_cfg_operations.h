@@ -84,6 +84,10 @@ extern struct timer_list hDuringIpTimer;
 #define nl80211_SCAN_RESULT_EXPIRE	(3 * HZ)
 #define SCAN_RESULT_EXPIRE		(40 * HZ)
 
+#define SCHED_SCAN_MAX_MATCH_SETS	MAX_NUM_PROBED_SSID
+/* Retry delay when a scheduled scan pass finds the scanner busy */
+#define SCHED_SCAN_RETRY_MS		1000
+
 static const u32 cipher_suites[] = {
 	WLAN_CIPHER_SUITE_WEP40,
 	WLAN_CIPHER_SUITE_WEP104,
@@ -132,6 +136,7 @@ void WILC_WFI_WiphyFree(struct net_device *net);
 int WILC_WFI_update_stats(struct wiphy *wiphy, u32 pktlen, u8 changed);
 int WILC_WFI_DeInitHostInt(struct net_device *net);
 int WILC_WFI_InitHostInt(struct net_device *net);
+void WILC_WFI_fast_reconn_recover(struct net_device *net);
 int WILC_WFI_deinit_mon_interface(void);
 struct net_device *WILC_WFI_init_mon_interface(const char *name,
 					       struct net_device *real_dev);
@@ -16,6 +16,7 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <linux/crc32.h>
 #include "wilc_wlan_if.h"
 #include "wilc_wlan.h"
 #include "at_pwr_dev.h"
@@ -32,15 +33,17 @@ struct wilc_wlan_dev {
 
 	/* host interface functions */
 	struct wilc_hif_func hif_func;
-	void *hif_lock;
 
 	/* configuration interface functions */
 	struct wilc_cfg_func cif_func;
-	int cfg_frame_in_use;
+	/* frame being built, owned from start until commit */
+	struct mutex cfg_build_lock;
 	struct wilc_cfg_frame cfg_frame;
 	uint32_t cfg_frame_offset;
 	int cfg_seq_no;
-	void *cfg_wait;
+	spinlock_t cfg_req_lock;
+	wait_queue_head_t cfg_req_wq;
+	struct wilc_cfg_req cfg_req[WILC_CFG_MAX_INFLIGHT];
 
 	/* RX buffer */
 #ifdef MEMORY_STATIC
@@ -78,6 +81,9 @@ struct wilc_wlan_dev {
 
 static struct wilc_wlan_dev g_wlan;
 
+static void wilc_wlan_cfg_req_complete(uint8_t seq_no, int status);
+static void wilc_wlan_cfg_abort_all(void);
+
 static void wilc_wlan_txq_remove(struct txq_entry_t *tqe)
 {
 	struct wilc_wlan_dev *p = (struct wilc_wlan_dev *)&g_wlan;
@@ -412,13 +418,11 @@ static int wilc_wlan_txq_add_cfg_pkt(uint8_t *buffer, uint32_t buffer_size)
 	PRINT_D(TX_DBG, "Adding config packet ...\n");
 	if (p->quit) {
 		PRINT_D(TX_DBG, "Return due to clear function\n");
-		up(p->cfg_wait);
 		return 0;
 	}
 
 	if (!(g_wlan.initialized)) {
 		PRINT_D(TX_DBG, "not_init, return from cfg_pkt\n");
-		up(p->cfg_wait);
 		return 0;
 	}
 
@@ -625,7 +629,7 @@ void chip_sleep_manually(unsigned int u32SleepTime, int source)
 	/* Trigger the manual sleep interrupt host_interrupt_4 */
 	g_wlan.hif_func.hif_write_reg(0x10B8, 1);
 
-	genuChipPSstate = CHIP_SLEEPING_MANUAL;
+	chip_ps_state_set(CHIP_SLEEPING_MANUAL);
 	release_bus(RELEASE_ONLY, PWR_DEV_SRC_WIFI);
 }
 
@@ -667,6 +671,12 @@ static int wilc_wlan_handle_txq(uint32_t *pu32TxqCount)
 	#ifdef	TCP_ACK_FILTER
 		wilc_wlan_txq_filter_dup_tcp_ack();
 	#endif
+		/*
+		 * Own the bus while building the vmm list so that the
+		 * contention check below sees who queued up behind us.
+		 */
+		acquire_bus_prio(ACQUIRE_AND_WAKEUP, PWR_DEV_SRC_WIFI, BUS_PRIO_TX);
+
 		/* build the vmm list */
 		PRINT_D(TX_DBG, "Getting the head of the TxQ\n");
 		tqe = wilc_wlan_txq_get_first();
@@ -700,6 +710,14 @@ static int wilc_wlan_handle_txq(uint32_t *pu32TxqCount)
 				if ((sum + vmm_sz) > p->tx_buffer_size)
 					break;
 
+				/*
+				 * keep the aggregate short while RX waits for
+				 * the bus, the rest goes in the next round.
+				 */
+				if ((i > 0) && ((sum + vmm_sz) > WILC_TX_YIELD_SIZE) &&
+				    bus_arb_contended(BUS_PRIO_TX))
+					break;
+
 				PRINT_D(TX_DBG, "VMM Size AFTER alignment = %d\n", vmm_sz);
 				vmm_table[i] = vmm_sz / 4;
 				PRINT_D(TX_DBG, "VMMTable entry size = %d\n", vmm_table[i]);
@@ -722,12 +740,12 @@ static int wilc_wlan_handle_txq(uint32_t *pu32TxqCount)
 
 		if (i == 0) {	/* nothing in the queue */
 			PRINT_D(TX_DBG, "Nothing in TX-Q\n");
+			release_bus(RELEASE_ALLOW_SLEEP, PWR_DEV_SRC_WIFI);
 			break;
 		}
 
 		vmm_table[i] = 0x0; /* mark the last element to 0 */
 
-		acquire_bus(ACQUIRE_AND_WAKEUP, PWR_DEV_SRC_WIFI);
 		counter = 0;
 		do {
 			ret = p->hif_func.hif_read_reg(WILC_HOST_TX_CTRL, &reg);
@@ -912,7 +930,7 @@ static int wilc_wlan_handle_txq(uint32_t *pu32TxqCount)
 			}
 		} while (--entries);
 
-		acquire_bus(ACQUIRE_AND_WAKEUP, PWR_DEV_SRC_WIFI);
+		acquire_bus_prio(ACQUIRE_AND_WAKEUP, PWR_DEV_SRC_WIFI, BUS_PRIO_TX);
 
 		ret = p->hif_func.hif_clear_int_ext(ENABLE_TX_VMM);
 		if (!ret) {
@@ -954,7 +972,7 @@ static void wilc_wlan_handle_rxq(void)
 	do {
 		if (p->quit) {
 			PRINT_D(TX_DBG, "exit 1st do-while due to Clean_UP function\n");
-			up(p->cfg_wait);
+			wilc_wlan_cfg_abort_all();
 			break;
 		}
 		rqe = wilc_wlan_rxq_remove();
@@ -1016,10 +1034,9 @@ static void wilc_wlan_handle_rxq(void)
 
 					p->cif_func.rx_indicate(&buffer[pkt_offset + offset], pkt_len, &rsp);
 					if (rsp.type == WILC_CFG_RSP) {
-						/* wake up the waiting task */
-						PRINT_D(TX_DBG, "p->cfg_seq_no = %d - rsp.seq_no = %d\n", p->cfg_seq_no, rsp.seq_no);
-						if (p->cfg_seq_no == rsp.seq_no)
-							up(p->cfg_wait);
+						/* complete the matching request */
+						PRINT_D(TX_DBG, "rsp.seq_no = %d\n", rsp.seq_no);
+						wilc_wlan_cfg_req_complete(rsp.seq_no, 1);
 					} else if (rsp.type == WILC_CFG_RSP_STATUS) {
 						/* Call back to indicate status */
 						if (p->indicate_func.mac_indicate)
@@ -1171,7 +1188,7 @@ void wilc_handle_isr(void)
 {
 	uint32_t int_status;
 
-	acquire_bus(ACQUIRE_AND_WAKEUP, PWR_DEV_SRC_WIFI);
+	acquire_bus_prio(ACQUIRE_AND_WAKEUP, PWR_DEV_SRC_WIFI, BUS_PRIO_RX);
 	g_wlan.hif_func.hif_read_int(&int_status);
 
 	if (int_status & PLL_INT_EXT)
@@ -1190,30 +1207,206 @@ void wilc_handle_isr(void)
 	release_bus(RELEASE_ALLOW_SLEEP, PWR_DEV_SRC_WIFI);
 }
 
+/*
+ * Firmware is pushed through a DMA-safe bounce buffer (the blob itself is
+ * vmalloc'd). The burst is a multiple of both the SPI data packet (8KB)
+ * and the SDIO block size so each write goes out as whole packets/blocks;
+ * small platforms that cannot spare it fall back to a page.
+ */
+#define FW_DL_BURST_SZ		(32 * 1024)
+#define FW_DL_BURST_SZ_MIN	(4 * 1024)
+
+static uint8_t *fw_dma_alloc(uint32_t *blksz)
+{
+	uint8_t *dma_buffer;
+
+	*blksz = FW_DL_BURST_SZ;
+	dma_buffer = kmalloc(*blksz, GFP_KERNEL | __GFP_NOWARN);
+	if (NULL == dma_buffer) {
+		*blksz = FW_DL_BURST_SZ_MIN;
+		dma_buffer = kmalloc(*blksz, GFP_KERNEL);
+	}
+	return dma_buffer;
+}
+
+/* The image is a list of sections: address, size, then size bytes */
+static void fw_section_hdr(const uint8_t *buffer, uint32_t offset,
+			   uint32_t *addr, uint32_t *size)
+{
+	memcpy(addr, &buffer[offset], 4);
+	memcpy(size, &buffer[offset + 4], 4);
+#ifdef BIG_ENDIAN
+	*addr = BYTE_SWAP(*addr);
+	*size = BYTE_SWAP(*size);
+#endif
+}
+
+/*
+ * Warm start. wilc_wlan_stop() only holds the WiFi CPU in reset; the chip
+ * stays powered until the module goes away and normally keeps its
+ * memories. Each wilc_wlan_fw_snapshot() reads the IRAM sections of the
+ * image back in full; those that still match may be skipped by the next
+ * download. Data sections are always downloaded since the firmware writes
+ * to them. A close arms one download: start retries and anything
+ * unexpected download in full.
+ */
+#define FW_WARM_MAX_SECT	32
+#define FW_WARM_SAMPLES		8
+#define FW_WARM_SAMPLE_SZ	32
+
+static struct {
+	uint32_t size;
+	uint32_t crc;
+	uint32_t clean;		/* IRAM sections that matched at the last close */
+	int armed;		/* the next download may skip them */
+} fw_warm;
+
+/*
+ * Samples every clean section at a few points. Called with the bus held
+ * and the CPU in reset.
+ */
+static int fw_warm_verify(const uint8_t *buffer, uint32_t buffer_size,
+			  uint32_t clean, uint8_t *dma_buffer)
+{
+	struct wilc_wlan_dev *p = (struct wilc_wlan_dev *)&g_wlan;
+	uint32_t offset = 0;
+	uint32_t addr, size, pos, len;
+	int sect = 0, i;
+
+	while ((offset + 8 <= buffer_size) && (sect < FW_WARM_MAX_SECT)) {
+		fw_section_hdr(buffer, offset, &addr, &size);
+		offset += 8;
+		if (size > buffer_size - offset)
+			return 0;
+
+		for (i = 0; (clean & BIT(sect)) && i < FW_WARM_SAMPLES; i++) {
+			pos = (size / FW_WARM_SAMPLES * i) & ~3;
+			len = size - pos;
+			if (len > FW_WARM_SAMPLE_SZ)
+				len = FW_WARM_SAMPLE_SZ;
+			if (!len)
+				break;
+			if (!p->hif_func.hif_block_rx(addr + pos, dma_buffer, len) ||
+			    memcmp(dma_buffer, &buffer[offset + pos], len)) {
+				PRINT_D(INIT_DBG, "Warm start: fw section %d changed\n", sect);
+				return 0;
+			}
+		}
+		offset += size;
+		sect++;
+	}
+
+	return 1;
+}
+
+/* Reads the IRAM sections back; returns those that still match */
+static uint32_t fw_warm_learn(const uint8_t *buffer, uint32_t buffer_size,
+			      uint8_t *dma_buffer, uint32_t blksz)
+{
+	struct wilc_wlan_dev *p = (struct wilc_wlan_dev *)&g_wlan;
+	uint32_t offset = 0;
+	uint32_t addr, size, size2;
+	uint32_t clean = 0;
+	int sect = 0, dirty;
+
+	while ((offset + 8 <= buffer_size) && (sect < FW_WARM_MAX_SECT)) {
+		fw_section_hdr(buffer, offset, &addr, &size);
+		offset += 8;
+		if (size > buffer_size - offset)
+			break;
+
+		/* only code can be trusted to be as the image left it */
+		dirty = (addr < WILC_AHB_IRAM_BASE) || (addr >= WILC_AHB_IRAM_END) ||
+			(size > WILC_AHB_IRAM_END - addr);
+		while (size && !dirty) {
+			size2 = (size <= blksz) ? size : blksz;
+			if (!p->hif_func.hif_block_rx(addr, dma_buffer, size2) ||
+			    memcmp(dma_buffer, &buffer[offset], size2))
+				dirty = 1;
+			addr += size2;
+			offset += size2;
+			size -= size2;
+		}
+		offset += size;
+
+		if (!dirty)
+			clean |= BIT(sect);
+		sect++;
+	}
+
+	PRINT_D(INIT_DBG, "Warm start: %d of %d fw sections reusable\n",
+		hweight32(clean), sect);
+	return clean;
+}
+
+/* Called after wilc_wlan_stop() on a regular close, never on recovery */
+static void wilc_wlan_fw_snapshot(const uint8_t *buffer, uint32_t buffer_size)
+{
+	uint32_t blksz;
+	uint8_t *dma_buffer;
+
+	fw_warm.armed = 0;
+	fw_warm.clean = 0;
+
+	dma_buffer = fw_dma_alloc(&blksz);
+	if (NULL == dma_buffer)
+		return;
+
+	acquire_bus(ACQUIRE_AND_WAKEUP, PWR_DEV_SRC_WIFI);
+	fw_warm.size = buffer_size;
+	fw_warm.crc = crc32_le(~0, buffer, buffer_size);
+	fw_warm.clean = fw_warm_learn(buffer, buffer_size, dma_buffer, blksz);
+	fw_warm.armed = (fw_warm.clean != 0);
+	release_bus(RELEASE_ALLOW_SLEEP, PWR_DEV_SRC_WIFI);
+	kfree(dma_buffer);
+}
+
+/*
+ * Returns the sections that can be skipped by this download. Called with
+ * the bus held and the CPU in reset.
+ */
+static uint32_t fw_warm_check(const uint8_t *buffer, uint32_t buffer_size,
+			      uint8_t *dma_buffer)
+{
+	if (!fw_warm.armed)
+		return 0;
+	fw_warm.armed = 0;
+
+	if (!fw_warm.clean || (fw_warm.size != buffer_size) ||
+	    (fw_warm.crc != crc32_le(~0, buffer, buffer_size)))
+		return 0;
+
+	if (!fw_warm_verify(buffer, buffer_size, fw_warm.clean, dma_buffer)) {
+		PRINT_D(INIT_DBG, "Warm start: fw memory lost, full download\n");
+		return 0;
+	}
+
+	return fw_warm.clean;
+}
+
 static int wilc_wlan_firmware_download(const uint8_t *buffer, uint32_t buffer_size)
 {
 	struct wilc_wlan_dev *p = (struct wilc_wlan_dev *)&g_wlan;
 	uint32_t offset;
 	uint32_t addr, size, size2, blksz;
+	uint32_t clean, written = 0;
 	uint8_t *dma_buffer;
-	int ret = 0;
+	int ret = 0, sect;
 	uint32_t reg = 0;
 
-	/* 4KB Good enough size for most platforms = PAGE_SIZE. */
-	blksz = (1ul << 12);
-	/* Allocate a DMA coherent  buffer. */
-	dma_buffer = kmalloc(blksz, GFP_KERNEL);
+	dma_buffer = fw_dma_alloc(&blksz);
 	if (NULL == dma_buffer) {
 		ret = -5;
 		PRINT_ER("Can't allocate buffer for fw download IO error\n");
 		goto _fail_1;
 	}
 
-	PRINT_D(TX_DBG, "Downloading firmware size = %d\n", buffer_size);
+	PRINT_D(TX_DBG, "Downloading firmware size = %d in %d byte bursts\n", buffer_size, blksz);
 
-	/* Reset the CPU before changing IRAM */
+	/* Hold the bus for the whole download rather than per section */
 	acquire_bus(ACQUIRE_AND_WAKEUP, PWR_DEV_SRC_WIFI);
 
+	/* Reset the CPU before changing IRAM */
 	p->hif_func.hif_read_reg(WILC_GLB_RESET_0, &reg);
 	reg &= ~(1ul << 10);
 	ret = p->hif_func.hif_write_reg(WILC_GLB_RESET_0, reg);
@@ -1221,19 +1414,19 @@ static int wilc_wlan_firmware_download(const uint8_t *buffer, uint32_t buffer_si
 	if ((reg & (1ul << 10)) != 0)
 		PRINT_ER("Failed to reset Wifi CPU\n");
 
-	release_bus(RELEASE_ONLY, PWR_DEV_SRC_WIFI);
+	clean = fw_warm_check(buffer, buffer_size, dma_buffer);
 
 	/* load the firmware */
 	offset = 0;
+	sect = 0;
 	do {
-		memcpy(&addr, &buffer[offset], 4);
-		memcpy(&size, &buffer[offset + 4], 4);
-	#ifdef BIG_ENDIAN
-		addr = BYTE_SWAP(addr);
-		size = BYTE_SWAP(size);
-	#endif
-		acquire_bus(ACQUIRE_AND_WAKEUP, PWR_DEV_SRC_WIFI);
+		fw_section_hdr(buffer, offset, &addr, &size);
 		offset += 8;
+		if ((sect < FW_WARM_MAX_SECT) && (clean & BIT(sect++))) {
+			offset += size;
+			continue;
+		}
+		written += size;
 		while (((int)size) && (offset < buffer_size)) {
 			if (size <= blksz)
 				size2 = size;
@@ -1250,17 +1443,21 @@ static int wilc_wlan_firmware_download(const uint8_t *buffer, uint32_t buffer_si
 			offset += size2;
 			size -= size2;
 		}
-		release_bus(RELEASE_ALLOW_SLEEP, PWR_DEV_SRC_WIFI);
 
 		if (!ret) {
 			ret = -5;
 			PRINT_ER("Can't download firmware IO error\n");
-			goto _fail_;
+			break;
 		}
 		PRINT_D(TX_DBG, "Offset = %d\n", offset);
 	} while (offset < buffer_size);
 
-_fail_:
+	release_bus(RELEASE_ALLOW_SLEEP, PWR_DEV_SRC_WIFI);
+
+	if (clean)
+		PRINT_D(INIT_DBG, "Warm start: wrote %d of %d fw bytes\n",
+			written, buffer_size);
+
 	kfree(dma_buffer);
 _fail_1:
 	return (ret < 0) ? ret : 0;
@@ -1276,7 +1473,7 @@ static int wilc_bt_firmware_download(const uint8_t *buffer, uint32_t buffer_size
 	int ret = 0;
 	uint32_t reg;
 
-	mutex_lock(p->hif_lock);
+	acquire_bus(ACQUIRE_ONLY, PWR_DEV_SRC_WIFI);
 
 	p->hif_func.hif_read_reg(0x3B0400, &reg);
 
@@ -1288,7 +1485,7 @@ static int wilc_bt_firmware_download(const uint8_t *buffer, uint32_t buffer_size
 		reg &= ~(1ul << 2);
 	}
 	p->hif_func.hif_write_reg(0x3B0400, reg);
-	mutex_unlock(p->hif_lock);
+	release_bus(RELEASE_ONLY, PWR_DEV_SRC_WIFI);
 
 	/* blocks of sizes > 512 causes the wifi to hang */
 	blksz = (1ul << 9);
@@ -1310,7 +1507,7 @@ static int wilc_bt_firmware_download(const uint8_t *buffer, uint32_t buffer_size
 	addr = BYTE_SWAP(addr);
 	size = BYTE_SWAP(size);
 #endif
-	mutex_lock(p->hif_lock);
+	acquire_bus(ACQUIRE_ONLY, PWR_DEV_SRC_WIFI);
 	offset = 0;
 
 	while (((int)size) && (offset < buffer_size)) {
@@ -1328,7 +1525,7 @@ static int wilc_bt_firmware_download(const uint8_t *buffer, uint32_t buffer_size
 		offset += size2;
 		size -= size2;
 	}
-	mutex_unlock(p->hif_lock);
+	release_bus(RELEASE_ONLY, PWR_DEV_SRC_WIFI);
 
 	if (!ret) {
 		ret = -5;
@@ -1459,7 +1656,7 @@ static int wilc_wlan_stop(void)
 	int ret;
 	uint8_t timeout = 10;
 
-	/* stop the firmware, need a re-download */
+	/* stop the firmware, need a (warm) re-download */
 	acquire_bus(ACQUIRE_AND_WAKEUP, PWR_DEV_SRC_WIFI);
 
 	/*
@@ -1564,7 +1761,7 @@ static int wilc_bt_start(void)
 	uint32_t val32 = 0;
 	int ret = 0;
 
-	mutex_lock(p->hif_lock);
+	acquire_bus(ACQUIRE_ONLY, PWR_DEV_SRC_WIFI);
 
 	/*
 	 * Write the firmware download complete magic value 0x10ADD09E at
@@ -1582,7 +1779,7 @@ static int wilc_bt_start(void)
 	val32 |= ((1ul << 2) | (1ul << 3));
 	p->hif_func.hif_write_reg(0x3B0400, val32);
 
-	mutex_unlock(p->hif_lock);
+	release_bus(RELEASE_ONLY, PWR_DEV_SRC_WIFI);
 
 	return (ret < 0) ? ret : 0;
 }
@@ -1595,9 +1792,14 @@ static void wilc_wlan_cleanup(void)
 	struct rxq_entry_t *rqe;
 	uint32_t reg = 0;
 	int ret;
+	int i;
 
 	p->quit = 1;
 
+	wilc_wlan_cfg_abort_all();
+	for (i = 0; i < WILC_CFG_MAX_INFLIGHT; i++)
+		cancel_delayed_work_sync(&p->cfg_req[i].timeout_work);
+
 	/* clean up the queue */
 	do {
 		tqe = wilc_wlan_txq_remove_from_head();
@@ -1642,13 +1844,143 @@ static void wilc_wlan_cleanup(void)
 	release_bus(RELEASE_ALLOW_SLEEP, PWR_DEV_SRC_WIFI);
 }
 
-static int wilc_wlan_cfg_commit(int type, uint32_t drvHandler)
+static struct wilc_cfg_req *wilc_wlan_cfg_req_alloc(void)
+{
+	struct wilc_wlan_dev *p = (struct wilc_wlan_dev *)&g_wlan;
+	struct wilc_cfg_req *req = NULL;
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&p->cfg_req_lock, flags);
+	for (i = 0; i < WILC_CFG_MAX_INFLIGHT; i++) {
+		if (p->cfg_req[i].state == WILC_CFG_REQ_FREE) {
+			req = &p->cfg_req[i];
+			req->state = WILC_CFG_REQ_CLAIMED;
+			break;
+		}
+	}
+	spin_unlock_irqrestore(&p->cfg_req_lock, flags);
+
+	return req;
+}
+
+static void wilc_wlan_cfg_req_free(struct wilc_cfg_req *req)
+{
+	struct wilc_wlan_dev *p = (struct wilc_wlan_dev *)&g_wlan;
+	unsigned long flags;
+
+	spin_lock_irqsave(&p->cfg_req_lock, flags);
+	req->state = WILC_CFG_REQ_FREE;
+	req->func = NULL;
+	req->priv = NULL;
+	spin_unlock_irqrestore(&p->cfg_req_lock, flags);
+	wake_up(&p->cfg_req_wq);
+}
+
+/*
+ * Finish the request waiting for seq_no. Callback requests are run and
+ * released here, waiters are woken up and release the request themselves.
+ */
+static void wilc_wlan_cfg_req_complete(uint8_t seq_no, int status)
+{
+	struct wilc_wlan_dev *p = (struct wilc_wlan_dev *)&g_wlan;
+	struct wilc_cfg_req *req = NULL;
+	unsigned long flags;
+	int run_func = 0;
+	int i;
+
+	spin_lock_irqsave(&p->cfg_req_lock, flags);
+	for (i = 0; i < WILC_CFG_MAX_INFLIGHT; i++) {
+		if ((p->cfg_req[i].state == WILC_CFG_REQ_PENDING) &&
+		    (p->cfg_req[i].seq_no == seq_no)) {
+			req = &p->cfg_req[i];
+			req->status = status;
+			if (req->func) {
+				req->state = WILC_CFG_REQ_CLAIMED;
+				run_func = 1;
+			} else {
+				req->state = WILC_CFG_REQ_DONE;
+				complete(&req->done);
+			}
+			break;
+		}
+	}
+	spin_unlock_irqrestore(&p->cfg_req_lock, flags);
+
+	if (req == NULL) {
+		PRINT_D(TX_DBG, "No cfg request for seq_no %d\n", seq_no);
+		return;
+	}
+
+	if (run_func) {
+		cancel_delayed_work(&req->timeout_work);
+		req->func(req->priv, status);
+		wilc_wlan_cfg_req_free(req);
+	}
+}
+
+static void wilc_wlan_cfg_abort_all(void)
 {
 	struct wilc_wlan_dev *p = (struct wilc_wlan_dev *)&g_wlan;
-	struct wilc_cfg_frame *cfg = &p->cfg_frame;
+	int i;
+
+	for (i = 0; i < WILC_CFG_MAX_INFLIGHT; i++) {
+		if (p->cfg_req[i].state == WILC_CFG_REQ_PENDING)
+			wilc_wlan_cfg_req_complete(p->cfg_req[i].seq_no, 0);
+	}
+}
+
+static void wilc_wlan_cfg_req_timeout(struct work_struct *work)
+{
+	struct wilc_wlan_dev *p = (struct wilc_wlan_dev *)&g_wlan;
+	struct wilc_cfg_req *req = container_of(to_delayed_work(work),
+						struct wilc_cfg_req,
+						timeout_work);
+	unsigned long flags;
+	int expired = 0;
+
+	spin_lock_irqsave(&p->cfg_req_lock, flags);
+	if ((req->state == WILC_CFG_REQ_PENDING) &&
+	    time_after_eq(jiffies, req->deadline)) {
+		req->state = WILC_CFG_REQ_CLAIMED;
+		expired = 1;
+	}
+	spin_unlock_irqrestore(&p->cfg_req_lock, flags);
+
+	if (expired) {
+		PRINT_ER("Cfg request seq_no %d timed out\n", req->seq_no);
+		req->func(req->priv, 0);
+		wilc_wlan_cfg_req_free(req);
+	}
+}
+
+/*
+ * Move the frame built by wilc_wlan_cfg_set()/get() into a free in-flight
+ * request and queue it, so the next frame can be built right away.
+ */
+static struct wilc_cfg_req *wilc_wlan_cfg_commit(int type, uint32_t drvHandler,
+						 wilc_cfg_done_func_t func,
+						 void *priv)
+{
+	struct wilc_wlan_dev *p = (struct wilc_wlan_dev *)&g_wlan;
+	struct wilc_cfg_req *req = NULL;
+	struct wilc_cfg_frame *cfg;
 	int total_len = p->cfg_frame_offset + 4 + DRIVER_HANDLER_SIZE;
 	int seq_no = p->cfg_seq_no % 256;
 	int driver_handler = (unsigned int)drvHandler;
+	unsigned long flags;
+
+	if (!wait_event_timeout(p->cfg_req_wq,
+				(req = wilc_wlan_cfg_req_alloc()) != NULL,
+				msecs_to_jiffies(CFG_PKTS_TIMEOUT))) {
+		PRINT_ER("No free cfg request\n");
+		p->cfg_frame_offset = 0;
+		return NULL;
+	}
+	cfg = &req->cfg;
+	memcpy(cfg->frame, p->cfg_frame.frame, p->cfg_frame_offset);
+	p->cfg_frame_offset = 0;
+	p->cfg_seq_no = seq_no + 1;
 
 	/* Set up header */
 	if (type == WILC_CFG_SET)
@@ -1665,13 +1997,94 @@ static int wilc_wlan_cfg_commit(int type, uint32_t drvHandler)
 	cfg->wid_header[5] = (uint8_t)(driver_handler >> 8);
 	cfg->wid_header[6] = (uint8_t)(driver_handler >> 16);
 	cfg->wid_header[7] = (uint8_t)(driver_handler >> 24);
-	p->cfg_seq_no = seq_no;
+
+	req->seq_no = seq_no;
+	req->status = 0;
+	req->func = func;
+	req->priv = priv;
+	req->deadline = jiffies + msecs_to_jiffies(CFG_PKTS_TIMEOUT);
+	init_completion(&req->done);
+	spin_lock_irqsave(&p->cfg_req_lock, flags);
+	req->state = WILC_CFG_REQ_PENDING;
+	spin_unlock_irqrestore(&p->cfg_req_lock, flags);
+
+	PRINT_D(TX_DBG, "PACKET Commit with sequence no.%d\n", seq_no);
 
 	/* Add to TX queue */
-	if (!wilc_wlan_txq_add_cfg_pkt(&cfg->wid_header[0], total_len))
-		return -1;
+	if (!wilc_wlan_txq_add_cfg_pkt(&cfg->wid_header[0], total_len)) {
+		wilc_wlan_cfg_req_free(req);
+		return NULL;
+	}
 
-	return 0;
+	if (func)
+		schedule_delayed_work(&req->timeout_work,
+				      msecs_to_jiffies(CFG_PKTS_TIMEOUT));
+
+	return req;
+}
+
+/*
+ * Wait for the response to a request queued without a callback, then
+ * release it. Returns 1 if the firmware answered in time.
+ */
+static int wilc_wlan_cfg_wait(struct wilc_cfg_req *req)
+{
+	struct wilc_wlan_dev *p = (struct wilc_wlan_dev *)&g_wlan;
+	unsigned long flags;
+	int status;
+
+	wait_for_completion_timeout(&req->done,
+				    msecs_to_jiffies(CFG_PKTS_TIMEOUT));
+
+	spin_lock_irqsave(&p->cfg_req_lock, flags);
+	status = (req->state == WILC_CFG_REQ_DONE) ? req->status : 0;
+	spin_unlock_irqrestore(&p->cfg_req_lock, flags);
+	wilc_wlan_cfg_req_free(req);
+
+	return status;
+}
+
+/*
+ * Send the WIDs staged so far and wait for the answer, used when the next
+ * WID of a multi-WID request does not fit into MAX_CFG_FRAME_SIZE.
+ */
+static int wilc_wlan_cfg_flush(int type, uint32_t drvHandler)
+{
+	struct wilc_cfg_req *req;
+
+	PRINT_D(TX_DBG, "Cfg frame full, committing %d bytes\n",
+		g_wlan.cfg_frame_offset);
+	req = wilc_wlan_cfg_commit(type, drvHandler, NULL, NULL);
+	if (req == NULL || !wilc_wlan_cfg_wait(req)) {
+		PRINT_ER("Cfg frame flush failed\n");
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * A frame is built over several wilc_wlan_cfg_set()/get() calls, from
+ * start to commit. The builder holds cfg_build_lock over all of them so
+ * that another caller can't slip its WIDs in; it is dropped as soon as
+ * the frame has been copied into its request, or when building fails.
+ */
+static void wilc_wlan_cfg_build_begin(int start)
+{
+	struct wilc_wlan_dev *p = (struct wilc_wlan_dev *)&g_wlan;
+
+	if (start) {
+		mutex_lock(&p->cfg_build_lock);
+		p->cfg_frame_offset = 0;
+	}
+}
+
+static void wilc_wlan_cfg_build_end(void)
+{
+	struct wilc_wlan_dev *p = (struct wilc_wlan_dev *)&g_wlan;
+
+	p->cfg_frame_offset = 0;
+	mutex_unlock(&p->cfg_build_lock);
 }
 
 static int wilc_wlan_cfg_set(int start, uint32_t wid,
@@ -1679,36 +2092,42 @@ static int wilc_wlan_cfg_set(int start, uint32_t wid,
 			     int commit, uint32_t drvHandler)
 {
 	struct wilc_wlan_dev *p = (struct wilc_wlan_dev *)&g_wlan;
+	struct wilc_cfg_req *req;
 	uint32_t offset;
 	int ret_size;
 
-	if (p->cfg_frame_in_use)
-		return 0;
-
-	if (start)
-		p->cfg_frame_offset = 0;
+	wilc_wlan_cfg_build_begin(start);
 
 	offset = p->cfg_frame_offset;
 	ret_size = p->cif_func.cfg_wid_set(p->cfg_frame.frame, offset,
 					   (uint16_t)wid, buffer,
 					   buffer_size);
+	if ((ret_size == 0) && (offset != 0)) {
+		/* frame is full, send what we have and start a new one */
+		if (!wilc_wlan_cfg_flush(WILC_CFG_SET, drvHandler)) {
+			wilc_wlan_cfg_build_end();
+			return 0;
+		}
+		offset = 0;
+		ret_size = p->cif_func.cfg_wid_set(p->cfg_frame.frame, offset,
+						   (uint16_t)wid, buffer,
+						   buffer_size);
+	}
+	if (ret_size == 0) {
+		PRINT_ER("Can't add WID 0x%x to cfg frame\n", wid);
+		wilc_wlan_cfg_build_end();
+		return 0;
+	}
 	offset += ret_size;
 	p->cfg_frame_offset = offset;
 
 	if (commit) {
-		PRINT_D(TX_DBG, "PACKET Commit with sequence no.%d\n", p->cfg_seq_no);
-		p->cfg_frame_in_use = 1;
-
-		if (wilc_wlan_cfg_commit(WILC_CFG_SET, drvHandler))
-			ret_size = 0;
-
-		if (down_timeout(p->cfg_wait, msecs_to_jiffies(CFG_PKTS_TIMEOUT))) {
+		req = wilc_wlan_cfg_commit(WILC_CFG_SET, drvHandler, NULL, NULL);
+		wilc_wlan_cfg_build_end();
+		if (req == NULL || !wilc_wlan_cfg_wait(req)) {
 			PRINT_D(TX_DBG, "Set Timed Out\n");
 			ret_size = 0;
 		}
-		p->cfg_frame_in_use = 0;
-		p->cfg_frame_offset = 0;
-		p->cfg_seq_no += 1;
 	}
 
 	return ret_size;
@@ -1718,41 +2137,63 @@ static int wilc_wlan_cfg_get(int start, uint32_t wid,
 			     int commit, uint32_t drvHandler)
 {
 	struct wilc_wlan_dev *p = (struct wilc_wlan_dev *)&g_wlan;
+	struct wilc_cfg_req *req;
 	uint32_t offset;
 	int ret_size;
 
-	if (p->cfg_frame_in_use)
-		return 0;
-
-	if (start)
-		p->cfg_frame_offset = 0;
+	wilc_wlan_cfg_build_begin(start);
 
 	offset = p->cfg_frame_offset;
 	ret_size = p->cif_func.cfg_wid_get(p->cfg_frame.frame,
 					   offset,
 					   (uint16_t)wid);
+	if ((ret_size == 0) && (offset != 0)) {
+		if (!wilc_wlan_cfg_flush(WILC_CFG_QUERY, drvHandler)) {
+			wilc_wlan_cfg_build_end();
+			return 0;
+		}
+		offset = 0;
+		ret_size = p->cif_func.cfg_wid_get(p->cfg_frame.frame,
+						   offset,
+						   (uint16_t)wid);
+	}
+	if (ret_size == 0) {
+		PRINT_ER("Can't add WID 0x%x to cfg frame\n", wid);
+		wilc_wlan_cfg_build_end();
+		return 0;
+	}
 	offset += ret_size;
 	p->cfg_frame_offset = offset;
 
 	if (commit) {
-		p->cfg_frame_in_use = 1;
-
-		if (wilc_wlan_cfg_commit(WILC_CFG_QUERY, drvHandler))
-			ret_size = 0;
-
-		if (down_timeout(p->cfg_wait, msecs_to_jiffies(CFG_PKTS_TIMEOUT))) {
+		req = wilc_wlan_cfg_commit(WILC_CFG_QUERY, drvHandler, NULL, NULL);
+		wilc_wlan_cfg_build_end();
+		if (req == NULL || !wilc_wlan_cfg_wait(req)) {
 			PRINT_D(TX_DBG, "Get Timed Out\n");
 			ret_size = 0;
 		}
 		PRINT_D(TX_DBG, "Get Response received\n");
-		p->cfg_frame_in_use = 0;
-		p->cfg_frame_offset = 0;
-		p->cfg_seq_no += 1;
 	}
 
 	return ret_size;
 }
 
+/*
+ * Queue the frame built with commit = 0 without waiting for the answer.
+ * func is called with 1 on the response or 0 on timeout or cleanup.
+ */
+static int wilc_wlan_cfg_commit_async(int type, uint32_t drvHandler,
+				      wilc_cfg_done_func_t func, void *priv)
+{
+	struct wilc_cfg_req *req = NULL;
+
+	if (func != NULL)
+		req = wilc_wlan_cfg_commit(type, drvHandler, func, priv);
+	wilc_wlan_cfg_build_end();
+
+	return (req != NULL);
+}
+
 static int wilc_wlan_cfg_get_val(uint32_t wid, uint8_t *buffer,
 				 uint32_t buffer_size)
 {
@@ -1874,6 +2315,7 @@ uint8_t core_11b_ready(void)
 int at_wlan_init(struct wilc_wlan_inp *inp, struct wilc_wlan_oup *oup)
 {
 	int ret = 0;
+	int i;
 
 	PRINT_D(TX_DBG, "Initializing WILC_Wlan\n");
 
@@ -1882,14 +2324,12 @@ int at_wlan_init(struct wilc_wlan_inp *inp, struct wilc_wlan_oup *oup)
 	g_wlan.io_type = inp->io_func.io_type;
 	memcpy(&g_wlan.net_func, &inp->net_func, sizeof(struct wilc_wlan_net_func));
 	memcpy(&g_wlan.indicate_func, &inp->indicate_func, sizeof(struct wilc_wlan_net_func));
-	g_wlan.hif_lock = inp->os_context.hif_critical_section;
 	g_wlan.txq_lock = inp->os_context.txq_critical_section;
 	g_wlan.txq_add_to_head_lock = inp->os_context.txq_add_to_head_critical_section;
 	g_wlan.txq_spinlock = inp->os_context.txq_spin_lock;
 	g_wlan.rxq_lock = inp->os_context.rxq_critical_section;
 	g_wlan.txq_wait = inp->os_context.txq_wait_event;
 	g_wlan.rxq_wait = inp->os_context.rxq_wait_event;
-	g_wlan.cfg_wait = inp->os_context.cfg_wait_event;
 	g_wlan.tx_buffer_size = inp->os_context.tx_buffer_size;
 #ifdef MEMORY_STATIC
 	g_wlan.rx_buffer_size = inp->os_context.rx_buffer_size;
@@ -1913,6 +2353,15 @@ int at_wlan_init(struct wilc_wlan_inp *inp, struct wilc_wlan_oup *oup)
 	}
 	memcpy(&g_wlan.cif_func, &mac_cfg, sizeof(struct wilc_cfg_func));
 
+	mutex_init(&g_wlan.cfg_build_lock);
+	spin_lock_init(&g_wlan.cfg_req_lock);
+	init_waitqueue_head(&g_wlan.cfg_req_wq);
+	for (i = 0; i < WILC_CFG_MAX_INFLIGHT; i++) {
+		init_completion(&g_wlan.cfg_req[i].done);
+		INIT_DELAYED_WORK(&g_wlan.cfg_req[i].timeout_work,
+				  wilc_wlan_cfg_req_timeout);
+	}
+
 	if (NULL == g_wlan.tx_buffer)
 		g_wlan.tx_buffer = kmalloc(g_wlan.tx_buffer_size, GFP_KERNEL);
 
@@ -1947,6 +2396,7 @@ int at_wlan_init(struct wilc_wlan_inp *inp, struct wilc_wlan_oup *oup)
 	oup->bt_start = wilc_bt_start;
 #endif
 	oup->wlan_stop = wilc_wlan_stop;
+	oup->wlan_fw_snapshot = wilc_wlan_fw_snapshot;
 	oup->wlan_add_to_tx_que = wilc_wlan_txq_add_net_pkt;
 	oup->wlan_handle_tx_que = wilc_wlan_handle_txq;
 	oup->wlan_handle_rx_que = wilc_wlan_handle_rxq;
@@ -1955,6 +2405,7 @@ int at_wlan_init(struct wilc_wlan_inp *inp, struct wilc_wlan_oup *oup)
 	oup->wlan_cfg_set = wilc_wlan_cfg_set;
 	oup->wlan_cfg_get = wilc_wlan_cfg_get;
 	oup->wlan_cfg_get_value = wilc_wlan_cfg_get_val;
+	oup->wlan_cfg_commit_async = wilc_wlan_cfg_commit_async;
 
 #if defined(WILC_AP_EXTERNAL_MLME) || defined(WILC_P2P)
 	oup->wlan_add_mgmt_to_tx_que = wilc_wlan_txq_add_mgmt_pkt;
@@ -16,6 +16,7 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <linux/hash.h>
 #include "wilc_wlan_if.h"
 #include "wilc_wlan.h"
 #include "wilc_wlan_cfg.h"
@@ -155,6 +156,86 @@ static struct wilc_cfg_str_t g_cfg_str[] = {
 	{WID_NIL, NULL}
 };
 
+/*
+ * WID -> slot lookup. A single open-addressed table, filled from the
+ * lists above at init, maps every cached WID to its list and index. A few
+ * WIDs are filed in a list other than the one their type bits name; the
+ * lookup checks the list so those never alias a slot of another list.
+ */
+#define WILC_CFG_HASH_BITS	8
+#define WILC_CFG_HASH_SIZE	(1 << WILC_CFG_HASH_BITS)
+
+struct wilc_cfg_hash_t {
+	uint16_t id;
+	uint8_t type;	/* WID_CHAR..WID_STR: the list idx points into */
+	uint8_t idx;
+};
+
+static struct wilc_cfg_hash_t g_cfg_hash[WILC_CFG_HASH_SIZE];
+
+static int wilc_wlan_cfg_hash_add(uint16_t id, uint8_t type, int idx)
+{
+	uint32_t h = hash_32(id, WILC_CFG_HASH_BITS);
+	int n;
+
+	for (n = 0; n < WILC_CFG_HASH_SIZE; n++) {
+		/* keep the first slot of WIDs listed twice (site survey) */
+		if (g_cfg_hash[h].id == id)
+			return 1;
+		if (g_cfg_hash[h].id == WID_NIL) {
+			g_cfg_hash[h].id = id;
+			g_cfg_hash[h].type = type;
+			g_cfg_hash[h].idx = idx;
+			return 1;
+		}
+		h = (h + 1) & (WILC_CFG_HASH_SIZE - 1);
+	}
+
+	PRINT_ER("[CFG]: WID lookup table full (%04x)\n", id);
+	return 0;
+}
+
+static int wilc_wlan_cfg_lookup(uint32_t wid, uint8_t type)
+{
+	uint32_t h = hash_32(wid, WILC_CFG_HASH_BITS);
+	int n;
+
+	for (n = 0; n < WILC_CFG_HASH_SIZE; n++) {
+		if (g_cfg_hash[h].id == wid) {
+			if (g_cfg_hash[h].type != type)
+				return -1;
+			return g_cfg_hash[h].idx;
+		}
+		if (g_cfg_hash[h].id == WID_NIL)
+			break;
+		h = (h + 1) & (WILC_CFG_HASH_SIZE - 1);
+	}
+
+	return -1;
+}
+
+static int wilc_wlan_cfg_hash_init(void)
+{
+	int i;
+
+	memset(g_cfg_hash, 0xff, sizeof(g_cfg_hash));
+
+	for (i = 0; g_cfg_byte[i].id != WID_NIL; i++)
+		if (!wilc_wlan_cfg_hash_add(g_cfg_byte[i].id, WID_CHAR, i))
+			return 0;
+	for (i = 0; g_cfg_hword[i].id != WID_NIL; i++)
+		if (!wilc_wlan_cfg_hash_add(g_cfg_hword[i].id, WID_SHORT, i))
+			return 0;
+	for (i = 0; g_cfg_word[i].id != WID_NIL; i++)
+		if (!wilc_wlan_cfg_hash_add(g_cfg_word[i].id, WID_INT, i))
+			return 0;
+	for (i = 0; g_cfg_str[i].id != WID_NIL; i++)
+		if (!wilc_wlan_cfg_hash_add(g_cfg_str[i].id, WID_STR, i))
+			return 0;
+
+	return 1;
+}
+
 static int wilc_wlan_cfg_set_byte(uint8_t *frame, uint32_t offset,
 				  uint16_t id, uint8_t val8)
 {
@@ -261,85 +342,57 @@ static int wilc_wlan_cfg_set_bin(uint8_t *frame, uint32_t offset,
 
 static void wilc_wlan_parse_response_frame(uint8_t *info, int size)
 {
-	uint32_t wid, len = 0, i;
+	uint32_t wid, len = 0;
+	int i;
 	static int seq;
 
 	while (size > 0) {
-		i = 0;
 		wid = info[0] | (info[1] << 8);
 	#ifdef BIG_ENDIAN
 		wid = BYTE_SWAP(wid);
 	#endif
 		PRINT_INFO(GENERIC_DBG,"Processing response for %d seq %d\n", wid, seq++);
+		i = wilc_wlan_cfg_lookup(wid, (wid >> 12) & 0x7);
 		switch ((wid >> 12) & 0x7) {
 		case WID_CHAR:
-			do {
-				if (g_cfg_byte[i].id == WID_NIL)
-					break;
-
-				if (g_cfg_byte[i].id == wid) {
-					g_cfg_byte[i].val = info[3];
-					break;
-				}
-				i++;
-			} while (1);
+			if (i >= 0)
+				g_cfg_byte[i].val = info[3];
 			len = 2;
 			break;
 		case WID_SHORT:
-			do {
-				if (g_cfg_hword[i].id == WID_NIL)
-					break;
-
-				if (g_cfg_hword[i].id == wid) {
-				#ifdef BIG_ENDIAN
-					g_cfg_hword[i].val = (info[3] << 8) | (info[4]);
-				#else
-					g_cfg_hword[i].val = info[3] | (info[4] << 8);
-				#endif
-					break;
-				}
-				i++;
-			} while (1);
+			if (i >= 0) {
+			#ifdef BIG_ENDIAN
+				g_cfg_hword[i].val = (info[3] << 8) | (info[4]);
+			#else
+				g_cfg_hword[i].val = info[3] | (info[4] << 8);
+			#endif
+			}
 			len = 3;
 			break;
 		case WID_INT:
-			do {
-				if (g_cfg_word[i].id == WID_NIL)
-					break;
-
-				if (g_cfg_word[i].id == wid) {
-				#ifdef BIG_ENDIAN
-					g_cfg_word[i].val = (info[3] << 24) | (info[4] << 16) | (info[5] << 8) | (info[6]);
-				#else
-					g_cfg_word[i].val = info[3] | (info[4] << 8) | (info[5] << 16) | (info[6] << 24);
-				#endif
-					break;
-				}
-				i++;
-			} while (1);
+			if (i >= 0) {
+			#ifdef BIG_ENDIAN
+				g_cfg_word[i].val = (info[3] << 24) | (info[4] << 16) | (info[5] << 8) | (info[6]);
+			#else
+				g_cfg_word[i].val = info[3] | (info[4] << 8) | (info[5] << 16) | (info[6] << 24);
+			#endif
+			}
 			len = 5;
 			break;
 		case WID_STR:
-			do {
-				if (g_cfg_str[i].id == WID_NIL)
-					break;
-
-				if (g_cfg_str[i].id == wid) {
-					if (wid == WID_SITE_SURVEY_RESULTS) {
-						static int toggle;
-
-						PRINT_INFO(GENERIC_DBG,"Site survey results received %d\n",
-							   size);
-
-						PRINT_INFO(GENERIC_DBG,"Site survey results value %d toggle%d\n", size, toggle);
-						i += toggle;
-						toggle ^= 1;
-					}
-					memcpy(g_cfg_str[i].str, &info[2], (info[2] + 1));
-					break;
+			if (i >= 0) {
+				if (wid == WID_SITE_SURVEY_RESULTS) {
+					static int toggle;
+
+					PRINT_INFO(GENERIC_DBG,"Site survey results received %d\n",
+						   size);
+
+					PRINT_INFO(GENERIC_DBG,"Site survey results value %d toggle%d\n", size, toggle);
+					i += toggle;
+					toggle ^= 1;
 				}
-				i++;
-			} while (1);
+				memcpy(g_cfg_str[i].str, &info[2], (info[2] + 1));
+			}
 			len = 1 + info[2];
 			break;
 		default:
@@ -420,69 +473,39 @@ static int wilc_wlan_cfg_get_wid_value(uint16_t wid, uint8_t *buffer,
 		return 4;
 	}
 
-	i = 0;
+	if (type > 3) {
+		PRINT_ER("[CFG]: illegal type (%08x)\n", wid);
+		return 0;
+	}
+
+	i = wilc_wlan_cfg_lookup(wid, type);
+	if (i < 0)
+		return 0;
+
 	if (type == 0) {	/* byte command */
-		do {
-			if (g_cfg_byte[i].id == WID_NIL)
-				break;
-
-			if (g_cfg_byte[i].id == wid) {
-				memcpy(buffer,  &g_cfg_byte[i].val, 1);
-				ret = 1;
-				break;
-			}
-			i++;
-		} while (1);
+		memcpy(buffer,  &g_cfg_byte[i].val, 1);
+		ret = 1;
 	} else if (type == 1) {	/* half word command */
-		do {
-			if (g_cfg_hword[i].id == WID_NIL)
-				break;
-
-			if (g_cfg_hword[i].id == wid) {
-				memcpy(buffer,  &g_cfg_hword[i].val, 2);
-				ret = 2;
-				break;
-			}
-			i++;
-		} while (1);
+		memcpy(buffer,  &g_cfg_hword[i].val, 2);
+		ret = 2;
 	} else if (type == 2) {	/* word command */
-		do {
-			if (g_cfg_word[i].id == WID_NIL)
-				break;
-
-			if (g_cfg_word[i].id == wid) {
-				memcpy(buffer,  &g_cfg_word[i].val, 4);
-				ret = 4;
-				break;
-			}
-			i++;
-		} while (1);
-	} else if (type == 3) {	/* string command */
-		do {
-			if (g_cfg_str[i].id == WID_NIL)
-				break;
-
-			if (g_cfg_str[i].id == wid) {
-				uint32_t size =  g_cfg_str[i].str[0];
-
-				if (buffer_size >= size) {
-					if (g_cfg_str[i].id == WID_SITE_SURVEY_RESULTS)	{
-						static int toggle;
-
-						PRINT_INFO(GENERIC_DBG,"Site survey results%d\n",
-							 size);
-						i += toggle;
-						toggle ^= 1;
-					}
-					memcpy(buffer,  &g_cfg_str[i].str[1], size);
-					ret = size;
-				}
-				break;
+		memcpy(buffer,  &g_cfg_word[i].val, 4);
+		ret = 4;
+	} else {		/* string command */
+		uint32_t size =  g_cfg_str[i].str[0];
+
+		if (buffer_size >= size) {
+			if (wid == WID_SITE_SURVEY_RESULTS) {
+				static int toggle;
+
+				PRINT_INFO(GENERIC_DBG,"Site survey results%d\n",
+					 size);
+				i += toggle;
+				toggle ^= 1;
 			}
-			i++;
-		} while (1);
-	} else {
-		PRINT_ER("[CFG]: illegal type (%08x)\n", wid);
+			memcpy(buffer,  &g_cfg_str[i].str[1], size);
+			ret = size;
+		}
 	}
 	return ret;
 }
@@ -575,7 +598,7 @@ static int wilc_wlan_cfg_indicate_rx(uint8_t *frame, int size, struct wilc_cfg_r
 static int wilc_wlan_cfg_init(void)
 {
 	memset((void *)&g_mac, 0, sizeof(struct wilc_mac_cfg_t));
-	return 1;
+	return wilc_wlan_cfg_hash_init();
 }
 
 struct wilc_cfg_func mac_cfg = {
@@ -59,6 +59,17 @@ enum BUS_RELEASE {
 	RELEASE_ALLOW_SLEEP	= 1,
 };
 
+/*
+ * Bus arbitration classes, highest priority first. Waiters of a lower
+ * class are passed over at most BUS_ARB_MAX_BYPASS times in a row.
+ */
+enum BUS_PRIO {
+	BUS_PRIO_RX		= 0,
+	BUS_PRIO_CTRL		= 1,
+	BUS_PRIO_TX		= 2,
+	BUS_PRIO_MAX
+};
+
 enum CHIP_PS_STATE {
 	CHIP_WAKEDUP		= 0,
 	CHIP_SLEEPING_AUTO	= 1,
@@ -78,7 +89,6 @@ struct wilc_wlan_os_context {
 #endif
 	void *rxq_critical_section;
 	void *rxq_wait_event;
-	void *cfg_wait_event;
 };
 
 struct wilc_wlan_io_func {
@@ -89,12 +99,20 @@ struct wilc_wlan_io_func {
 		struct {
 			int (*sdio_cmd52)(struct sdio_cmd52_t *);
 			int (*sdio_cmd53)(struct sdio_cmd53_t *);
+			int (*sdio_cmd53_sg)(struct sdio_cmd53_t *,
+					     struct scatterlist *,
+					     unsigned int);
 			int (*sdio_set_max_speed)(void);
+			int (*sdio_set_speed)(int);
+			uint32_t (*sdio_crc_errors)(void);
+			void (*sdio_xact_begin)(void);
+			void (*sdio_xact_end)(void);
 		} sdio;
 		struct {
 			int (*spi_tx)(uint8_t *, uint32_t);
 			int (*spi_rx)(uint8_t *, uint32_t);
 			int (*spi_trx)(uint8_t *, uint8_t *, uint32_t);
+			int (*spi_set_speed)(uint32_t);
 		} spi;
 	} u;
 };
@@ -130,6 +148,8 @@ struct wilc_hif_func {
 	int (*hif_block_tx_ext)(uint32_t, uint8_t *, uint32_t);
 	int (*hif_block_rx_ext)(uint32_t, uint8_t *, uint32_t);
 	int (*hif_sync_ext)(int);
+	void (*hif_xact_begin)(void);
+	void (*hif_xact_end)(void);
 };
 
 /*TicketId883*/
@@ -194,6 +214,7 @@ void wilc_set_pf_change_coex_mode(WILCpfChangeCoexMode pfChangeCoexMode);
 
 void chip_allow_sleep(int source);
 void chip_wakeup(int source);
+void chip_ps_state_set(enum CHIP_PS_STATE state);
 void set_pf_chip_sleep_manually(void (*chip_sleep_manually_address)(unsigned int , int ));
 
 
@@ -205,6 +226,9 @@ void set_pf_host_sleep_notify(void (*host_sleep_notify_address)( int ));
 
 void set_pf_get_u8SuspendOnEvent_value(int (*get_u8SuspendOnEvent_val)(void));
 void acquire_bus(enum BUS_ACQUIRE acquire, int source);
+void acquire_bus_prio(enum BUS_ACQUIRE acquire, int source,
+		      enum BUS_PRIO prio);
 void release_bus(enum BUS_RELEASE release, int source);
+int bus_arb_contended(enum BUS_PRIO prio);
 struct mutex *at_pwr_dev_get_bus_lock(void);
 #endif /* AT_PWR_DEV_H */
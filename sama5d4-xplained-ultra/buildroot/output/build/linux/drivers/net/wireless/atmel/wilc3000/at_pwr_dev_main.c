@@ -32,6 +32,12 @@
 #include <linux/device.h>
 #include <linux/cdev.h>
 #include <linux/firmware.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/debugfs.h>
+#include <linux/uaccess.h>
 #ifdef WILC_SDIO
 #include "linux_wlan_sdio.h"
 #include <linux/mmc/host.h>
@@ -45,13 +51,80 @@
 
 #define DOWNLOAD_BT_FW_ONCE
 
+/*
+ * Sleep hysteresis: release_bus(RELEASE_ALLOW_SLEEP) lets the chip sleep
+ * only after twice the average gap between bus uses, bounded by these.
+ * With longer gaps the chip is allowed to sleep right away.
+ */
+#define PS_HYST_MIN_MS		2
+#define PS_HYST_MAX_MS		50
+
+/*
+ * Bus arbiter: waiters queue per BUS_PRIO class in front of hif_cs and the
+ * highest class is granted first.
+ */
+#define BUS_ARB_MAX_BYPASS	8
+
+/* Time histograms use buckets of <16us, <64us, ... , >=16ms */
+#define PWR_DEV_HIST_BUCKETS	7
+
+/* What made the chip wake up, see chip_wakeup() */
+enum PS_WAKE_REASON {
+	PS_WAKE_TX	= 0,
+	PS_WAKE_RX	= 1,
+	PS_WAKE_CFG	= 2,
+	PS_WAKE_BT	= 3,
+	PS_WAKE_OTHER	= 4,
+	PS_WAKE_MAX
+};
+
 unsigned int int_clrd;
 
+struct pwr_dev_ps_stats {
+	ktime_t state_since;
+	uint64_t residency_us[CHIP_SLEEPING_MANUAL + 1];
+	uint32_t wake_reason[PS_WAKE_MAX];
+	uint32_t wake_lat_hist[PWR_DEV_SRC_MAX][PWR_DEV_HIST_BUCKETS];
+	uint32_t wake_retry_cnt;
+	uint32_t wake_fail_cnt;
+};
+
+struct pwr_dev_arb {
+	spinlock_t lock;
+	wait_queue_head_t wq;
+	uint8_t busy;
+	uint32_t waiting[BUS_PRIO_MAX];
+	uint32_t bypassed[BUS_PRIO_MAX];
+	int owner_src;
+	int owner_prio;
+	ktime_t grant_time;
+	/* statistics */
+	uint32_t hold_hist[PWR_DEV_SRC_MAX][BUS_PRIO_MAX][PWR_DEV_HIST_BUCKETS];
+	uint32_t wait_hist[PWR_DEV_SRC_MAX][BUS_PRIO_MAX][PWR_DEV_HIST_BUCKETS];
+	uint32_t hold_max_us[PWR_DEV_SRC_MAX][BUS_PRIO_MAX];
+	uint32_t wait_max_us[PWR_DEV_SRC_MAX][BUS_PRIO_MAX];
+};
+
+struct pwr_dev_ps_src {
+	struct delayed_work sleep_work;
+	uint8_t sleep_pending;
+	ktime_t last_release;
+	uint32_t gap_avg_us;
+	/* statistics */
+	uint32_t wake_cnt;
+	uint32_t wake_saved_cnt;
+	uint64_t wake_lat_total_us;
+	uint32_t wake_lat_max_us;
+};
+
 struct pwr_dev_t {
 	struct mutex cs;
 	uint8_t bus_registered[PWR_DEV_SRC_MAX];
 	uint8_t power_status[PWR_DEV_SRC_MAX];
 	uint8_t keep_awake[PWR_DEV_SRC_MAX];
+	struct pwr_dev_ps_src ps[PWR_DEV_SRC_MAX];
+	struct pwr_dev_arb arb;
+	struct pwr_dev_ps_stats ps_stats;
 	struct wilc_hif_func hif_func;
 	struct mutex hif_cs;
 #ifdef DOWNLOAD_BT_FW_ONCE
@@ -102,6 +175,49 @@ static int wilc_bt_start(void);
 static int linux_wlan_device_power(int on_off);
 static int linux_wlan_device_detection(int on_off);
 static void prepare_inp(struct wilc_wlan_inp *nwi);
+static void pwr_dev_sleep_work(struct work_struct *work);
+static ssize_t wake_stats_show(struct device *dev,
+			       struct device_attribute *attr, char *buf);
+
+static ssize_t bus_stats_show(struct device *dev,
+			      struct device_attribute *attr, char *buf);
+
+static ssize_t ps_residency_show(struct device *dev,
+				 struct device_attribute *attr, char *buf);
+static ssize_t wake_reasons_show(struct device *dev,
+				 struct device_attribute *attr, char *buf);
+static ssize_t wake_latency_show(struct device *dev,
+				 struct device_attribute *attr, char *buf);
+static ssize_t ps_debugfs_read(struct file *file, char __user *ubuf,
+			       size_t count, loff_t *ppos);
+
+static DEVICE_ATTR(wake_stats, S_IRUGO, wake_stats_show, NULL);
+static DEVICE_ATTR(bus_stats, S_IRUGO, bus_stats_show, NULL);
+static DEVICE_ATTR(ps_residency, S_IRUGO, ps_residency_show, NULL);
+static DEVICE_ATTR(wake_reasons, S_IRUGO, wake_reasons_show, NULL);
+static DEVICE_ATTR(wake_latency, S_IRUGO, wake_latency_show, NULL);
+
+static struct attribute *pwr_dev_attrs[] = {
+	&dev_attr_wake_stats.attr,
+	&dev_attr_bus_stats.attr,
+	&dev_attr_ps_residency.attr,
+	&dev_attr_wake_reasons.attr,
+	&dev_attr_wake_latency.attr,
+	NULL,
+};
+
+static const struct attribute_group pwr_dev_attr_group = {
+	.attrs = pwr_dev_attrs,
+};
+
+static const struct file_operations ps_debugfs_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = ps_debugfs_read,
+	.llseek = default_llseek,
+};
+
+static struct dentry *pwr_dev_debugfs_dir;
 
 static const struct cmd_handle_entry cmd_table[] = {
 	{"BT_DOWNLOAD_FW", cmd_handle_bt_download_fw},
@@ -129,6 +245,7 @@ enum CHIP_PS_STATE genuChipPSstateFromWifi;
 int at_pwr_dev_init(void)
 {
 	int ret = 0;
+	int source;
 
 	PRINT_D(PWRDEV_DBG, "at_pwr_dev: registered\n");
 	memset(&pwr_dev, 0, sizeof(pwr_dev));
@@ -165,14 +282,38 @@ int at_pwr_dev_init(void)
 
 	mutex_init(&pwr_dev.cs);
 	mutex_init(&pwr_dev.hif_cs);
+	spin_lock_init(&pwr_dev.arb.lock);
+	init_waitqueue_head(&pwr_dev.arb.wq);
+
+	for (source = 0; source < PWR_DEV_SRC_MAX; source++)
+		INIT_DELAYED_WORK(&pwr_dev.ps[source].sleep_work,
+				  pwr_dev_sleep_work);
+
+	pwr_dev.ps_stats.state_since = ktime_get();
+
+	if (sysfs_create_group(&dev->kobj, &pwr_dev_attr_group))
+		PRINT_ER("Can't create at_pwr_dev attributes\n");
+
+	pwr_dev_debugfs_dir = debugfs_create_dir("at_pwr_dev", NULL);
+	if (!IS_ERR_OR_NULL(pwr_dev_debugfs_dir))
+		debugfs_create_file("ps_stats", S_IRUSR, pwr_dev_debugfs_dir,
+				    NULL, &ps_debugfs_fops);
 
 	return ret;
 }
 
 int at_pwr_dev_deinit(void)
 {
+	int source;
+
 	PRINT_D(PWRDEV_DBG, "at_pwr_dev: deinit\n");
 
+	for (source = 0; source < PWR_DEV_SRC_MAX; source++)
+		cancel_delayed_work_sync(&pwr_dev.ps[source].sleep_work);
+	debugfs_remove_recursive(pwr_dev_debugfs_dir);
+	pwr_dev_debugfs_dir = NULL;
+	sysfs_remove_group(&dev->kobj, &pwr_dev_attr_group);
+
 	if (&pwr_dev.hif_cs != NULL)
 		mutex_destroy(&pwr_dev.hif_cs);
 
@@ -324,6 +465,8 @@ int at_pwr_unregister_bus(int source)
 		PRINT_WRN(PWRDEV_DBG, "Another device is preventing bus unregisteration. request source is %s\n",
 			(source == PWR_DEV_SRC_WIFI ? "Wifi" : "BT"));
 	} else {
+		flush_delayed_work(&pwr_dev.ps[PWR_DEV_SRC_WIFI].sleep_work);
+		flush_delayed_work(&pwr_dev.ps[PWR_DEV_SRC_BT].sleep_work);
 #ifndef WILC_SDIO
 		hif_spi.hif_deinit(NULL);
 		PRINT_D(PWRDEV_DBG, "SPI unregsiter...\n");
@@ -680,7 +823,12 @@ void prepare_inp(struct wilc_wlan_inp *nwi)
 	nwi->io_func.io_deinit = linux_sdio_deinit;
 	nwi->io_func.u.sdio.sdio_cmd52 = linux_sdio_cmd52;
 	nwi->io_func.u.sdio.sdio_cmd53 = linux_sdio_cmd53;
+	nwi->io_func.u.sdio.sdio_cmd53_sg = linux_sdio_cmd53_sg;
 	nwi->io_func.u.sdio.sdio_set_max_speed = linux_sdio_set_max_speed;
+	nwi->io_func.u.sdio.sdio_set_speed = linux_sdio_set_speed;
+	nwi->io_func.u.sdio.sdio_crc_errors = linux_sdio_crc_errors;
+	nwi->io_func.u.sdio.sdio_xact_begin = linux_sdio_xact_begin;
+	nwi->io_func.u.sdio.sdio_xact_end = linux_sdio_xact_end;
 #else
 	nwi->io_func.io_type = HIF_SPI;
 	nwi->io_func.io_init = linux_spi_init;
@@ -688,10 +836,55 @@ void prepare_inp(struct wilc_wlan_inp *nwi)
 	nwi->io_func.u.spi.spi_tx = linux_spi_write;
 	nwi->io_func.u.spi.spi_rx = linux_spi_read;
 	nwi->io_func.u.spi.spi_trx = linux_spi_write_read;
+	nwi->io_func.u.spi.spi_set_speed = linux_spi_set_speed;
 #endif /* WILC_SDIO */
 }
 
 
+static int pwr_dev_hist_bucket(uint32_t us)
+{
+	int bucket;
+
+	if (us < 16)
+		return 0;
+	bucket = (ilog2(us) - 4) / 2 + 1;
+
+	return min(bucket, PWR_DEV_HIST_BUCKETS - 1);
+}
+
+/*
+ * Move the chip to a new power-save state, accounting the time spent in
+ * the previous one.
+ */
+void chip_ps_state_set(enum CHIP_PS_STATE state)
+{
+	struct pwr_dev_ps_stats *st = &pwr_dev.ps_stats;
+	ktime_t now = ktime_get();
+
+	st->residency_us[genuChipPSstate] += ktime_us_delta(now, st->state_since);
+	st->state_since = now;
+	genuChipPSstate = state;
+}
+EXPORT_SYMBOL(chip_ps_state_set);
+
+static int chip_wake_reason(int source)
+{
+	if (source == PWR_DEV_SRC_BT)
+		return PS_WAKE_BT;
+
+	if (!pwr_dev.arb.busy)
+		return PS_WAKE_OTHER;
+
+	switch (pwr_dev.arb.owner_prio) {
+	case BUS_PRIO_RX:
+		return PS_WAKE_RX;
+	case BUS_PRIO_TX:
+		return PS_WAKE_TX;
+	default:
+		return PS_WAKE_CFG;
+	}
+}
+
 void chip_allow_sleep(int source)
 {
 	uint32_t reg = 0;
@@ -712,9 +905,10 @@ void chip_allow_sleep(int source)
 #endif /* WILC_SDIO */
 	}
 	if (source == PWR_DEV_SRC_WIFI)
-		genuChipPSstate = CHIP_SLEEPING_AUTO;
+		chip_ps_state_set(CHIP_SLEEPING_AUTO);
 
 	pwr_dev.keep_awake[source] = false;
+	pwr_dev.ps[source].sleep_pending = false;
 }
 EXPORT_SYMBOL(chip_allow_sleep);
 
@@ -734,9 +928,16 @@ void chip_wakeup(int source)
 #endif /* WILC_SDIO */
 
 	int wake_seq_trials = 5;
+	struct pwr_dev_ps_src *ps = &pwr_dev.ps[source];
+	struct pwr_dev_ps_stats *st = &pwr_dev.ps_stats;
+	ktime_t start = ktime_get();
+	uint32_t lat;
+	int seq = 0;
 
 	pwr_dev.hif_func.hif_read_reg(u32WakeupReg, &wakeup_reg_val);
 	do {
+		if (seq++)
+			st->wake_retry_cnt++;
 		pwr_dev.hif_func.hif_write_reg(u32WakeupReg, wakeup_reg_val | u32WakepBit);
 		/* Check the clock status */
 		pwr_dev.hif_func.hif_read_reg(u32ClkStsReg, &clk_status_reg_val);
@@ -769,29 +970,358 @@ void chip_wakeup(int source)
 	} while (((clk_status_reg_val & u32ClkStsBit) == 0)
 		 && (wake_seq_trials-- > 0));
 
-	genuChipPSstate = CHIP_WAKEDUP;
+	if ((clk_status_reg_val & u32ClkStsBit) == 0)
+		st->wake_fail_cnt++;
+
+	if (genuChipPSstate != CHIP_WAKEDUP)
+		st->wake_reason[chip_wake_reason(source)]++;
+	chip_ps_state_set(CHIP_WAKEDUP);
 
 	pwr_dev.keep_awake[source] = true;
+
+	lat = (uint32_t)ktime_us_delta(ktime_get(), start);
+	ps->wake_cnt++;
+	ps->wake_lat_total_us += lat;
+	if (lat > ps->wake_lat_max_us)
+		ps->wake_lat_max_us = lat;
+	st->wake_lat_hist[source][pwr_dev_hist_bucket(lat)]++;
+}
+
+/*
+ * Deferred chip_allow_sleep(), runs once the source stayed idle for the
+ * hysteresis window. A chip_allow_sleep() or a new bus use from the
+ * source in the meantime clears sleep_pending.
+ */
+static void pwr_dev_sleep_work(struct work_struct *work)
+{
+	struct pwr_dev_ps_src *ps = container_of(to_delayed_work(work),
+						 struct pwr_dev_ps_src,
+						 sleep_work);
+	int source = ps - pwr_dev.ps;
+
+	acquire_bus_prio(ACQUIRE_ONLY, source, BUS_PRIO_CTRL);
+	if (ps->sleep_pending)
+		chip_allow_sleep(source);
+	release_bus(RELEASE_ONLY, source);
+}
+
+static unsigned int pwr_dev_sleep_hyst_ms(int source)
+{
+	unsigned int ms = (2 * pwr_dev.ps[source].gap_avg_us) / 1000;
+
+	if (ms > PS_HYST_MAX_MS)
+		return 0;
+	if (ms < PS_HYST_MIN_MS)
+		ms = PS_HYST_MIN_MS;
+
+	return ms;
+}
+
+static ssize_t wake_stats_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	ssize_t len = 0;
+	int source;
+
+	for (source = 0; source < PWR_DEV_SRC_MAX; source++) {
+		struct pwr_dev_ps_src *ps = &pwr_dev.ps[source];
+
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+				 "%s: wakeups %u saved %u latency avg %u max %u us, gap avg %u us\n",
+				 (source == PWR_DEV_SRC_WIFI) ? "wifi" : "bt",
+				 ps->wake_cnt, ps->wake_saved_cnt,
+				 ps->wake_cnt ? (uint32_t)div_u64(ps->wake_lat_total_us,
+								  ps->wake_cnt) : 0,
+				 ps->wake_lat_max_us, ps->gap_avg_us);
+	}
+
+	return len;
+}
+
+static ssize_t bus_stats_show(struct device *dev,
+			      struct device_attribute *attr, char *buf)
+{
+	static const char * const prio_name[BUS_PRIO_MAX] = {
+		"rx", "ctrl", "tx"
+	};
+	struct pwr_dev_arb *arb = &pwr_dev.arb;
+	ssize_t len = 0;
+	int source, prio, i;
+
+	len += scnprintf(buf + len, PAGE_SIZE - len,
+			 "%-10s %-4s %8s %8s %8s %8s %8s %8s %8s %8s\n",
+			 "user", "", "<16us", "<64us", "<256us", "<1ms",
+			 "<4ms", "<16ms", ">=16ms", "max(us)");
+	for (source = 0; source < PWR_DEV_SRC_MAX; source++) {
+		for (prio = 0; prio < BUS_PRIO_MAX; prio++) {
+			char name[16];
+
+			snprintf(name, sizeof(name), "%s-%s",
+				 (source == PWR_DEV_SRC_WIFI) ? "wifi" : "bt",
+				 prio_name[prio]);
+
+			len += scnprintf(buf + len, PAGE_SIZE - len,
+					 "%-10s %-4s", name, "hold");
+			for (i = 0; i < PWR_DEV_HIST_BUCKETS; i++)
+				len += scnprintf(buf + len, PAGE_SIZE - len, " %8u",
+						 arb->hold_hist[source][prio][i]);
+			len += scnprintf(buf + len, PAGE_SIZE - len, " %8u\n",
+					 arb->hold_max_us[source][prio]);
+
+			len += scnprintf(buf + len, PAGE_SIZE - len,
+					 "%-10s %-4s", name, "wait");
+			for (i = 0; i < PWR_DEV_HIST_BUCKETS; i++)
+				len += scnprintf(buf + len, PAGE_SIZE - len, " %8u",
+						 arb->wait_hist[source][prio][i]);
+			len += scnprintf(buf + len, PAGE_SIZE - len, " %8u\n",
+					 arb->wait_max_us[source][prio]);
+		}
+	}
+
+	return len;
+}
+
+static ssize_t ps_residency_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	static const char * const state_name[] = {
+		"awake", "sleep_auto", "sleep_manual"
+	};
+	struct pwr_dev_ps_stats *st = &pwr_dev.ps_stats;
+	ssize_t len = 0;
+	uint64_t us;
+	int state;
+
+	for (state = CHIP_WAKEDUP; state <= CHIP_SLEEPING_MANUAL; state++) {
+		us = st->residency_us[state];
+		if (state == genuChipPSstate)
+			us += ktime_us_delta(ktime_get(), st->state_since);
+		len += scnprintf(buf + len, PAGE_SIZE - len, "%-12s %llu ms\n",
+				 state_name[state],
+				 (unsigned long long)div_u64(us, 1000));
+	}
+
+	return len;
+}
+
+static ssize_t wake_reasons_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	static const char * const reason_name[PS_WAKE_MAX] = {
+		"tx", "rx_irq", "cfg", "bt", "other"
+	};
+	struct pwr_dev_ps_stats *st = &pwr_dev.ps_stats;
+	ssize_t len = 0;
+	int i;
+
+	for (i = 0; i < PS_WAKE_MAX; i++)
+		len += scnprintf(buf + len, PAGE_SIZE - len, "%-8s %u\n",
+				 reason_name[i], st->wake_reason[i]);
+	len += scnprintf(buf + len, PAGE_SIZE - len,
+			 "retries  %u\nfailures %u\n",
+			 st->wake_retry_cnt, st->wake_fail_cnt);
+
+	return len;
+}
+
+static ssize_t wake_latency_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	struct pwr_dev_ps_stats *st = &pwr_dev.ps_stats;
+	ssize_t len = 0;
+	int source, i;
+
+	len += scnprintf(buf + len, PAGE_SIZE - len,
+			 "%-5s %8s %8s %8s %8s %8s %8s %8s\n",
+			 "user", "<16us", "<64us", "<256us", "<1ms",
+			 "<4ms", "<16ms", ">=16ms");
+	for (source = 0; source < PWR_DEV_SRC_MAX; source++) {
+		len += scnprintf(buf + len, PAGE_SIZE - len, "%-5s",
+				 (source == PWR_DEV_SRC_WIFI) ? "wifi" : "bt");
+		for (i = 0; i < PWR_DEV_HIST_BUCKETS; i++)
+			len += scnprintf(buf + len, PAGE_SIZE - len, " %8u",
+					 st->wake_lat_hist[source][i]);
+		len += scnprintf(buf + len, PAGE_SIZE - len, "\n");
+	}
+
+	return len;
+}
+
+/* debugfs at_pwr_dev/ps_stats: all the attributes above in one read */
+static ssize_t ps_debugfs_read(struct file *file, char __user *ubuf,
+			       size_t count, loff_t *ppos)
+{
+	struct attribute **attr;
+	struct device_attribute *dattr;
+	ssize_t len = 0, ret;
+	size_t size;
+	char *buf;
+
+	/* a page per attribute, plus one for the section headers */
+	size = PAGE_SIZE * ARRAY_SIZE(pwr_dev_attrs);
+	buf = kzalloc(size, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	for (attr = pwr_dev_attrs; *attr; attr++) {
+		dattr = container_of(*attr, struct device_attribute, attr);
+		len += scnprintf(buf + len, size - len, "[%s]\n",
+				 (*attr)->name);
+		len += dattr->show(dev, dattr, buf + len);
+		len += scnprintf(buf + len, size - len, "\n");
+	}
+
+	ret = simple_read_from_buffer(ubuf, count, ppos, buf, len);
+	kfree(buf);
+
+	return ret;
+}
+
+/*
+ * Grant the bus to a waiter of class prio if it is free and no higher
+ * class is waiting, or if prio has already been passed over too often.
+ */
+static int bus_arb_try_grant(int prio)
+{
+	struct pwr_dev_arb *arb = &pwr_dev.arb;
+	unsigned long flags;
+	int granted = 0;
+	int p;
+
+	spin_lock_irqsave(&arb->lock, flags);
+	if (arb->busy)
+		goto _unlock_;
+
+	if (arb->bypassed[prio] < BUS_ARB_MAX_BYPASS) {
+		for (p = 0; p < prio; p++) {
+			if (arb->waiting[p])
+				goto _unlock_;
+		}
+	}
+
+	arb->busy = true;
+	arb->waiting[prio]--;
+	arb->bypassed[prio] = 0;
+	for (p = prio + 1; p < BUS_PRIO_MAX; p++) {
+		if (arb->waiting[p])
+			arb->bypassed[p]++;
+	}
+	granted = 1;
+
+_unlock_:
+	spin_unlock_irqrestore(&arb->lock, flags);
+	return granted;
 }
 
+/*
+ * Returns nonzero if a waiter of a higher class than prio is queued, so
+ * that a long transfer can be cut short and the bus handed over.
+ */
+int bus_arb_contended(enum BUS_PRIO prio)
+{
+	int p;
+
+	for (p = 0; p < prio; p++) {
+		if (ACCESS_ONCE(pwr_dev.arb.waiting[p]))
+			return 1;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL(bus_arb_contended);
+
 void acquire_bus(enum BUS_ACQUIRE acquire, int source)
 {
+	acquire_bus_prio(acquire, source, BUS_PRIO_CTRL);
+}
+EXPORT_SYMBOL(acquire_bus);
+
+void acquire_bus_prio(enum BUS_ACQUIRE acquire, int source,
+		      enum BUS_PRIO prio)
+{
+	struct pwr_dev_ps_src *ps = &pwr_dev.ps[source];
+	struct pwr_dev_arb *arb = &pwr_dev.arb;
+	ktime_t start = ktime_get();
+	unsigned long flags;
+	uint32_t gap, wait;
+
+	spin_lock_irqsave(&arb->lock, flags);
+	arb->waiting[prio]++;
+	spin_unlock_irqrestore(&arb->lock, flags);
+
+	wait_event(arb->wq, bus_arb_try_grant(prio));
 	mutex_lock(&pwr_dev.hif_cs);
 
+	arb->owner_src = source;
+	arb->owner_prio = prio;
+	arb->grant_time = ktime_get();
+	wait = (uint32_t)ktime_us_delta(arb->grant_time, start);
+	arb->wait_hist[source][prio][pwr_dev_hist_bucket(wait)]++;
+	if (wait > arb->wait_max_us[source][prio])
+		arb->wait_max_us[source][prio] = wait;
+
+	if (pwr_dev.hif_func.hif_xact_begin)
+		pwr_dev.hif_func.hif_xact_begin();
+
+	if (acquire == ACQUIRE_AND_WAKEUP) {
+		gap = (uint32_t)min_t(s64, ktime_us_delta(ktime_get(),
+							   ps->last_release),
+				      USEC_PER_SEC);
+		ps->gap_avg_us = (ps->gap_avg_us * 7 + gap) / 8;
+
+		/* still awake thanks to the hysteresis */
+		if (ps->sleep_pending) {
+			ps->sleep_pending = false;
+			ps->wake_saved_cnt++;
+		}
+	}
+
 	if (genuChipPSstate != CHIP_WAKEDUP) {
 		if (acquire == ACQUIRE_AND_WAKEUP)
 			chip_wakeup(source);
 	}
 }
-EXPORT_SYMBOL(acquire_bus);
+EXPORT_SYMBOL(acquire_bus_prio);
 
 void release_bus(enum BUS_RELEASE release, int source)
 {
-	if (release == RELEASE_ALLOW_SLEEP)
-		chip_allow_sleep(source);
+	struct pwr_dev_ps_src *ps = &pwr_dev.ps[source];
+	struct pwr_dev_arb *arb = &pwr_dev.arb;
+	unsigned int hyst_ms;
+	unsigned long flags;
+	uint32_t hold;
+
+	if (!arb->busy) {
+		PRINT_ER("Releasing bus not acquired, source %d\n", source);
+		return;
+	}
+
+	if (release == RELEASE_ALLOW_SLEEP) {
+		ps->last_release = ktime_get();
+		hyst_ms = pwr_dev_sleep_hyst_ms(source);
+		if (hyst_ms == 0) {
+			chip_allow_sleep(source);
+		} else {
+			ps->sleep_pending = true;
+			mod_delayed_work(system_freezable_wq, &ps->sleep_work,
+					 msecs_to_jiffies(hyst_ms));
+		}
+	}
+
+	if (pwr_dev.hif_func.hif_xact_end)
+		pwr_dev.hif_func.hif_xact_end();
+
+	hold = (uint32_t)ktime_us_delta(ktime_get(), arb->grant_time);
+	arb->hold_hist[arb->owner_src][arb->owner_prio][pwr_dev_hist_bucket(hold)]++;
+	if (hold > arb->hold_max_us[arb->owner_src][arb->owner_prio])
+		arb->hold_max_us[arb->owner_src][arb->owner_prio] = hold;
+
+	mutex_unlock(&pwr_dev.hif_cs);
 
-	if (mutex_is_locked(&pwr_dev.hif_cs))
-		mutex_unlock(&pwr_dev.hif_cs);
+	spin_lock_irqsave(&arb->lock, flags);
+	arb->busy = false;
+	spin_unlock_irqrestore(&arb->lock, flags);
+	wake_up_all(&arb->wq);
 }
 EXPORT_SYMBOL(release_bus);
 
@@ -19,11 +19,45 @@
 #ifndef __ATL_MSG_QUEUE_H__
 #define __ATL_MSG_QUEUE_H__
 
+#include <linux/ktime.h>
+
+/*
+ * Messages are copied into fixed size slots preallocated at create time,
+ * one ring per priority. Receivers always drain the high priority ring
+ * first, each ring is FIFO.
+ */
+enum MSG_PRIO {
+	MSG_PRIO_HIGH		= 0,
+	MSG_PRIO_NORMAL		= 1,
+	MSG_PRIO_MAX,
+	/* normal ring, but shed once only the reserved slots are left */
+	MSG_PRIO_BULK		= MSG_PRIO_MAX
+};
+
+#define MSG_QUEUE_DEPTH_HIGH	16
+#define MSG_QUEUE_DEPTH_NORMAL	64
+/* normal slots kept for messages that must not be dropped */
+#define MSG_QUEUE_RESERVED	16
+
 /* Message Queue type is a structure */
 struct Message {
-	void *pvBuffer;
 	unsigned int u32Length;
-	struct Message *pstrNext;
+	ktime_t tEnqueued;
+	u8 au8Buffer[0];
+};
+
+struct MsgRing {
+	u8 *pu8Slots;
+	unsigned int u32Depth;
+	unsigned int u32Head;
+	unsigned int u32Count;
+
+	/* statistics */
+	unsigned int u32Sent;
+	unsigned int u32Dropped;
+	unsigned int u32MaxCount;
+	unsigned int u32LatMaxUs;
+	u64 u64LatTotalUs;
 };
 
 struct MsgQueueHandle {
@@ -31,22 +65,24 @@ struct MsgQueueHandle {
 	spinlock_t strCriticalSection;
 	bool bExiting;
 	unsigned int u32ReceiversCount;
-	struct Message *pstrMessageList;
+	unsigned int u32MsgSize;
+	unsigned int u32SlotSize;
+	struct MsgRing astrRing[MSG_PRIO_MAX];
+	/* picks the ring of a message, NULL sends everything as normal */
+	enum MSG_PRIO (*pfPrio)(const void *pvBuffer);
 };
 
 /*
- * Creates a new Message queue, if the feature
- * CONFIG_ATL_MSG_QUEUE_IPC_NAME is enabled and pstrAttrs->pcName
- * is not Null, then this message queue can be used for IPC with
- * any other message queue having the same name in the system
+ * Creates a new Message queue holding messages of up to u32MsgSize
+ * bytes. pfPrio classifies each message on send.
  */
-signed int ATL_MsgQueueCreate(struct MsgQueueHandle *pHandle);
+signed int ATL_MsgQueueCreate(struct MsgQueueHandle *pHandle,
+			      unsigned int u32MsgSize,
+			      enum MSG_PRIO (*pfPrio)(const void *pvBuffer));
 
 /*
- * Sends a message, this API will block unil the message is
- * actually sent or until it is timedout (as long as the feature
- * CONFIG_ATL_MSG_QUEUE_TIMEOUT is enabled and pstrAttrs->u32Timeout
- * is not set to ATL_OS_INFINITY), zero timeout is a valid value
+ * Sends a message, this API never blocks nor allocates. It fails
+ * with ATL_FULL when the ring of the message priority is full.
  */
 signed int ATL_MsgQueueSend(struct MsgQueueHandle *pHandle,
 		const void *pvSendBuffer, unsigned int u32SendBufferSize);
@@ -65,4 +101,9 @@ signed int ATL_MsgQueueRecv(struct MsgQueueHandle *pHandle,
  * Destroys an existing  Message queue
  */
 signed int ATL_MsgQueueDestroy(struct MsgQueueHandle *pHandle);
+
+/*
+ * Prints depth and latency statistics of the queue into pcBuf
+ */
+int ATL_MsgQueueStats(struct MsgQueueHandle *pHandle, char *pcBuf, int s32Size);
 #endif
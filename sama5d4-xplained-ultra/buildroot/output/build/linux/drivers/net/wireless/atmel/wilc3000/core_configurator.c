@@ -637,87 +637,57 @@ _fail_:
 	return s32Error;
 }
 
-u8 *get_tim_elm(u8 *pu8msa, u16 u16RxLen, u16 u16TagParamOffset)
+/*
+ * Walks the tagged parameters of a network parsed by ParseNetworkInfo() and
+ * picks up the current channel (DS parameter set) and the DTIM period (TIM
+ * element). Networks whose join params are built get both from that walk
+ * instead.
+ */
+void ParseNetworkInfoIEs(struct tstrNetworkInfo *pstrNetworkInfo)
 {
+	u8 *pu8IEs = pstrNetworkInfo->pu8IEs;
+	u16 u16IEsLen = pstrNetworkInfo->u16IEsLen;
 	u16 u16index = 0;
+	bool bDsFound = false;
+	bool bTimFound = false;
 
-    /*************************************************************************/
-    /*                       Beacon Frame - Frame Body                       */
-    /* --------------------------------------------------------------------- */
-    /* |Timestamp |BeaconInt |CapInfo |SSID |SupRates |DSParSet |TIM elm   | */
-    /* --------------------------------------------------------------------- */
-    /* |8         |2         |2       |2-34 |3-10     |3        |4-256     | */
-    /* --------------------------------------------------------------------- */
-    /*                                                                       */
-    /*************************************************************************/
-	u16index = u16TagParamOffset;
-
-	/* Search for the TIM Element Field and return if the element is found */
-	while (u16index < (u16RxLen - FCS_LEN)) {
-		if (pu8msa[u16index] == ITIM)
-			return &pu8msa[u16index];
-		u16index += (IE_HDR_LEN + pu8msa[u16index + 1]);
-	}
+	while ((u16index + IE_HDR_LEN) <= u16IEsLen) {
+		u8 u8ElmLen = pu8IEs[u16index + 1];
 
-	return 0;
-}
-
-/*
- * This function gets the current channel information from
- * the 802.11n beacon/probe response frame
- */
-u8 get_current_channel_802_11n(u8 *pu8msa, u16 u16RxLen)
-{
-	u16 index;
-
-	index = TAG_PARAM_OFFSET;
-	while (index < (u16RxLen - FCS_LEN)) {
-		if (pu8msa[index] == IDSPARMS)
-			return pu8msa[index + 2];
-		/* Increment index by length information and header */
-		index += pu8msa[index + 1] + IE_HDR_LEN;
-	}
+		if ((u16index + IE_HDR_LEN + u8ElmLen) > u16IEsLen)
+			break;
 
-	return 0;
-}
+		if (pu8IEs[u16index] == IDSPARMS && !bDsFound && u8ElmLen >= 1) {
+			pstrNetworkInfo->u8channel = pu8IEs[u16index + 2];
+			bDsFound = true;
+		} else if (pu8IEs[u16index] == ITIM && !bTimFound && u8ElmLen >= 2) {
+			pstrNetworkInfo->u8DtimPeriod = pu8IEs[u16index + 3];
+			bTimFound = true;
+		}
 
-u8 get_current_channel(u8 *pu8msa, u16 u16RxLen)
-{
-#ifdef PHY_802_11n
-#ifdef FIVE_GHZ_BAND
-	/* Get the current channel as its not set in */
-	/* 802.11a beacons/probe response            */
-	return (get_rf_channel() + 1);
-#else /* FIVE_GHZ_BAND */
-	/* Extract current channel information from */
-	/* the beacon/probe response frame          */
-	return get_current_channel_802_11n(pu8msa, u16RxLen);
-#endif /* FIVE_GHZ_BAND */
-#else
-	return 0;
-#endif /* PHY_802_11n */
+		if (bDsFound && bTimFound)
+			break;
+		u16index += IE_HDR_LEN + u8ElmLen;
+	}
 }
 
 /*
- * parses the received 'N' message
+ * Parses a received 'N' message into the caller's tstrNetworkInfo. Nothing
+ * is allocated: pu8IEs points into pu8MsgBuffer, so the result is only
+ * valid for as long as the message buffer is. The IEs are not walked here,
+ * so channel and DTIM period are still 0; the caller fills them in with
+ * ParseNetworkInfoIEs() or while building the join params, once it knows
+ * the network is worth it.
  */
-signed int ParseNetworkInfo(u8 *pu8MsgBuffer, struct tstrNetworkInfo **ppstrNetworkInfo)
+signed int ParseNetworkInfo(u8 *pu8MsgBuffer, struct tstrNetworkInfo *pstrNetworkInfo)
 {
 	signed int s32Error = ATL_SUCCESS;
-	struct tstrNetworkInfo *pstrNetworkInfo = NULL;
 	u8 u8MsgType = 0;
-	u8 u8MsgID = 0;
-	u16 u16MsgLen = 0;
-	u16 u16WidID = (u16)WID_NIL;
 	u16 u16WidLen  = 0;
 	u8  *pu8WidVal = 0;
 
 	u8  *pu8msa = 0;
 	u16 u16RxLen = 0;
-	u8 *pu8TimElm = 0;
-	u8 *pu8IEs = 0;
-	u16 u16IEsLen = 0;
-	u8 u8index = 0;
 	unsigned int u32Tsf_Lo;
 	unsigned int u32Tsf_Hi;
 
@@ -729,44 +699,37 @@ signed int ParseNetworkInfo(u8 *pu8MsgBuffer, struct tstrNetworkInfo **ppstrNetw
 		ATL_ERRORREPORT(s32Error, ATL_FAIL);
 	}
 
-	/* Extract message ID */
-	u8MsgID = pu8MsgBuffer[1];
-
-    /* Extract message Length */
-	u16MsgLen = MAKE_WORD16(pu8MsgBuffer[2], pu8MsgBuffer[3]);
-
-	/* Extract WID ID */
-	u16WidID = MAKE_WORD16(pu8MsgBuffer[4], pu8MsgBuffer[5]);
-
 	/* Extract WID Length */
 	u16WidLen = MAKE_WORD16(pu8MsgBuffer[6], pu8MsgBuffer[7]);
 
 	/* Assign a pointer to the WID value */
 	pu8WidVal  = &pu8MsgBuffer[8];
 
+	u16RxLen = u16WidLen - 1;
+	if (u16WidLen < 1 || u16RxLen < TAG_PARAM_OFFSET) {
+		PRINT_ER("Network info too short: %d\n", u16WidLen);
+		ATL_ERRORREPORT(s32Error, ATL_FAIL);
+	}
+
 	/* parse the WID value of the WID "WID_NEWORK_INFO" */
-	pstrNetworkInfo = kmalloc(sizeof(struct tstrNetworkInfo), GFP_ATOMIC);
 	memset((void *)(pstrNetworkInfo), 0, sizeof(struct tstrNetworkInfo));
 
 	pstrNetworkInfo->s8rssi = pu8WidVal[0];
 
-		/* Assign a pointer to msa "Mac Header Start Address" */
+	/* Assign a pointer to msa "Mac Header Start Address" */
 	pu8msa = &pu8WidVal[1];
 
-	u16RxLen = u16WidLen - 1;
-
-		/* parse msa*/
-		/* Get the cap_info */
+	/* parse msa*/
+	/* Get the cap_info */
 	pstrNetworkInfo->u16CapInfo = get_cap_info(pu8msa);
-#ifdef WILC_P2P
-		/* Get time-stamp [Low only 32 bit] */
-	pstrNetworkInfo->u32Tsf = get_beacon_timestamp_lo(pu8msa);
-		PRINT_D(CORECONFIG_DBG,"TSF :%x\n",pstrNetworkInfo->u32Tsf );
-#endif
 
-		/* Get full time-stamp [Low and High 64 bit] */		
+	/* Get full time-stamp [Low and High 64 bit] */
 	u32Tsf_Lo = get_beacon_timestamp_lo(pu8msa);
 	u32Tsf_Hi = get_beacon_timestamp_hi(pu8msa);
+#ifdef WILC_P2P
+	pstrNetworkInfo->u32Tsf = u32Tsf_Lo;
+	PRINT_D(CORECONFIG_DBG, "TSF :%x\n", pstrNetworkInfo->u32Tsf);
+#endif
 
 	/*TicketId1023*/
 	pstrNetworkInfo->u64Tsf = u32Tsf_Hi;
@@ -778,62 +741,18 @@ signed int ParseNetworkInfo(u8 *pu8MsgBuffer, struct tstrNetworkInfo **ppstrNetw
 	/* Get BSSID */
 	get_BSSID(pu8msa, pstrNetworkInfo->au8bssid);
 
-	/* Get the current channel */
-	pstrNetworkInfo->u8channel = get_current_channel(pu8msa, (u16RxLen + FCS_LEN));
-
 	/* Get beacon period */
-	u8index = (MAC_HDR_LEN + TIME_STAMP_LEN);
-
-	pstrNetworkInfo->u16BeaconPeriod = get_beacon_period(pu8msa + u8index);
+	pstrNetworkInfo->u16BeaconPeriod = get_beacon_period(pu8msa + MAC_HDR_LEN + TIME_STAMP_LEN);
 
-	u8index += BEACON_INTERVAL_LEN + CAP_INFO_LEN;
-
-	/* Get DTIM Period */
-	pu8TimElm = get_tim_elm(pu8msa, (u16RxLen + FCS_LEN), u8index);
-	if (pu8TimElm != 0)
-		pstrNetworkInfo->u8DtimPeriod = pu8TimElm[3];
-	pu8IEs = &pu8msa[MAC_HDR_LEN + TIME_STAMP_LEN + BEACON_INTERVAL_LEN +
-			 CAP_INFO_LEN];
-	u16IEsLen = u16RxLen - (MAC_HDR_LEN + TIME_STAMP_LEN +
-		    BEACON_INTERVAL_LEN + CAP_INFO_LEN);
-
-	if (u16IEsLen > 0) {
-		pstrNetworkInfo->pu8IEs = kmalloc(u16IEsLen, GFP_ATOMIC);
-		memset((void *)(pstrNetworkInfo->pu8IEs), 0, u16IEsLen);
-
-		memcpy(pstrNetworkInfo->pu8IEs, pu8IEs, u16IEsLen);
-	}
-	pstrNetworkInfo->u16IEsLen = u16IEsLen;
-
-	*ppstrNetworkInfo = pstrNetworkInfo;
+	/* The IEs are referenced in place, not copied */
+	pstrNetworkInfo->pu8IEs = &pu8msa[TAG_PARAM_OFFSET];
+	pstrNetworkInfo->u16IEsLen = u16RxLen - TAG_PARAM_OFFSET;
 
 	ATL_CATCH(s32Error){
 	}
 	return s32Error;
 }
 
-/*
- * Deallocates the parsed Network Info
- */
-signed int DeallocateNetworkInfo(struct tstrNetworkInfo *pstrNetworkInfo)
-{
-	signed int s32Error = ATL_SUCCESS;
-
-	if (pstrNetworkInfo != NULL) {
-		if (pstrNetworkInfo->pu8IEs != NULL) {
-			kfree(pstrNetworkInfo->pu8IEs);
-			pstrNetworkInfo->pu8IEs = NULL;
-		} else {
-			s32Error = ATL_FAIL;
-		}
-		kfree(pstrNetworkInfo);
-		pstrNetworkInfo = NULL;
-	} else {
-		s32Error = ATL_FAIL;
-	}
-	return s32Error;
-}
-
 /*
  * parses the received Association Response frame
  */
@@ -1676,3 +1595,51 @@ signed int SendConfigPkt(u8 u8Mode, struct tstrWID *pstrWIDs,
 	cfg_timed_out_cnt = (ret != -1) ? 0 : cfg_timed_out_cnt + 1;
 	return ret;
 }
+
+/*
+ * Same as SendConfigPkt but returns once the packet is queued. pfDone is
+ * called with 1 when the firmware answers or 0 on timeout, for GET_CFG the
+ * values can then be read with wlan_cfg_get_value. Several packets can
+ * be in flight at the same time.
+ */
+signed int SendConfigPktAsync(u8 u8Mode, struct tstrWID *pstrWIDs,
+			      unsigned int u32WIDsCount,
+			      unsigned int drvHandler,
+			      wilc_cfg_done_func_t pfDone, void *pvPriv)
+{
+	signed int counter = 0;
+	int ret;
+
+	if (NULL == gpstrWlanOps ||
+	    NULL == gpstrWlanOps->wlan_cfg_commit_async) {
+		PRINT_INFO(CORECONFIG_DBG,"Async config is still not initialized\n");
+		return -1;
+	}
+
+	for (counter = 0; counter < u32WIDsCount; counter++) {
+		if (u8Mode == GET_CFG)
+			ret = gpstrWlanOps->wlan_cfg_get(!counter,
+							 pstrWIDs[counter].u16WIDid,
+							 0, drvHandler);
+		else
+			ret = gpstrWlanOps->wlan_cfg_set(!counter,
+							 pstrWIDs[counter].u16WIDid,
+							 pstrWIDs[counter].ps8WidVal,
+							 pstrWIDs[counter].s32ValueSize,
+							 0, drvHandler);
+		if (!ret) {
+			PRINT_ER("[SendConfigPktAsync] Can't add WID %x\n",
+				 pstrWIDs[counter].u16WIDid);
+			return -1;
+		}
+	}
+
+	if (!gpstrWlanOps->wlan_cfg_commit_async((u8Mode == GET_CFG) ?
+						 WILC_CFG_QUERY : WILC_CFG_SET,
+						 drvHandler, pfDone, pvPriv)) {
+		PRINT_ER("[SendConfigPktAsync] Can't queue config packet\n");
+		return -1;
+	}
+
+	return 0;
+}
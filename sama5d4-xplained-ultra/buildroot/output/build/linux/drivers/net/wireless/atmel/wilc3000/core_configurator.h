@@ -226,8 +226,12 @@ signed int SendConfigPkt(u8 u8Mode, struct tstrWID *pstrWIDs,
 				unsigned int u32WIDsCount,
 				bool bRespRequired,
 				unsigned int drvHandler);
-signed int ParseNetworkInfo(u8 *pu8MsgBuffer, struct tstrNetworkInfo **ppstrNetworkInfo);
-signed int DeallocateNetworkInfo(struct tstrNetworkInfo *pstrNetworkInfo);
+signed int SendConfigPktAsync(u8 u8Mode, struct tstrWID *pstrWIDs,
+			      unsigned int u32WIDsCount,
+			      unsigned int drvHandler,
+			      wilc_cfg_done_func_t pfDone, void *pvPriv);
+signed int ParseNetworkInfo(u8 *pu8MsgBuffer, struct tstrNetworkInfo *pstrNetworkInfo);
+void ParseNetworkInfoIEs(struct tstrNetworkInfo *pstrNetworkInfo);
 signed int ParseAssocRespInfo(u8 *pu8Buffer, unsigned int u32BufferLen,
 				     struct tstrConnectRespInfo **ppstrConnectRespInfo);
 signed int DeallocateAssocRespInfo(struct tstrConnectRespInfo *pstrConnectRespInfo);
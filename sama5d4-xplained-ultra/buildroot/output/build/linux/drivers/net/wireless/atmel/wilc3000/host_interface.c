@@ -25,6 +25,10 @@
 #include "linux_wlan.h"
 #include <linux/kthread.h>
 #include <linux/semaphore.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/completion.h>
+#include <linux/kref.h>
 #include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/kernel.h>
@@ -79,6 +83,7 @@
 #define HOST_IF_MSG_SEND_BUFFERED_EAP		((u16)39)
 #define HOST_IF_MSG_SET_TX_POWER	((u16)40)
 #define HOST_IF_MSG_GET_TX_POWER	((u16)41)
+#define HOST_IF_MSG_DEFER_KICK			((u16)42)
 #define HOST_IF_MSG_EXIT			((u16)100)
 
 #define HOST_IF_SCAN_TIMEOUT			4000
@@ -295,6 +300,8 @@ struct tstrTimerCb {
 struct tstrHostIfPowerMgmtParam {
 	bool bIsEnabled;
 	unsigned int u32Timeout;
+	s8 s8PowerMode;
+	u8 u8ListenInterval;
 };
 
 /*
@@ -354,13 +361,11 @@ union tuniHostIFmsgBody {
 	struct tstrHostIFSetMulti strHostIfSetMulti;
 	struct tstrHostIfSetOperationMode strHostIfSetOperationMode;
 	struct tstrHostIfSetMacAddress strHostIfSetMacAddress;
-	struct tstrHostIfGetMacAddress strHostIfGetMacAddress;
 	struct tstrHostIfBASessionInfo strHostIfBASessionInfo;
 #ifdef WILC_P2P
 	struct tstrHostIfRemainOnChan strHostIfRemainOnChan;
 	struct tstrHostIfRegisterFrame strHostIfRegisterFrame;
 #endif /* WILC_P2P */
-	char *pUserData;
 	struct tstrHostIFDelAllSta strHostIFDelAllSta;
 #ifdef WILC_BT_COEXISTENCE
 	struct tstrHostIFBTCoexMode strHostIfBTMode;
@@ -369,6 +374,30 @@ union tuniHostIFmsgBody {
 	struct tstrHostIFTxPwr strHostIFTxPwr;
 };
 
+/*
+ * Result slot of a synchronous request. It is refcounted between the
+ * caller and the message so a handler finishing after the caller timed
+ * out never writes to a stale stack frame.
+ */
+union tuniHostIFResult {
+	struct tstrStatistics strStatistics;
+	u8 au8MacAddress[ETH_ALEN];
+	unsigned int u32InactiveTime;
+	s8 s8Rssi;
+	s8 s8LinkSpeed;
+	u8 u8Chnl;
+	u8 u8TxPwr;
+};
+
+struct tstrHostIFWait {
+	struct kref strRef;
+	struct completion strDone;
+	signed int s32Result;
+	union tuniHostIFResult uniResult;
+};
+
+#define HOST_IF_WAIT_TIMEOUT_MS		10000
+
 /*
  * Host Interface message
  */
@@ -376,6 +405,7 @@ struct tstrHostIFmsg {
 	u16 u16MsgId; /* Message ID */
 	union tuniHostIFmsgBody uniHostIFmsgBody; /* Message body */
 	void *drvHandler;
+	struct tstrHostIFWait *pstrWait; /* set for synchronous requests */
 };
 
 #ifdef CONNECT_DIRECT
@@ -430,6 +460,18 @@ struct tstrBssTable {
 	struct tstrJoinBssParam *head;
 	struct tstrJoinBssParam *tail;
 };
+
+/*
+ * Join params live in a fixed pool sized for a full scan shadow plus the
+ * copies held by fast reconnect and queued joins, so scan results do not
+ * hit the allocator; kmalloc is only a fallback once the pool runs dry.
+ */
+#define JOIN_PARAMS_POOL_SIZE	(MAX_NUM_SCANNED_NETWORKS_SHADOW + 8)
+
+static struct tstrJoinBssParam gastrJoinParamsPool[JOIN_PARAMS_POOL_SIZE];
+static DECLARE_BITMAP(gaulJoinParamsUsed, JOIN_PARAMS_POOL_SIZE);
+static DEFINE_SPINLOCK(gsJoinParamsLock);
+static u32 join_params_pool_misses;
 #endif /*WILC_PARSE_SCAN_IN_HOST*/
 
 enum tenuScanConnTimer {
@@ -450,7 +492,6 @@ static struct MsgQueueHandle gMsgQHostIF;
 static struct semaphore hSemHostIFthrdEnd;
 
 struct semaphore hSemDeinitDrvHandle;
-static struct semaphore hWaitResponse;
 struct semaphore hSemHostIntDeinit;
 struct timer_list g_hPeriodicRSSI;
 
@@ -464,13 +505,22 @@ static u8 gapu8RcvdAssocResp[MAX_ASSOC_RESP_FRAME_SIZE];
 
 bool gbScanWhileConnected = false;
 
-static s8 gs8Rssi;
-static s8 gs8lnkspd;
-static u8 gu8Chnl;
 static u8 gs8SetIP[2][4];
 static u8 gs8GetIP[2][4];
+
+/* WID cache TTL in ms (0 disables it), tunable through debugfs */
+#define WID_CACHE_REFRESH_MS	5000
+/* Statistics refresh period while a link monitor is registered */
+#define RSSI_MONITOR_PERIOD_MS	1000
+static u32 wid_cache_ttl_ms = WID_CACHE_REFRESH_MS + 1000;
+static u32 wid_cache_hits;
+static u32 wid_cache_misses;
+/* Scan result handling cost, for measuring the parser against a beacon replay */
+static u32 ntwrk_info_frames;
+static u64 ntwrk_info_ns;
+static struct dentry *host_if_debugfs_dir;
+
 #ifdef WILC_AP_EXTERNAL_MLME
-static unsigned int gu32InactiveTime;
 static u8 gu8DelBcn;
 #endif /* WILC_AP_EXTERNAL_MLME */
 static unsigned int gu32WidConnRstHack;
@@ -493,6 +543,7 @@ unsigned int gu8FlushedJoinReqDrvHandler = 0;
 /*Bug4218: Parsing Join Param*/
 static void *host_int_ParseJoinBssParam(struct tstrNetworkInfo *ptstrNetworkInfo);
 #endif /*WILC_PARSE_SCAN_IN_HOST*/
+static void host_if_defer_kick(void);
 
 static int add_handler_in_list(struct WILC_WFIDrv *handler) {
 	int i;
@@ -563,6 +614,184 @@ static signed int Handle_SendBufferedEAP(void *drvHandler,
 	return s32Error;
 }
 
+/*
+ * Messages that must not sit behind queued polls. Only the scan abort
+ * qualifies: DISCONNECT and KEY must stay ordered after the CONNECT they
+ * belong to, which may still be queued. Scan results are shed first, so
+ * a dense scan cannot crowd out the connect response, the disconnect
+ * notification or the scan complete queued behind it.
+ */
+static enum MSG_PRIO host_if_msg_prio(const void *pvBuffer)
+{
+	const struct tstrHostIFmsg *pstrHostIFmsg = pvBuffer;
+
+	switch (pstrHostIFmsg->u16MsgId) {
+	case HOST_IF_MSG_SCAN_TIMER_FIRED:
+		return MSG_PRIO_HIGH;
+	case HOST_IF_MSG_RCVD_NTWRK_INFO:
+		return MSG_PRIO_BULK;
+	default:
+		return MSG_PRIO_NORMAL;
+	}
+}
+
+static int host_if_msgq_stats_show(struct seq_file *s, void *data)
+{
+	char *pcBuf;
+	int s32Len;
+
+	pcBuf = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	if (pcBuf == NULL)
+		return -ENOMEM;
+
+	s32Len = ATL_MsgQueueStats(&gMsgQHostIF, pcBuf, PAGE_SIZE);
+	seq_write(s, pcBuf, s32Len);
+	kfree(pcBuf);
+
+	return 0;
+}
+
+static int host_if_msgq_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, host_if_msgq_stats_show, inode->i_private);
+}
+
+static const struct file_operations host_if_msgq_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= host_if_msgq_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static struct tstrHostIFWait *host_if_wait_alloc(void)
+{
+	struct tstrHostIFWait *pstrWait;
+
+	pstrWait = kzalloc(sizeof(*pstrWait), GFP_KERNEL);
+	if (pstrWait == NULL)
+		return NULL;
+
+	kref_init(&pstrWait->strRef);
+	init_completion(&pstrWait->strDone);
+	pstrWait->s32Result = ATL_FAIL;
+
+	return pstrWait;
+}
+
+static void host_if_wait_release(struct kref *pstrRef)
+{
+	kfree(container_of(pstrRef, struct tstrHostIFWait, strRef));
+}
+
+static void host_if_wait_put(struct tstrHostIFWait *pstrWait)
+{
+	kref_put(&pstrWait->strRef, host_if_wait_release);
+}
+
+/*
+ * Called once the message of a synchronous request was handled or
+ * dropped; drops the reference the message held.
+ */
+static void host_if_wait_done(struct tstrHostIFWait *pstrWait,
+			      signed int s32Result)
+{
+	if (pstrWait == NULL)
+		return;
+
+	pstrWait->s32Result = s32Result;
+	complete(&pstrWait->strDone);
+	host_if_wait_put(pstrWait);
+}
+
+/*
+ * Queues a request and waits for its own completion. The result slot is
+ * only valid if ATL_SUCCESS is returned; the caller still puts pstrWait.
+ */
+static signed int host_if_send_wait(struct tstrHostIFmsg *pstrHostIFmsg,
+				    struct tstrHostIFWait *pstrWait)
+{
+	kref_get(&pstrWait->strRef);
+	pstrHostIFmsg->pstrWait = pstrWait;
+
+	if (ATL_MsgQueueSend(&gMsgQHostIF, pstrHostIFmsg,
+			     sizeof(struct tstrHostIFmsg))) {
+		PRINT_ER("Failed to send host interface msg %d\n",
+			 pstrHostIFmsg->u16MsgId);
+		host_if_wait_put(pstrWait);
+		return ATL_FAIL;
+	}
+
+	if (!wait_for_completion_timeout(&pstrWait->strDone,
+					 msecs_to_jiffies(HOST_IF_WAIT_TIMEOUT_MS))) {
+		PRINT_ER("Timed out waiting for host interface msg %d\n",
+			 pstrHostIFmsg->u16MsgId);
+		return ATL_FAIL;
+	}
+
+	return pstrWait->s32Result;
+}
+
+static void wid_cache_put(struct WILC_WFIDrv *pstrWFIDrv,
+			  enum tenuWidCacheIdx enuIdx, unsigned int u32Val)
+{
+	unsigned long flags;
+
+	if (pstrWFIDrv == NULL)
+		return;
+
+	spin_lock_irqsave(&pstrWFIDrv->strWidCacheLock, flags);
+	pstrWFIDrv->astrWidCache[enuIdx].u32Val = u32Val;
+	pstrWFIDrv->astrWidCache[enuIdx].ulStamp = jiffies;
+	pstrWFIDrv->astrWidCache[enuIdx].bValid = true;
+	spin_unlock_irqrestore(&pstrWFIDrv->strWidCacheLock, flags);
+}
+
+/*
+ * Copies u32Count consecutive cache entries starting at enuIdx, only if
+ * all of them are still fresh. Counts one hit or miss per call.
+ */
+static bool wid_cache_fetch(struct WILC_WFIDrv *pstrWFIDrv,
+			    enum tenuWidCacheIdx enuIdx, unsigned int u32Count,
+			    unsigned int *pu32Val)
+{
+	unsigned long flags, ulTTL = msecs_to_jiffies(wid_cache_ttl_ms);
+	struct tstrWidCacheEntry *pstrEntry;
+	bool bHit = (wid_cache_ttl_ms != 0);
+	unsigned int i;
+
+	spin_lock_irqsave(&pstrWFIDrv->strWidCacheLock, flags);
+	for (i = 0; bHit && i < u32Count; i++) {
+		pstrEntry = &pstrWFIDrv->astrWidCache[enuIdx + i];
+		if (!pstrEntry->bValid ||
+		    time_after(jiffies, pstrEntry->ulStamp + ulTTL))
+			bHit = false;
+		else
+			pu32Val[i] = pstrEntry->u32Val;
+	}
+	if (bHit)
+		wid_cache_hits++;
+	else
+		wid_cache_misses++;
+	spin_unlock_irqrestore(&pstrWFIDrv->strWidCacheLock, flags);
+
+	return bHit;
+}
+
+static void wid_cache_flush(struct WILC_WFIDrv *pstrWFIDrv)
+{
+	unsigned long flags;
+	int i;
+
+	if (pstrWFIDrv == NULL)
+		return;
+
+	spin_lock_irqsave(&pstrWFIDrv->strWidCacheLock, flags);
+	for (i = 0; i < WID_CACHE_MAX; i++)
+		pstrWFIDrv->astrWidCache[i].bValid = false;
+	spin_unlock_irqrestore(&pstrWFIDrv->strWidCacheLock, flags);
+}
+
 /*
  * Sending config packet to firmware to set channel
  */
@@ -597,6 +826,7 @@ static signed int Handle_SetChannel(void *drvHandler,
 		PRINT_ER("Failed to set channel\n");
 		ATL_ERRORREPORT(s32Error, ATL_INVALID_STATE);
 	}
+	wid_cache_put(pstrWFIDrv, WID_CACHE_CHNL, pstrHostIFSetChan->u8SetChan);
 	ATL_CATCH(s32Error){
 	}
 	
@@ -864,8 +1094,7 @@ static signed int Handle_SetMacAddress(void *drvHandler,
 /*
  * Getting mac address
  */
-static signed int Handle_GetMacAddress(void *drvHandler,
-				       struct tstrHostIfGetMacAddress *pstrHostIfGetMacAddress)
+static signed int Handle_GetMacAddress(void *drvHandler, u8 *pu8MacAddress)
 {
 	signed int s32Error = ATL_SUCCESS;
 	struct tstrWID strWID;
@@ -883,7 +1112,7 @@ static signed int Handle_GetMacAddress(void *drvHandler,
 	
 	strWID.u16WIDid = (u16)WID_MAC_ADDR;
 	strWID.enuWIDtype = WID_STR;
-	strWID.ps8WidVal = pstrHostIfGetMacAddress->u8MacAddress;
+	strWID.ps8WidVal = pu8MacAddress;
 	strWID.s32ValueSize = ETH_ALEN;
 
 	s32Error = SendConfigPkt(GET_CFG, &strWID, 1, false, driver_handler_id);
@@ -894,7 +1123,6 @@ static signed int Handle_GetMacAddress(void *drvHandler,
 	ATL_CATCH(s32Error){
 
 	}
-	up(&hWaitResponse);
 
 	return s32Error;
 }
@@ -1286,7 +1514,6 @@ static signed int Handle_wait_msg_q_empty(void)
 	signed int s32Error = ATL_SUCCESS;
 
 	g_wilc_initialized = 0;
-	up(&hWaitResponse);
 	return s32Error;
 }
 
@@ -1309,6 +1536,19 @@ static signed int Handle_Scan(void *drvHandler,
 	PRINT_D(HOSTINF_DBG,"Setting SCAN params\n");
 	PRINT_D(HOSTINF_DBG,"Scanning: In [%d] state \n", pstrWFIDrv->enuHostIFstate);
 
+	/*
+	 * The scan in flight keeps its callback until it is done; a second
+	 * one is turned away through its own callback instead.
+	 */
+	if (pstrWFIDrv->strWILC_UsrScanReq.pfUserScanResult != NULL) {
+		PRINT_D(GENERIC_DBG, "Don't scan, another scan is in flight\n");
+		if (pstrHostIFscanAttr->pfScanResult != NULL)
+			pstrHostIFscanAttr->pfScanResult(SCAN_EVENT_ABORTED, NULL,
+							 pstrHostIFscanAttr->pvUserArg, NULL);
+		s32Error = ATL_BUSY;
+		goto _free_attr_;
+	}
+
 	pstrWFIDrv->strWILC_UsrScanReq.pfUserScanResult = pstrHostIFscanAttr->pfScanResult;
 	pstrWFIDrv->strWILC_UsrScanReq.u32UserScanPvoid = pstrHostIFscanAttr->pvUserArg;
 
@@ -1428,6 +1668,7 @@ static signed int Handle_Scan(void *drvHandler,
 		Handle_ScanDone(drvHandler, SCAN_EVENT_ABORTED);
 	}
 
+_free_attr_:
 	/* Deallocate pstrHostIFscanAttr->u8ChnlListLen which was prevoisuly allocated by the sending thread */
 	if (pstrHostIFscanAttr->pu8ChnlFreqList != NULL) {
 		kfree(pstrHostIFscanAttr->pu8ChnlFreqList);
@@ -1440,6 +1681,8 @@ static signed int Handle_Scan(void *drvHandler,
 		pstrHostIFscanAttr->pu8IEs = NULL;
 	}
 	if (pstrHostIFscanAttr->strHiddenNetwork.pstrHiddenNetworkInfo != NULL)	{
+		for (i = 0; i < pstrHostIFscanAttr->strHiddenNetwork.u8ssidnum; i++)
+			kfree(pstrHostIFscanAttr->strHiddenNetwork.pstrHiddenNetworkInfo[i].pu8ssid);
 		kfree(pstrHostIFscanAttr->strHiddenNetwork.pstrHiddenNetworkInfo);
 		pstrHostIFscanAttr->strHiddenNetwork.pstrHiddenNetworkInfo = NULL;
 	}
@@ -1510,11 +1753,34 @@ signed int Handle_ScanDone(void *drvHandler, enum tenuScanEvent enuEvent)
 			pstrWFIDrv->strWILC_UsrScanReq.u32UserScanPvoid, NULL);
 		/*delete current scan request*/
 		pstrWFIDrv->strWILC_UsrScanReq.pfUserScanResult = NULL;
+		/* a CONNECT may be parked on this scan */
+		if (current != HostIFthreadHandler)
+			host_if_defer_kick();
 	}
 
 	return s32Error;
 }
 
+/*
+ * Free what host_int_set_join_req() allocated for a CONNECT message,
+ * including the join params it took ownership of
+ */
+static void host_if_free_connect_attr(struct tstrHostIFconnectAttr *pstrHostIFconnectAttr)
+{
+	kfree(pstrHostIFconnectAttr->pu8bssid);
+	pstrHostIFconnectAttr->pu8bssid = NULL;
+	kfree(pstrHostIFconnectAttr->pu8ssid);
+	pstrHostIFconnectAttr->pu8ssid = NULL;
+	kfree(pstrHostIFconnectAttr->pu8IEs);
+	pstrHostIFconnectAttr->pu8IEs = NULL;
+#ifdef WILC_PARSE_SCAN_IN_HOST
+	if (pstrHostIFconnectAttr->pJoinParams != NULL) {
+		host_int_freeJoinParams(pstrHostIFconnectAttr->pJoinParams);
+		pstrHostIFconnectAttr->pJoinParams = NULL;
+	}
+#endif /*WILC_PARSE_SCAN_IN_HOST*/
+}
+
 /*
  * Sending config packet to firmware to starting connection
  */
@@ -1689,6 +1955,7 @@ static signed int Handle_Connect(void *drvHandler,
 	if (memcmp(pstrHostIFconnectAttr->pu8bssid, u8ConnectedSSID, ETH_ALEN) == 0) {
 		s32Error = ATL_SUCCESS;
 		PRINT_ER("Trying to connect to an already connected AP, Discard connect request\n");
+		host_if_free_connect_attr(pstrHostIFconnectAttr);
 		return s32Error;
 	}
 
@@ -2026,23 +2293,8 @@ static signed int Handle_Connect(void *drvHandler,
 	}
 
 	PRINT_D(HOSTINF_DBG, "Deallocating connection parameters\n");
-	/* Deallocate pstrHostIFconnectAttr->pu8bssid which was prevoisuly allocated by the sending thread */
-	if (pstrHostIFconnectAttr->pu8bssid != NULL) {
-		kfree(pstrHostIFconnectAttr->pu8bssid);
-		pstrHostIFconnectAttr->pu8bssid = NULL;
-	}
-
-	/* Deallocate pstrHostIFconnectAttr->pu8ssid which was prevoisuly allocated by the sending thread */
-	if (pstrHostIFconnectAttr->pu8ssid != NULL) {
-		kfree(pstrHostIFconnectAttr->pu8ssid);
-		pstrHostIFconnectAttr->pu8ssid = NULL;
-	}
-
-	/* Deallocate pstrHostIFconnectAttr->pu8IEs which was prevoisuly allocated by the sending thread */
-	if (pstrHostIFconnectAttr->pu8IEs != NULL) {
-		kfree(pstrHostIFconnectAttr->pu8IEs);
-		pstrHostIFconnectAttr->pu8IEs = NULL;
-	}
+	/* Deallocate what was prevoisuly allocated by the sending thread */
+	host_if_free_connect_attr(pstrHostIFconnectAttr);
 
 	if (pu8CurrByte != NULL)
 		kfree(pu8CurrByte);
@@ -2235,8 +2487,10 @@ static signed int Handle_RcvdNtwrkInfo(void *drvHandler,
 	bool bNewNtwrkFound;
 
 	signed int s32Error = ATL_SUCCESS;
-	struct tstrNetworkInfo *pstrNetworkInfo = NULL;
+	struct tstrNetworkInfo strNetworkInfo;
+	struct tstrNetworkInfo *pstrNetworkInfo = &strNetworkInfo;
 	void *pJoinParams = NULL;
+	ktime_t tStart = ktime_get();
 
 	struct WILC_WFIDrv *pstrWFIDrv  = (struct WILC_WFIDrv *)drvHandler;
 
@@ -2246,8 +2500,7 @@ static signed int Handle_RcvdNtwrkInfo(void *drvHandler,
 	/*if there is a an ongoing scan request*/
 	if (pstrWFIDrv->strWILC_UsrScanReq.pfUserScanResult) {
 		PRINT_D(HOSTINF_DBG, "State: Scanning, parsing network information received\n");
-		ParseNetworkInfo(pstrRcvdNetworkInfo->pu8Buffer, &pstrNetworkInfo);
-		if ((pstrNetworkInfo == NULL)
+		if (ParseNetworkInfo(pstrRcvdNetworkInfo->pu8Buffer, pstrNetworkInfo) != ATL_SUCCESS
 		    || (pstrWFIDrv->strWILC_UsrScanReq.pfUserScanResult == NULL))
 			ATL_ERRORREPORT(s32Error, ATL_INVALID_ARGUMENT);
 
@@ -2293,10 +2546,13 @@ static signed int Handle_RcvdNtwrkInfo(void *drvHandler,
 
 					pstrNetworkInfo->bNewNetwork = true;
 				/*Bug4218: Parsing Join Param
-				*add new BSS to JoinBssTable
+				*add new BSS to JoinBssTable; this also fills in
+				*the channel and DTIM period
 				*/
 #ifdef WILC_PARSE_SCAN_IN_HOST
 					pJoinParams = host_int_ParseJoinBssParam(pstrNetworkInfo);
+#else
+					ParseNetworkInfoIEs(pstrNetworkInfo);
 #endif /*WILC_PARSE_SCAN_IN_HOST*/
 
 					pstrWFIDrv->strWILC_UsrScanReq.pfUserScanResult(SCAN_EVENT_NETWORK_FOUND, pstrNetworkInfo,
@@ -2308,6 +2564,7 @@ static signed int Handle_RcvdNtwrkInfo(void *drvHandler,
 			}
 		} else {
 			pstrNetworkInfo->bNewNetwork = false;
+			ParseNetworkInfoIEs(pstrNetworkInfo);
 			/* just call the User CallBack function to send the same discovered network with its updated RSSI */
 			pstrWFIDrv->strWILC_UsrScanReq.pfUserScanResult(SCAN_EVENT_NETWORK_FOUND, pstrNetworkInfo,
 									  pstrWFIDrv->strWILC_UsrScanReq.u32UserScanPvoid, NULL);
@@ -2317,18 +2574,18 @@ static signed int Handle_RcvdNtwrkInfo(void *drvHandler,
 	ATL_CATCH(s32Error){
 	}
 done:
-	/* Deallocate pstrRcvdNetworkInfo->pu8Buffer which was prevoisuly allocated by the sending thread */
+	ntwrk_info_frames++;
+	ntwrk_info_ns += ktime_to_ns(ktime_sub(ktime_get(), tStart));
+
+	/*
+	 * Deallocate pstrRcvdNetworkInfo->pu8Buffer which was prevoisuly allocated by the sending thread.
+	 * strNetworkInfo points into it, so this is the only copy to free.
+	 */
 	if (pstrRcvdNetworkInfo->pu8Buffer != NULL) {
 		kfree(pstrRcvdNetworkInfo->pu8Buffer);
 		pstrRcvdNetworkInfo->pu8Buffer = NULL;
 	}
 
-	/*free structure allocated*/
-	if (pstrNetworkInfo != NULL) {
-		DeallocateNetworkInfo(pstrNetworkInfo);
-		pstrNetworkInfo = NULL;
-	}
-
 	return s32Error;
 }
 
@@ -2503,6 +2760,7 @@ static signed int Handle_RcvdGnrlAsyncInfo(void *drvHandler,
 
 				PRINT_D(HOSTINF_DBG, "MAC status : CONNECTED and Connect Status : Successful\n");
 				pstrWFIDrv->enuHostIFstate = HOST_IF_CONNECTED;
+				wid_cache_flush(pstrWFIDrv);
 
 #ifdef DISABLE_PWRSAVE_AND_SCAN_DURING_IP
 				PRINT_D(GENERIC_DBG, "Obtaining an IP, Disable Scan\n");
@@ -2979,6 +3237,7 @@ static void Handle_Disconnect(void *drvHandler)
 	strWID.s32ValueSize = sizeof(char);
 
 	PRINT_D(HOSTINF_DBG, "Sending disconnect request\n");
+	wid_cache_flush(pstrWFIDrv);
 
 #ifdef DISABLE_PWRSAVE_AND_SCAN_DURING_IP
 
@@ -3149,7 +3408,7 @@ static signed int Switch_Log_Terminal(void *drvHandler)
 /*
  * Sending config packet to get channel
  */
-static signed int Handle_GetChnl(void *drvHandler)
+static signed int Handle_GetChnl(void *drvHandler, u8 *pu8Chnl)
 {
 	signed int s32Error = ATL_SUCCESS;
 	struct tstrWID strWID;
@@ -3167,7 +3426,7 @@ static signed int Handle_GetChnl(void *drvHandler)
 	
 	strWID.u16WIDid = (u16)WID_CURRENT_CHANNEL;
 	strWID.enuWIDtype = WID_CHAR;
-	strWID.ps8WidVal = (s8 *)&gu8Chnl;
+	strWID.ps8WidVal = (s8 *)pu8Chnl;
 	strWID.s32ValueSize = sizeof(char);
 
 	PRINT_D(HOSTINF_DBG, "Getting channel value\n");
@@ -3178,19 +3437,18 @@ static signed int Handle_GetChnl(void *drvHandler)
 		PRINT_ER("Failed to get channel number\n");
 		ATL_ERRORREPORT(s32Error, ATL_FAIL);
 	}
+	wid_cache_put(pstrWFIDrv, WID_CACHE_CHNL, *pu8Chnl);
 
 	ATL_CATCH(s32Error){
 	}
 
-	up(&(pstrWFIDrv->hSemGetCHNL));
-
 	return s32Error;
 }
 
 /*
  * Sending config packet to get RSSI
  */
-static void Handle_GetRssi(void *drvHandler)
+static signed int Handle_GetRssi(void *drvHandler, s8 *ps8Rssi)
 {
 	signed int s32Error = ATL_SUCCESS;
 	struct tstrWID strWID;
@@ -3208,7 +3466,7 @@ static void Handle_GetRssi(void *drvHandler)
 	
 	strWID.u16WIDid = (u16)WID_RSSI;
 	strWID.enuWIDtype = WID_CHAR;
-	strWID.ps8WidVal = &gs8Rssi;
+	strWID.ps8WidVal = ps8Rssi;
 	strWID.s32ValueSize = sizeof(char);
 
 	/*Sending Cfg*/
@@ -3219,14 +3477,15 @@ static void Handle_GetRssi(void *drvHandler)
 		PRINT_ER("Failed to get RSSI value\n");
 		ATL_ERRORREPORT(s32Error, ATL_FAIL);
 	}
+	wid_cache_put(pstrWFIDrv, WID_CACHE_RSSI, (u8)*ps8Rssi);
 
 	ATL_CATCH(s32Error){
 	}
 
-	up(&(pstrWFIDrv->hSemGetRSSI));
+	return s32Error;
 }
 
-static void Handle_GetLinkspeed(void *drvHandler)
+static signed int Handle_GetLinkspeed(void *drvHandler, s8 *ps8lnkspd)
 {
 	signed int s32Error = ATL_SUCCESS;
 	struct tstrWID strWID;
@@ -3242,11 +3501,11 @@ static void Handle_GetLinkspeed(void *drvHandler)
 		driver_handler_id = 0;
 	}
 	
-	gs8lnkspd = 0;
+	*ps8lnkspd = 0;
 
 	strWID.u16WIDid = (u16)WID_LINKSPEED;
 	strWID.enuWIDtype = WID_CHAR;
-	strWID.ps8WidVal = &gs8lnkspd;
+	strWID.ps8WidVal = ps8lnkspd;
 	strWID.s32ValueSize = sizeof(char);
 	/*Sending Cfg*/
 	PRINT_D(HOSTINF_DBG, "Getting LINKSPEED value\n");
@@ -3256,20 +3515,29 @@ static void Handle_GetLinkspeed(void *drvHandler)
 		PRINT_ER("Failed to get LINKSPEED value\n");
 		ATL_ERRORREPORT(s32Error, ATL_FAIL);
 	}
+	wid_cache_put(pstrWFIDrv, WID_CACHE_LINKSPEED, (u8)*ps8lnkspd);
 
 	ATL_CATCH(s32Error){
 	}
 
-	up(&(pstrWFIDrv->hSemGetLINKSPEED));
+	return s32Error;
 }
 
+/*
+ * A NULL pstrStatistics is a background refresh of the WID cache.
+ */
 signed int Handle_GetStatistics(void *drvHandler,
 				struct tstrStatistics *pstrStatistics)
 {
 	struct tstrWID strWIDList[5];
+	struct tstrStatistics strStatistics;
 	uint32_t u32WidsCount = 0, s32Error = 0;
 	int driver_handler_id = 0;
 	struct WILC_WFIDrv *pstrWFIDrv = (struct WILC_WFIDrv *)drvHandler;
+	bool bRefresh = (pstrStatistics == NULL);
+
+	if (bRefresh)
+		pstrStatistics = &strStatistics;
 
 	if(pstrWFIDrv != NULL)
 	{
@@ -3312,11 +3580,21 @@ signed int Handle_GetStatistics(void *drvHandler,
 
 	s32Error = SendConfigPkt(GET_CFG, strWIDList, u32WidsCount, false, driver_handler_id);
 
-	if (s32Error)
+	if (s32Error) {
 		PRINT_ER("Failed to send scan paramters config packet\n");
-	up(&hWaitResponse);
+	} else {
+		wid_cache_put(pstrWFIDrv, WID_CACHE_LINKSPEED, pstrStatistics->u8LinkSpeed);
+		wid_cache_put(pstrWFIDrv, WID_CACHE_RSSI, (u8)pstrStatistics->s8RSSI);
+		wid_cache_put(pstrWFIDrv, WID_CACHE_TX_COUNT, pstrStatistics->u32TxCount);
+		wid_cache_put(pstrWFIDrv, WID_CACHE_RX_COUNT, pstrStatistics->u32RxCount);
+		wid_cache_put(pstrWFIDrv, WID_CACHE_TX_FAIL_COUNT, pstrStatistics->u32TxFailureCount);
 
-	return 0;
+		if (bRefresh && pstrWFIDrv->pfRssiSample != NULL &&
+		    pstrWFIDrv->enuHostIFstate == HOST_IF_CONNECTED)
+			pstrWFIDrv->pfRssiSample(pstrStatistics, pstrWFIDrv->pvRssiUserArg);
+	}
+
+	return s32Error ? ATL_FAIL : ATL_SUCCESS;
 }
 
 #ifdef WILC_AP_EXTERNAL_MLME
@@ -3324,7 +3602,8 @@ signed int Handle_GetStatistics(void *drvHandler,
  * Sending config packet to set mac adddress for station and get inactive time
  */
 static signed int Handle_Get_InActiveTime(void *drvHandler,
-					  struct tstrHostIfStaInactive *strHostIfStaInactiveT)
+					  struct tstrHostIfStaInactive *strHostIfStaInactiveT,
+					  unsigned int *pu32InactiveTime)
 {
 	signed int s32Error = ATL_SUCCESS;
 	u8 *stamac;
@@ -3360,7 +3639,7 @@ static signed int Handle_Get_InActiveTime(void *drvHandler,
 
 	strWID.u16WIDid = (u16)WID_GET_INACTIVE_TIME;
 	strWID.enuWIDtype = WID_INT;
-	strWID.ps8WidVal = (s8 *)&gu32InactiveTime;
+	strWID.ps8WidVal = (s8 *)pu32InactiveTime;
 	strWID.s32ValueSize = sizeof(unsigned int);
 
 	s32Error = SendConfigPkt(GET_CFG, &strWID, 1, true, driver_handler_id);
@@ -3370,9 +3649,7 @@ static signed int Handle_Get_InActiveTime(void *drvHandler,
 		ATL_ERRORREPORT(s32Error, ATL_FAIL);
 	}
 
-	PRINT_D(CFG80211_DBG, "Getting inactive time : %d\n", gu32InactiveTime);
-
-	up(&(pstrWFIDrv->hSemInactiveTime));
+	PRINT_D(CFG80211_DBG, "Getting inactive time : %d\n", *pu32InactiveTime);
 
 	ATL_CATCH(s32Error){
 	}
@@ -3659,7 +3936,6 @@ static void Handle_DelAllSta(void *drvHandler,
 
 	if (strWID.ps8WidVal != NULL)
 		kfree(strWID.ps8WidVal);
-	up(&hWaitResponse);
 }
 
 /*
@@ -3995,6 +4271,12 @@ static void ListenTimerCB(unsigned long function_context)
 }
 #endif
 
+static void PowerManagementDone(void *pvPriv, int s32Status)
+{
+	if (!s32Status)
+		PRINT_ER("Power management config packet timed out\n");
+}
+
 /*
  * Sending config packet to edit station
  */
@@ -4002,9 +4284,11 @@ static void Handle_PowerManagement(void *drvHandler,
 				   struct tstrHostIfPowerMgmtParam *strPowerMgmtParam)
 {
 	signed int s32Error = ATL_SUCCESS;
-	struct tstrWID strWID;
+	struct tstrWID strWIDList[2];
+	u8 u8WidCnt = 0;
 	int driver_handler_id = 0;
 	s8 s8PowerMode;
+	u8 u8ListenInterval = strPowerMgmtParam->u8ListenInterval;
 	struct WILC_WFIDrv *pstrWFIDrv = (struct WILC_WFIDrv *)drvHandler;
 
 	if(pstrWFIDrv != NULL)
@@ -4016,20 +4300,62 @@ static void Handle_PowerManagement(void *drvHandler,
 		driver_handler_id = 0;
 	}
 	
-	strWID.u16WIDid = (u16)WID_POWER_MANAGEMENT;
-
-	if (strPowerMgmtParam->bIsEnabled == true)
-		s8PowerMode = MIN_FAST_PS;
-	else
+	if (strPowerMgmtParam->bIsEnabled == true) {
+		if (strPowerMgmtParam->s8PowerMode != NO_POWERSAVE)
+			s8PowerMode = strPowerMgmtParam->s8PowerMode;
+		else
+			s8PowerMode = MIN_FAST_PS;
+	} else {
 		s8PowerMode = NO_POWERSAVE;
+	}
 	PRINT_D(HOSTINF_DBG, "Handling power mgmt to %d\n", s8PowerMode);
-	strWID.ps8WidVal = &s8PowerMode;
-	strWID.s32ValueSize = sizeof(char);
+	strWIDList[u8WidCnt].u16WIDid = (u16)WID_POWER_MANAGEMENT;
+	strWIDList[u8WidCnt].enuWIDtype = WID_CHAR;
+	strWIDList[u8WidCnt].ps8WidVal = &s8PowerMode;
+	strWIDList[u8WidCnt].s32ValueSize = sizeof(char);
+	u8WidCnt++;
+
+	/*
+	 * A listen interval comes from the PS policy in its idle level.
+	 * Remember the one it replaces and put it back with the next mode
+	 * that doesn't carry one (active, busy, power save off).
+	 */
+	if ((u8ListenInterval != 0) && (pstrWFIDrv != NULL) &&
+	    (pstrWFIDrv->u8SavedListenInterval == 0)) {
+		struct tstrWID strWID;
+
+		strWID.u16WIDid = (u16)WID_LISTEN_INTERVAL;
+		strWID.enuWIDtype = WID_CHAR;
+		strWID.ps8WidVal = (s8 *)&pstrWFIDrv->u8SavedListenInterval;
+		strWID.s32ValueSize = sizeof(char);
+		if (SendConfigPkt(GET_CFG, &strWID, 1, true, driver_handler_id)) {
+			PRINT_ER("Failed to get listen interval\n");
+			pstrWFIDrv->u8SavedListenInterval = 0;
+		}
+	} else if ((u8ListenInterval == 0) && (pstrWFIDrv != NULL) &&
+		   (pstrWFIDrv->u8SavedListenInterval != 0)) {
+		u8ListenInterval = pstrWFIDrv->u8SavedListenInterval;
+		pstrWFIDrv->u8SavedListenInterval = 0;
+	}
+
+	if (u8ListenInterval != 0) {
+		PRINT_D(HOSTINF_DBG, "Listen interval %d\n", u8ListenInterval);
+		strWIDList[u8WidCnt].u16WIDid = (u16)WID_LISTEN_INTERVAL;
+		strWIDList[u8WidCnt].enuWIDtype = WID_CHAR;
+		strWIDList[u8WidCnt].ps8WidVal = (s8 *)&u8ListenInterval;
+		strWIDList[u8WidCnt].s32ValueSize = sizeof(char);
+		u8WidCnt++;
+	}
 
 	PRINT_D(HOSTINF_DBG, "Handling Power Management\n");
 
-	/*Sending Cfg*/
-	s32Error = SendConfigPkt(SET_CFG, &strWID, 1, true, driver_handler_id);
+	/*
+	 * Sending Cfg, the policy engine may issue these often so don't
+	 * hold the host interface thread until the firmware answers
+	 */
+	s32Error = SendConfigPktAsync(SET_CFG, strWIDList, u8WidCnt,
+				      driver_handler_id,
+				      PowerManagementDone, NULL);
 	if (s32Error) {
 		PRINT_ER("Failed to send power management config packet\n");
 		ATL_ERRORREPORT(s32Error, ATL_INVALID_STATE);
@@ -4251,8 +4577,6 @@ static signed int Handle_DelBASession(void *drvHandler,
 	if (strWID.ps8WidVal != NULL)
 		kfree(strWID.ps8WidVal);
 
-	up(&hWaitResponse);
-
 	return s32Error;
 }
 
@@ -4321,368 +4645,519 @@ static signed int Handle_GetTxPwr(void * drvHandler, u8* pu8TxPwr)
 		PRINT_ER("Failed to send scan paramters config packet\n");
 		//ATL_ERRORREPORT(s32Error, s32Error);
 	}
-	up(&hWaitResponse);
 	return s32Error; 
 }
 
 
 
 /*
- * Main thread to handle message queue requests
+ * Runs the handler of a single host interface message
  */
-static int hostIFthread(void *pvArg)
+static void host_if_dispatch(struct tstrHostIFmsg *pstrHostIFmsg)
 {
-	unsigned int u32Ret;
-	struct tstrHostIFmsg strHostIFmsg;
-	struct WILC_WFIDrv *pstrWFIDrv;
-
-	memset(&strHostIFmsg, 0, sizeof(struct tstrHostIFmsg));
-
-	while (1) {
-		ATL_MsgQueueRecv(&gMsgQHostIF, &strHostIFmsg,
-				 sizeof(struct tstrHostIFmsg), &u32Ret);
-		pstrWFIDrv = (struct WILC_WFIDrv *)strHostIFmsg.drvHandler;
-		if (strHostIFmsg.u16MsgId == HOST_IF_MSG_EXIT) {
-			PRINT_D(GENERIC_DBG, "THREAD: Exiting HostIfThread\n");
-			break;
-		}
-
-		/*Re-Queue HIF message*/
-		if ((!g_wilc_initialized)) {
-			PRINT_D(GENERIC_DBG, "--WAIT--");
-			msleep(200);
-			ATL_MsgQueueSend(&gMsgQHostIF, &strHostIFmsg,
-					 sizeof(struct tstrHostIFmsg));
-			continue;
-		}
+	struct WILC_WFIDrv *pstrWFIDrv = (struct WILC_WFIDrv *)pstrHostIFmsg->drvHandler;
+	struct tstrHostIFWait *pstrWait = pstrHostIFmsg->pstrWait;
+	union tuniHostIFResult uniScratch, *puniResult;
+	signed int s32Result = ATL_SUCCESS;
 
-		if (strHostIFmsg.u16MsgId == HOST_IF_MSG_CONNECT &&
-		    pstrWFIDrv->strWILC_UsrScanReq.pfUserScanResult != NULL) {
-			PRINT_D(HOSTINF_DBG, "Requeue connect request till scan done received\n");
-			ATL_MsgQueueSend(&gMsgQHostIF, &strHostIFmsg,
-					 sizeof(struct tstrHostIFmsg));
-			usleep_range(2000, 2100);
-			continue;
-		}
+	puniResult = pstrWait ? &pstrWait->uniResult : &uniScratch;
 
-		switch (strHostIFmsg.u16MsgId) {
-		case HOST_IF_MSG_Q_IDLE:
-		{
-			Handle_wait_msg_q_empty();
-			break;
-		}
+	switch (pstrHostIFmsg->u16MsgId) {
+	case HOST_IF_MSG_Q_IDLE:
+	{
+		Handle_wait_msg_q_empty();
+		break;
+	}
 
-		case HOST_IF_MSG_SCAN:
-		{
-			Handle_Scan(strHostIFmsg.drvHandler,
-				    &strHostIFmsg.uniHostIFmsgBody.strHostIFscanAttr);
-			break;
-		}
+	case HOST_IF_MSG_SCAN:
+	{
+		Handle_Scan(pstrHostIFmsg->drvHandler,
+			    &pstrHostIFmsg->uniHostIFmsgBody.strHostIFscanAttr);
+		break;
+	}
 
-		case HOST_IF_MSG_CONNECT:
-		{
-			Handle_Connect(strHostIFmsg.drvHandler,
-				       &strHostIFmsg.uniHostIFmsgBody.strHostIFconnectAttr);
-			break;
-		}
+	case HOST_IF_MSG_CONNECT:
+	{
+		Handle_Connect(pstrHostIFmsg->drvHandler,
+			       &pstrHostIFmsg->uniHostIFmsgBody.strHostIFconnectAttr);
+		break;
+	}
 
-			/*BugID_5137*/
-		case HOST_IF_MSG_FLUSH_CONNECT:
-		{
-			Handle_FlushConnect(strHostIFmsg.drvHandler);
-			break;
-		}
+		/*BugID_5137*/
+	case HOST_IF_MSG_FLUSH_CONNECT:
+	{
+		Handle_FlushConnect(pstrHostIFmsg->drvHandler);
+		break;
+	}
 
-		case HOST_IF_MSG_RCVD_NTWRK_INFO:
-		{
-			Handle_RcvdNtwrkInfo(strHostIFmsg.drvHandler,
-					     &strHostIFmsg.uniHostIFmsgBody.strRcvdNetworkInfo);
-			break;
-		}
+	case HOST_IF_MSG_RCVD_NTWRK_INFO:
+	{
+		Handle_RcvdNtwrkInfo(pstrHostIFmsg->drvHandler,
+				     &pstrHostIFmsg->uniHostIFmsgBody.strRcvdNetworkInfo);
+		break;
+	}
 
-		case HOST_IF_MSG_RCVD_GNRL_ASYNC_INFO:
-		{
-			Handle_RcvdGnrlAsyncInfo(strHostIFmsg.drvHandler,
-						 &strHostIFmsg.uniHostIFmsgBody.strRcvdGnrlAsyncInfo);
-			break;
-		}
+	case HOST_IF_MSG_RCVD_GNRL_ASYNC_INFO:
+	{
+		Handle_RcvdGnrlAsyncInfo(pstrHostIFmsg->drvHandler,
+					 &pstrHostIFmsg->uniHostIFmsgBody.strRcvdGnrlAsyncInfo);
+		break;
+	}
 
-		case HOST_IF_MSG_KEY:
-		{
-			Handle_Key(strHostIFmsg.drvHandler,
-				   &strHostIFmsg.uniHostIFmsgBody.strHostIFkeyAttr);
-			break;
-		}
+	case HOST_IF_MSG_KEY:
+	{
+		Handle_Key(pstrHostIFmsg->drvHandler,
+			   &pstrHostIFmsg->uniHostIFmsgBody.strHostIFkeyAttr);
+		break;
+	}
 
-		case HOST_IF_MSG_CFG_PARAMS:
-		{
-			Handle_CfgParam(strHostIFmsg.drvHandler,
-					&strHostIFmsg.uniHostIFmsgBody.strHostIFCfgParamAttr);
-			break;
-		}
+	case HOST_IF_MSG_CFG_PARAMS:
+	{
+		Handle_CfgParam(pstrHostIFmsg->drvHandler,
+				&pstrHostIFmsg->uniHostIFmsgBody.strHostIFCfgParamAttr);
+		break;
+	}
 
-		case HOST_IF_MSG_SET_CHANNEL:
-		{
-			Handle_SetChannel(strHostIFmsg.drvHandler,
-					  &strHostIFmsg.uniHostIFmsgBody.strHostIFSetChan);
-			break;
-		}
+	case HOST_IF_MSG_SET_CHANNEL:
+	{
+		Handle_SetChannel(pstrHostIFmsg->drvHandler,
+				  &pstrHostIFmsg->uniHostIFmsgBody.strHostIFSetChan);
+		break;
+	}
 
 #ifdef WILC_BT_COEXISTENCE
-		case HOST_IF_MSG_CHANGE_BT_COEX_MODE:
-		{
-			Handle_BTCoexModeChange(strHostIFmsg.drvHandler,
-						&strHostIFmsg.uniHostIFmsgBody.strHostIfBTMode);
-			break;
-		}
+	case HOST_IF_MSG_CHANGE_BT_COEX_MODE:
+	{
+		Handle_BTCoexModeChange(pstrHostIFmsg->drvHandler,
+					&pstrHostIFmsg->uniHostIFmsgBody.strHostIfBTMode);
+		break;
+	}
 
 #endif
-		case HOST_IF_MSG_DISCONNECT:
-		{
-			Handle_Disconnect(strHostIFmsg.drvHandler);
-			break;
-		}
+	case HOST_IF_MSG_DISCONNECT:
+	{
+		Handle_Disconnect(pstrHostIFmsg->drvHandler);
+		break;
+	}
 
-		case HOST_IF_MSG_RCVD_SCAN_COMPLETE:
-		{
-			del_timer(&(pstrWFIDrv->hScanTimer));
-			PRINT_D(HOSTINF_DBG, "scan completed successfully\n");
+	case HOST_IF_MSG_RCVD_SCAN_COMPLETE:
+	{
+		del_timer(&(pstrWFIDrv->hScanTimer));
+		PRINT_D(HOSTINF_DBG, "scan completed successfully\n");
 
-			/*BugID_5213
-			*Allow chip sleep, only if both interfaces are not connected
-			*/
-			if (!linux_wlan_get_num_conn_ifcs())
-				chip_sleep_manually(INFINITE_SLEEP_TIME,
-						    PWR_DEV_SRC_WIFI);
+		/*BugID_5213
+		*Allow chip sleep, only if both interfaces are not connected
+		*/
+		if (!linux_wlan_get_num_conn_ifcs())
+			chip_sleep_manually(INFINITE_SLEEP_TIME,
+					    PWR_DEV_SRC_WIFI);
 
-			Handle_ScanDone(strHostIFmsg.drvHandler, SCAN_EVENT_DONE);
+		Handle_ScanDone(pstrHostIFmsg->drvHandler, SCAN_EVENT_DONE);
 
 #ifdef WILC_P2P
-			if (pstrWFIDrv->u8RemainOnChan_pendingreq)
-				Handle_RemainOnChan(strHostIFmsg.drvHandler,
-						    &strHostIFmsg.uniHostIFmsgBody.strHostIfRemainOnChan);
+		if (pstrWFIDrv->u8RemainOnChan_pendingreq)
+			Handle_RemainOnChan(pstrHostIFmsg->drvHandler,
+					    &pstrHostIFmsg->uniHostIFmsgBody.strHostIfRemainOnChan);
 #endif /* WILC_P2P */
 
-			break;
-		}
+		break;
+	}
 
-		case HOST_IF_MSG_GET_RSSI:
-		{
-			Handle_GetRssi(strHostIFmsg.drvHandler);
-			break;
-		}
+	case HOST_IF_MSG_GET_RSSI:
+	{
+		s32Result = Handle_GetRssi(pstrHostIFmsg->drvHandler,
+					   &puniResult->s8Rssi);
+		break;
+	}
 
-		case HOST_IF_MSG_GET_LINKSPEED:
-		{
-			Handle_GetLinkspeed(strHostIFmsg.drvHandler);
-			break;
-		}
+	case HOST_IF_MSG_GET_LINKSPEED:
+	{
+		s32Result = Handle_GetLinkspeed(pstrHostIFmsg->drvHandler,
+						&puniResult->s8LinkSpeed);
+		break;
+	}
 
-		case HOST_IF_MSG_GET_STATISTICS:
-		{
-			Handle_GetStatistics(strHostIFmsg.drvHandler,
-					     (struct tstrStatistics *)strHostIFmsg.uniHostIFmsgBody.pUserData);
-			break;
-		}
+	case HOST_IF_MSG_GET_STATISTICS:
+	{
+		s32Result = Handle_GetStatistics(pstrHostIFmsg->drvHandler,
+						 pstrWait ? &pstrWait->uniResult.strStatistics : NULL);
+		break;
+	}
 
-		case HOST_IF_MSG_GET_CHNL:
-		{
-			Handle_GetChnl(strHostIFmsg.drvHandler);
-			break;
-		}
+	case HOST_IF_MSG_GET_CHNL:
+	{
+		s32Result = Handle_GetChnl(pstrHostIFmsg->drvHandler,
+					   &puniResult->u8Chnl);
+		break;
+	}
 
 #ifdef WILC_AP_EXTERNAL_MLME
-		case HOST_IF_MSG_ADD_BEACON:
-		{
-			Handle_AddBeacon(strHostIFmsg.drvHandler,
-					 &strHostIFmsg.uniHostIFmsgBody.strHostIFSetBeacon);
-			break;
-		}
+	case HOST_IF_MSG_ADD_BEACON:
+	{
+		Handle_AddBeacon(pstrHostIFmsg->drvHandler,
+				 &pstrHostIFmsg->uniHostIFmsgBody.strHostIFSetBeacon);
 		break;
+	}
+	break;
 
-		case HOST_IF_MSG_DEL_BEACON:
-		{
-			Handle_DelBeacon(strHostIFmsg.drvHandler,
-					 &strHostIFmsg.uniHostIFmsgBody.strHostIFDelBeacon);
-			break;
-		}
+	case HOST_IF_MSG_DEL_BEACON:
+	{
+		Handle_DelBeacon(pstrHostIFmsg->drvHandler,
+				 &pstrHostIFmsg->uniHostIFmsgBody.strHostIFDelBeacon);
 		break;
+	}
+	break;
 
-		case HOST_IF_MSG_ADD_STATION:
-		{
-			Handle_AddStation(strHostIFmsg.drvHandler,
-					  &strHostIFmsg.uniHostIFmsgBody.strAddStaParam);
-			break;
-		}
+	case HOST_IF_MSG_ADD_STATION:
+	{
+		Handle_AddStation(pstrHostIFmsg->drvHandler,
+				  &pstrHostIFmsg->uniHostIFmsgBody.strAddStaParam);
+		break;
+	}
 
-		case HOST_IF_MSG_DEL_STATION:
-		{
-			Handle_DelStation(strHostIFmsg.drvHandler,
-					  &strHostIFmsg.uniHostIFmsgBody.strDelStaParam);
-			break;
-		}
+	case HOST_IF_MSG_DEL_STATION:
+	{
+		Handle_DelStation(pstrHostIFmsg->drvHandler,
+				  &pstrHostIFmsg->uniHostIFmsgBody.strDelStaParam);
+		break;
+	}
 
-		case HOST_IF_MSG_EDIT_STATION:
-		{
-			Handle_EditStation(strHostIFmsg.drvHandler,
-					   &strHostIFmsg.uniHostIFmsgBody.strEditStaParam);
-			break;
-		}
+	case HOST_IF_MSG_EDIT_STATION:
+	{
+		Handle_EditStation(pstrHostIFmsg->drvHandler,
+				   &pstrHostIFmsg->uniHostIFmsgBody.strEditStaParam);
+		break;
+	}
 
-		case HOST_IF_MSG_GET_INACTIVETIME:
-		{
-			Handle_Get_InActiveTime(strHostIFmsg.drvHandler,
-						&strHostIFmsg.uniHostIFmsgBody.strHostIfStaInactiveT);
-			break;
-		}
+	case HOST_IF_MSG_GET_INACTIVETIME:
+	{
+		s32Result = Handle_Get_InActiveTime(pstrHostIFmsg->drvHandler,
+						    &pstrHostIFmsg->uniHostIFmsgBody.strHostIfStaInactiveT,
+						    &puniResult->u32InactiveTime);
+		break;
+	}
 
 #endif /*WILC_AP_EXTERNAL_MLME*/
-		case HOST_IF_MSG_SCAN_TIMER_FIRED:
-		{
-			PRINT_INFO(HOSTINF_DBG, "Scan Timeout\n");
-			Handle_ScanDone(strHostIFmsg.drvHandler,
-					SCAN_EVENT_ABORTED);
+	case HOST_IF_MSG_SCAN_TIMER_FIRED:
+	{
+		PRINT_INFO(HOSTINF_DBG, "Scan Timeout\n");
+		Handle_ScanDone(pstrHostIFmsg->drvHandler,
+				SCAN_EVENT_ABORTED);
 
-			break;
-		}
+		break;
+	}
 
-		case HOST_IF_MSG_CONNECT_TIMER_FIRED:
-		{
-			PRINT_INFO(HOSTINF_DBG, "Connect Timeout\n");
-			Handle_ConnectTimeout(strHostIFmsg.drvHandler);
-			break;
-		}
+	case HOST_IF_MSG_CONNECT_TIMER_FIRED:
+	{
+		PRINT_INFO(HOSTINF_DBG, "Connect Timeout\n");
+		Handle_ConnectTimeout(pstrHostIFmsg->drvHandler);
+		break;
+	}
 
-		case HOST_IF_MSG_POWER_MGMT:
-		{
-			Handle_PowerManagement(strHostIFmsg.drvHandler,
-					       &strHostIFmsg.uniHostIFmsgBody.strPowerMgmtparam);
-			break;
-		}
+	case HOST_IF_MSG_POWER_MGMT:
+	{
+		Handle_PowerManagement(pstrHostIFmsg->drvHandler,
+				       &pstrHostIFmsg->uniHostIFmsgBody.strPowerMgmtparam);
+		break;
+	}
 
-		case HOST_IF_MSG_SET_WFIDRV_HANDLER:
-		{
-			Handle_SetWfiDrvHandler(&strHostIFmsg.uniHostIFmsgBody.strHostIfSetDrvHandler);
+	case HOST_IF_MSG_SET_WFIDRV_HANDLER:
+	{
+		Handle_SetWfiDrvHandler(&pstrHostIFmsg->uniHostIFmsgBody.strHostIfSetDrvHandler);
 
-			break;
-		}
+		break;
+	}
 
-		case HOST_IF_MSG_SET_OPERATION_MODE:
-		{
-			Handle_SetOperationMode(strHostIFmsg.drvHandler,
-						&strHostIFmsg.uniHostIFmsgBody.strHostIfSetOperationMode);
+	case HOST_IF_MSG_SET_OPERATION_MODE:
+	{
+		Handle_SetOperationMode(pstrHostIFmsg->drvHandler,
+					&pstrHostIFmsg->uniHostIFmsgBody.strHostIfSetOperationMode);
 
-			break;
-		}
+		break;
+	}
 
-		case HOST_IF_MSG_SET_IPADDRESS:
-		{
-			PRINT_D(HOSTINF_DBG, "HOST_IF_MSG_SET_IPADDRESS\n");
-			Handle_set_IPAddress(strHostIFmsg.drvHandler,
-					     strHostIFmsg.uniHostIFmsgBody.strHostIfSetIP.au8IPAddr,
-					     strHostIFmsg.uniHostIFmsgBody.strHostIfSetIP.idx);
-			break;
-		}
+	case HOST_IF_MSG_SET_IPADDRESS:
+	{
+		PRINT_D(HOSTINF_DBG, "HOST_IF_MSG_SET_IPADDRESS\n");
+		Handle_set_IPAddress(pstrHostIFmsg->drvHandler,
+				     pstrHostIFmsg->uniHostIFmsgBody.strHostIfSetIP.au8IPAddr,
+				     pstrHostIFmsg->uniHostIFmsgBody.strHostIfSetIP.idx);
+		break;
+	}
 
-		case HOST_IF_MSG_GET_IPADDRESS:
-		{
-			PRINT_D(HOSTINF_DBG, "HOST_IF_MSG_SET_IPADDRESS\n");
-			Handle_get_IPAddress(strHostIFmsg.drvHandler,
-					     strHostIFmsg.uniHostIFmsgBody.strHostIfSetIP.au8IPAddr,
-					     strHostIFmsg.uniHostIFmsgBody.strHostIfSetIP.idx);
-			break;
-		}
+	case HOST_IF_MSG_GET_IPADDRESS:
+	{
+		PRINT_D(HOSTINF_DBG, "HOST_IF_MSG_SET_IPADDRESS\n");
+		Handle_get_IPAddress(pstrHostIFmsg->drvHandler,
+				     pstrHostIFmsg->uniHostIFmsgBody.strHostIfSetIP.au8IPAddr,
+				     pstrHostIFmsg->uniHostIFmsgBody.strHostIfSetIP.idx);
+		break;
+	}
 
-		/*BugID_5077*/
-		case HOST_IF_MSG_SET_MAC_ADDRESS:
-		{
-			Handle_SetMacAddress(strHostIFmsg.drvHandler,
-					     &strHostIFmsg.uniHostIFmsgBody.strHostIfSetMacAddress);
-			break;
-		}
+	/*BugID_5077*/
+	case HOST_IF_MSG_SET_MAC_ADDRESS:
+	{
+		Handle_SetMacAddress(pstrHostIFmsg->drvHandler,
+				     &pstrHostIFmsg->uniHostIFmsgBody.strHostIfSetMacAddress);
+		break;
+	}
 
-		/*BugID_5213*/
-		case HOST_IF_MSG_GET_MAC_ADDRESS:
-		{
-			Handle_GetMacAddress(strHostIFmsg.drvHandler,
-					     &strHostIFmsg.uniHostIFmsgBody.strHostIfGetMacAddress);
-			break;
-		}
+	/*BugID_5213*/
+	case HOST_IF_MSG_GET_MAC_ADDRESS:
+	{
+		s32Result = Handle_GetMacAddress(pstrHostIFmsg->drvHandler,
+						 puniResult->au8MacAddress);
+		break;
+	}
 
 #ifdef WILC_P2P
-		case HOST_IF_MSG_REMAIN_ON_CHAN:
-		{
-			PRINT_D(HOSTINF_DBG, "HOST_IF_MSG_REMAIN_ON_CHAN\n");
-			Handle_RemainOnChan(strHostIFmsg.drvHandler,
-					    &strHostIFmsg.uniHostIFmsgBody.strHostIfRemainOnChan);
-			break;
-		}
+	case HOST_IF_MSG_REMAIN_ON_CHAN:
+	{
+		PRINT_D(HOSTINF_DBG, "HOST_IF_MSG_REMAIN_ON_CHAN\n");
+		Handle_RemainOnChan(pstrHostIFmsg->drvHandler,
+				    &pstrHostIFmsg->uniHostIFmsgBody.strHostIfRemainOnChan);
+		break;
+	}
 
-		case HOST_IF_MSG_REGISTER_FRAME:
-		{
-			PRINT_D(HOSTINF_DBG, "HOST_IF_MSG_REGISTER_FRAME\n");
-			Handle_RegisterFrame(strHostIFmsg.drvHandler,
-					     &strHostIFmsg.uniHostIFmsgBody.strHostIfRegisterFrame);
-			break;
-		}
+	case HOST_IF_MSG_REGISTER_FRAME:
+	{
+		PRINT_D(HOSTINF_DBG, "HOST_IF_MSG_REGISTER_FRAME\n");
+		Handle_RegisterFrame(pstrHostIFmsg->drvHandler,
+				     &pstrHostIFmsg->uniHostIFmsgBody.strHostIfRegisterFrame);
+		break;
+	}
 
-		case HOST_IF_MSG_LISTEN_TIMER_FIRED:
-		{
-			Handle_ListenStateExpired(strHostIFmsg.drvHandler,
-						  &strHostIFmsg.uniHostIFmsgBody.strHostIfRemainOnChan);
-			break;
-		}
+	case HOST_IF_MSG_LISTEN_TIMER_FIRED:
+	{
+		Handle_ListenStateExpired(pstrHostIFmsg->drvHandler,
+					  &pstrHostIFmsg->uniHostIFmsgBody.strHostIfRemainOnChan);
+		break;
+	}
 
 #endif /* WILC_P2P */
-		case HOST_IF_MSG_SET_MULTICAST_FILTER:
-		{
-			PRINT_D(HOSTINF_DBG, "HOST_IF_MSG_SET_MULTICAST_FILTER\n");
-			Handle_SetMulticastFilter(strHostIFmsg.drvHandler,
-						  &strHostIFmsg.uniHostIFmsgBody.strHostIfSetMulti);
-			break;
-		}
+	case HOST_IF_MSG_SET_MULTICAST_FILTER:
+	{
+		PRINT_D(HOSTINF_DBG, "HOST_IF_MSG_SET_MULTICAST_FILTER\n");
+		Handle_SetMulticastFilter(pstrHostIFmsg->drvHandler,
+					  &pstrHostIFmsg->uniHostIFmsgBody.strHostIfSetMulti);
+		break;
+	}
 
-		/*BugID_5222*/
-		case HOST_IF_MSG_ADD_BA_SESSION:
-		{
-			Handle_AddBASession(strHostIFmsg.drvHandler,
-					    &strHostIFmsg.uniHostIFmsgBody.strHostIfBASessionInfo);
-			break;
-		}
+	/*BugID_5222*/
+	case HOST_IF_MSG_ADD_BA_SESSION:
+	{
+		Handle_AddBASession(pstrHostIFmsg->drvHandler,
+				    &pstrHostIFmsg->uniHostIFmsgBody.strHostIfBASessionInfo);
+		break;
+	}
 
-		case HOST_IF_MSG_DEL_ALL_STA:
-		{
-			Handle_DelAllSta(strHostIFmsg.drvHandler,
-					 &strHostIFmsg.uniHostIFmsgBody.strHostIFDelAllSta);
-			break;
-		}
+	case HOST_IF_MSG_DEL_ALL_STA:
+	{
+		Handle_DelAllSta(pstrHostIFmsg->drvHandler,
+				 &pstrHostIFmsg->uniHostIFmsgBody.strHostIFDelAllSta);
+		break;
+	}
 
-		case HOST_IF_MSG_SEND_BUFFERED_EAP:
-		{
-			Handle_SendBufferedEAP(strHostIFmsg.drvHandler,
-					       &strHostIFmsg.uniHostIFmsgBody.strHostIFSendBufferedEAP);
-			break;
+	case HOST_IF_MSG_DEL_BA_SESSION:
+	{
+		s32Result = Handle_DelBASession(pstrHostIFmsg->drvHandler,
+						&pstrHostIFmsg->uniHostIFmsgBody.strHostIfBASessionInfo);
+		break;
+	}
+
+	case HOST_IF_MSG_SEND_BUFFERED_EAP:
+	{
+		Handle_SendBufferedEAP(pstrHostIFmsg->drvHandler,
+				       &pstrHostIFmsg->uniHostIFmsgBody.strHostIFSendBufferedEAP);
+		break;
+	}
+	case HOST_IF_MSG_SET_TX_POWER:
+	{
+		Handle_SetTxPwr(pstrHostIFmsg->drvHandler,pstrHostIFmsg->uniHostIFmsgBody.strHostIFTxPwr.u8TxPwr);
+		break;
+	}
+
+	case HOST_IF_MSG_GET_TX_POWER:
+	{
+		s32Result = Handle_GetTxPwr(pstrHostIFmsg->drvHandler, &puniResult->u8TxPwr);
+		break;
+	}
+
+	default:
+	{
+		PRINT_ER("[Host Interface] undefined Received Msg ID\n");
+		s32Result = ATL_FAIL;
+		break;
+	}
+	}
+
+	host_if_wait_done(pstrWait, s32Result);
+}
+
+/*
+ * Messages that cannot run yet are parked here, one FIFO per condition,
+ * and replayed in order by the host interface thread once the condition
+ * clears instead of being requeued behind unrelated messages. The thread
+ * retries after every message it handles; code clearing a condition from
+ * any other context must call host_if_defer_kick().
+ */
+enum tenuHostIFDeferCond {
+	HOST_IF_DEFER_INIT	= 0,	/* driver not initialized */
+	HOST_IF_DEFER_SCAN,		/* connect while a scan is pending */
+	HOST_IF_DEFER_MAX
+};
+
+struct tstrHostIFDeferred {
+	struct list_head list;
+	struct tstrHostIFmsg strHostIFmsg;
+};
+
+static struct list_head gastrHostIFDeferred[HOST_IF_DEFER_MAX] = {
+	LIST_HEAD_INIT(gastrHostIFDeferred[HOST_IF_DEFER_INIT]),
+	LIST_HEAD_INIT(gastrHostIFDeferred[HOST_IF_DEFER_SCAN]),
+};
+
+static bool host_if_defer_cond(enum tenuHostIFDeferCond enuCond,
+			       struct tstrHostIFmsg *pstrHostIFmsg)
+{
+	struct WILC_WFIDrv *pstrWFIDrv = (struct WILC_WFIDrv *)pstrHostIFmsg->drvHandler;
+
+	switch (enuCond) {
+	case HOST_IF_DEFER_INIT:
+		return !g_wilc_initialized;
+	case HOST_IF_DEFER_SCAN:
+		return pstrHostIFmsg->u16MsgId == HOST_IF_MSG_CONNECT &&
+		       pstrWFIDrv != NULL &&
+		       pstrWFIDrv->strWILC_UsrScanReq.pfUserScanResult != NULL;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Returns true if the message was parked on one of the conditions from
+ * enuFirst on. Anything arriving while messages wait for init waits too.
+ */
+static bool host_if_defer(struct tstrHostIFmsg *pstrHostIFmsg,
+			  enum tenuHostIFDeferCond enuFirst)
+{
+	struct tstrHostIFDeferred *pstrDeferred;
+	int i;
+
+	for (i = enuFirst; i < HOST_IF_DEFER_MAX; i++) {
+		if (!host_if_defer_cond(i, pstrHostIFmsg) &&
+		    (i != HOST_IF_DEFER_INIT || list_empty(&gastrHostIFDeferred[i])))
+			continue;
+
+		pstrDeferred = kmalloc(sizeof(*pstrDeferred), GFP_KERNEL);
+		if (pstrDeferred == NULL) {
+			/* fall back to requeueing at the back of the queue */
+			PRINT_ER("Failed to defer host interface msg %d\n",
+				 pstrHostIFmsg->u16MsgId);
+			msleep(20);
+			if (ATL_MsgQueueSend(&gMsgQHostIF, pstrHostIFmsg,
+					     sizeof(struct tstrHostIFmsg)))
+				host_if_wait_done(pstrHostIFmsg->pstrWait, ATL_FAIL);
+			return true;
 		}
-		case HOST_IF_MSG_SET_TX_POWER:
-		{
-			Handle_SetTxPwr(strHostIFmsg.drvHandler,strHostIFmsg.uniHostIFmsgBody.strHostIFTxPwr.u8TxPwr);
-			break;
+
+		PRINT_D(HOSTINF_DBG, "Deferring msg %d on condition %d\n",
+			pstrHostIFmsg->u16MsgId, i);
+		memcpy(&pstrDeferred->strHostIFmsg, pstrHostIFmsg,
+		       sizeof(struct tstrHostIFmsg));
+		list_add_tail(&pstrDeferred->list, &gastrHostIFDeferred[i]);
+		return true;
+	}
+
+	return false;
+}
+
+static void host_if_defer_release(void)
+{
+	struct tstrHostIFDeferred *pstrDeferred;
+	int i;
+
+	if (!g_wilc_initialized)
+		return;
+
+	for (i = 0; i < HOST_IF_DEFER_MAX; i++) {
+		while (!list_empty(&gastrHostIFDeferred[i])) {
+			pstrDeferred = list_first_entry(&gastrHostIFDeferred[i],
+							struct tstrHostIFDeferred,
+							list);
+			if (host_if_defer_cond(i, &pstrDeferred->strHostIFmsg))
+				break;
+
+			list_del(&pstrDeferred->list);
+			PRINT_D(HOSTINF_DBG, "Releasing deferred msg %d\n",
+				pstrDeferred->strHostIFmsg.u16MsgId);
+			/* it may still have to wait on a later condition */
+			if (!host_if_defer(&pstrDeferred->strHostIFmsg, i + 1))
+				host_if_dispatch(&pstrDeferred->strHostIFmsg);
+			kfree(pstrDeferred);
 		}
+	}
+}
 
-		case HOST_IF_MSG_GET_TX_POWER:
-		{
-			Handle_GetTxPwr(strHostIFmsg.drvHandler,&strHostIFmsg.uniHostIFmsgBody.strHostIFTxPwr.u8TxPwr);
-			break;
+/* wake the host interface thread to replay parked messages */
+static void host_if_defer_kick(void)
+{
+	struct tstrHostIFmsg strHostIFmsg;
+
+	memset(&strHostIFmsg, 0, sizeof(struct tstrHostIFmsg));
+	strHostIFmsg.u16MsgId = HOST_IF_MSG_DEFER_KICK;
+
+	if (ATL_MsgQueueSend(&gMsgQHostIF, &strHostIFmsg,
+			     sizeof(struct tstrHostIFmsg)))
+		PRINT_ER("Failed to kick deferred host interface msgs\n");
+}
+
+static void host_if_defer_flush(void)
+{
+	struct tstrHostIFDeferred *pstrDeferred, *pstrTmp;
+	int i;
+
+	for (i = 0; i < HOST_IF_DEFER_MAX; i++) {
+		list_for_each_entry_safe(pstrDeferred, pstrTmp,
+					 &gastrHostIFDeferred[i], list) {
+			PRINT_WRN(HOSTINF_DBG, "Dropping deferred msg %d\n",
+				  pstrDeferred->strHostIFmsg.u16MsgId);
+			list_del(&pstrDeferred->list);
+			if (pstrDeferred->strHostIFmsg.u16MsgId == HOST_IF_MSG_CONNECT)
+				host_if_free_connect_attr(&pstrDeferred->strHostIFmsg.uniHostIFmsgBody.strHostIFconnectAttr);
+			host_if_wait_done(pstrDeferred->strHostIFmsg.pstrWait, ATL_FAIL);
+			kfree(pstrDeferred);
 		}
+	}
+}
 
-		default:
-		{
-			PRINT_ER("[Host Interface] undefined Received Msg ID\n");
+/*
+ * Main thread to handle message queue requests
+ */
+static int hostIFthread(void *pvArg)
+{
+	unsigned int u32Ret;
+	struct tstrHostIFmsg strHostIFmsg;
+
+	memset(&strHostIFmsg, 0, sizeof(struct tstrHostIFmsg));
+
+	while (1) {
+		ATL_MsgQueueRecv(&gMsgQHostIF, &strHostIFmsg,
+				 sizeof(struct tstrHostIFmsg), &u32Ret);
+		if (strHostIFmsg.u16MsgId == HOST_IF_MSG_EXIT) {
+			PRINT_D(GENERIC_DBG, "THREAD: Exiting HostIfThread\n");
 			break;
 		}
-		}
+
+		if (strHostIFmsg.u16MsgId != HOST_IF_MSG_DEFER_KICK &&
+		    !host_if_defer(&strHostIFmsg, HOST_IF_DEFER_INIT))
+			host_if_dispatch(&strHostIFmsg);
+
+		host_if_defer_release();
 	}
 
+	host_if_defer_flush();
+
 	PRINT_D(HOSTINF_DBG, "Releasing thread exit semaphore\n");
 	up(&hSemHostIFthrdEnd);
 
@@ -5249,20 +5724,24 @@ signed int host_int_get_MacAddress(struct WFIDrvHandle *hWFIDrv,
 {
 	signed int s32Error = ATL_SUCCESS;
 	struct tstrHostIFmsg strHostIFmsg;
+	struct tstrHostIFWait *pstrWait;
+
+	pstrWait = host_if_wait_alloc();
+	if (pstrWait == NULL)
+		return ATL_NO_MEM;
 
 	memset(&strHostIFmsg, 0, sizeof(struct tstrHostIFmsg));
 
 	strHostIFmsg.u16MsgId = HOST_IF_MSG_GET_MAC_ADDRESS;
-	strHostIFmsg.uniHostIFmsgBody.strHostIfGetMacAddress.u8MacAddress = pu8MacAddress;
 	strHostIFmsg.drvHandler = hWFIDrv;
 
-	s32Error = ATL_MsgQueueSend(&gMsgQHostIF, &strHostIFmsg, sizeof(struct tstrHostIFmsg));
-	if (s32Error) {
-		PRINT_ER("Failed to send get mac address\n");
-		return ATL_FAIL;
-	}
+	s32Error = host_if_send_wait(&strHostIFmsg, pstrWait);
+	if (s32Error)
+		PRINT_ER("Failed to get mac address\n");
+	else
+		memcpy(pu8MacAddress, pstrWait->uniResult.au8MacAddress, ETH_ALEN);
 
-	down(&hWaitResponse);
+	host_if_wait_put(pstrWait);
 	return s32Error;
 }
 
@@ -5422,7 +5901,8 @@ signed int host_int_get_start_scan_req(struct WFIDrvHandle *hWFIDrv,
 }
 
 /*
- * sets a join request
+ * sets a join request. pJoinParams must be a copy owned by the caller;
+ * the CONNECT message takes it over and Handle_Connect() frees it.
  */
 signed int host_int_set_join_req(struct WFIDrvHandle *hWFIDrv, u8 *pu8bssid,
 				 u8 *pu8ssid, size_t ssidLen,
@@ -5437,6 +5917,10 @@ signed int host_int_set_join_req(struct WFIDrvHandle *hWFIDrv, u8 *pu8bssid,
 	struct tstrHostIFmsg strHostIFmsg;
 	enum tenuScanConnTimer enuScanConnTimer;
 
+	/* prepare the Connect Message; it owns pJoinParams from here on */
+	memset(&strHostIFmsg, 0, sizeof(struct tstrHostIFmsg));
+	strHostIFmsg.uniHostIFmsgBody.strHostIFconnectAttr.pJoinParams = pJoinParams;
+
 	if (pstrWFIDrv == NULL || pfConnectResult == NULL)
 		ATL_ERRORREPORT(s32Error, ATL_INVALID_ARGUMENT);
 
@@ -5450,9 +5934,6 @@ signed int host_int_set_join_req(struct WFIDrvHandle *hWFIDrv, u8 *pu8bssid,
 		ATL_ERRORREPORT(s32Error, ATL_FAIL);
 	}
 
-	/* prepare the Connect Message */
-	memset(&strHostIFmsg, 0, sizeof(struct tstrHostIFmsg));
-
 	strHostIFmsg.u16MsgId = HOST_IF_MSG_CONNECT;
 
 	strHostIFmsg.uniHostIFmsgBody.strHostIFconnectAttr.u8security = u8security;
@@ -5460,7 +5941,6 @@ signed int host_int_set_join_req(struct WFIDrvHandle *hWFIDrv, u8 *pu8bssid,
 	strHostIFmsg.uniHostIFmsgBody.strHostIFconnectAttr.u8channel = u8channel;
 	strHostIFmsg.uniHostIFmsgBody.strHostIFconnectAttr.pfConnectResult = pfConnectResult;
 	strHostIFmsg.uniHostIFmsgBody.strHostIFconnectAttr.pvUserArg = pvUserArg;
-	strHostIFmsg.uniHostIFmsgBody.strHostIFconnectAttr.pJoinParams = pJoinParams;
 	strHostIFmsg.drvHandler = hWFIDrv;
 
 	if (pu8bssid != NULL) {
@@ -5499,6 +5979,7 @@ signed int host_int_set_join_req(struct WFIDrvHandle *hWFIDrv, u8 *pu8bssid,
 	mod_timer(&(pstrWFIDrv->hConnectTimer), (jiffies + msecs_to_jiffies(HOST_IF_CONNECT_TIMEOUT)));
 
 	ATL_CATCH(s32Error){
+		host_if_free_connect_attr(&strHostIFmsg.uniHostIFmsgBody.strHostIFconnectAttr);
 	}
 
 	return s32Error;
@@ -5523,6 +6004,7 @@ signed int host_int_flush_join_req(struct WFIDrvHandle *hWFIDrv)
 	if (hWFIDrv  == NULL)
 		ATL_ERRORREPORT(s32Error, ATL_INVALID_ARGUMENT);
 
+	memset(&strHostIFmsg, 0, sizeof(struct tstrHostIFmsg));
 
 	strHostIFmsg.u16MsgId = HOST_IF_MSG_FLUSH_CONNECT;
 	strHostIFmsg.drvHandler = hWFIDrv;
@@ -5763,22 +6245,21 @@ signed int host_int_change_bt_coex_mode(struct WFIDrvHandle *hWFIDrv,
 signed int host_int_wait_msg_queue_idle(void)
 {
 	signed int s32Error = ATL_SUCCESS;
-
 	struct tstrHostIFmsg strHostIFmsg;
+	struct tstrHostIFWait *pstrWait;
+
+	pstrWait = host_if_wait_alloc();
+	if (pstrWait == NULL)
+		return ATL_NO_MEM;
 
 	/* prepare the set driver handler message */
 	memset(&strHostIFmsg, 0, sizeof(struct tstrHostIFmsg));
 	strHostIFmsg.u16MsgId = HOST_IF_MSG_Q_IDLE;
-	s32Error = ATL_MsgQueueSend(&gMsgQHostIF, &strHostIFmsg,
-				    sizeof(struct tstrHostIFmsg));
-	if (s32Error)
-		ATL_ERRORREPORT(s32Error, s32Error);
 
-	ATL_CATCH(s32Error){
-	}
 	/* wait untill MSG Q is empty*/
-	down(&hWaitResponse);
+	s32Error = host_if_send_wait(&strHostIFmsg, pstrWait);
 
+	host_if_wait_put(pstrWait);
 	return s32Error;
 }
 
@@ -5844,25 +6325,36 @@ signed int host_int_get_host_chnl_num(struct WFIDrvHandle *hWFIDrv, u8 *pu8ChNo)
 	signed int s32Error = ATL_SUCCESS;
 	struct WILC_WFIDrv *pstrWFIDrv = (struct WILC_WFIDrv *)hWFIDrv;
 	struct tstrHostIFmsg strHostIFmsg;
+	struct tstrHostIFWait *pstrWait;
+	unsigned int u32Val;
 
 	if (pstrWFIDrv == NULL) {
 		PRINT_ER("Driver not initialized: pstrWFIDrv = NULL\n");
 		ATL_ERRORREPORT(s32Error, ATL_INVALID_ARGUMENT);
 	}
 
+	if (wid_cache_fetch(pstrWFIDrv, WID_CACHE_CHNL, 1, &u32Val)) {
+		*pu8ChNo = u32Val;
+		return ATL_SUCCESS;
+	}
+
 	/* prepare the Get Channel Message */
 	memset(&strHostIFmsg, 0, sizeof(struct tstrHostIFmsg));
 
 	strHostIFmsg.u16MsgId = HOST_IF_MSG_GET_CHNL;
 	strHostIFmsg.drvHandler = hWFIDrv;
 
-	s32Error = ATL_MsgQueueSend(&gMsgQHostIF, &strHostIFmsg,
-				    sizeof(struct tstrHostIFmsg));
+	pstrWait = host_if_wait_alloc();
+	if (pstrWait == NULL)
+		ATL_ERRORREPORT(s32Error, ATL_NO_MEM);
+
+	s32Error = host_if_send_wait(&strHostIFmsg, pstrWait);
 	if (s32Error)
-		PRINT_ER("Failed to send get host channel param's message queue\n");
-	down(&(pstrWFIDrv->hSemGetCHNL));
+		PRINT_ER("Failed to get host channel\n");
+	else
+		*pu8ChNo = pstrWait->uniResult.u8Chnl;
 
-	*pu8ChNo = gu8Chnl;
+	host_if_wait_put(pstrWait);
 
 	ATL_CATCH(s32Error){
 	}
@@ -5924,6 +6416,7 @@ signed int host_int_get_inactive_time(struct WFIDrvHandle *hWFIDrv, u8 *mac,
 	signed int s32Error = ATL_SUCCESS;
 	struct WILC_WFIDrv *pstrWFIDrv = (struct WILC_WFIDrv *)hWFIDrv;
 	struct tstrHostIFmsg strHostIFmsg;
+	struct tstrHostIFWait *pstrWait;
 
 	if (pstrWFIDrv == NULL) {
 		PRINT_ER("Driver not initialized: pstrWFIDrv = NULL\n");
@@ -5938,14 +6431,17 @@ signed int host_int_get_inactive_time(struct WFIDrvHandle *hWFIDrv, u8 *mac,
 	strHostIFmsg.u16MsgId = HOST_IF_MSG_GET_INACTIVETIME;
 	strHostIFmsg.drvHandler = hWFIDrv;
 
-	s32Error = ATL_MsgQueueSend(&gMsgQHostIF, &strHostIFmsg,
-				    sizeof(struct tstrHostIFmsg));
-	if (s32Error)
-		PRINT_ER("Failed to send get host channel param's message queue");
+	pstrWait = host_if_wait_alloc();
+	if (pstrWait == NULL)
+		ATL_ERRORREPORT(s32Error, ATL_NO_MEM);
 
-	down(&(pstrWFIDrv->hSemInactiveTime));
+	s32Error = host_if_send_wait(&strHostIFmsg, pstrWait);
+	if (s32Error)
+		PRINT_ER("Failed to get inactive time\n");
+	else
+		*pu32InactiveTime = pstrWait->uniResult.u32InactiveTime;
 
-	*pu32InactiveTime = gu32InactiveTime;
+	host_if_wait_put(pstrWait);
 
 	ATL_CATCH(s32Error){
 	}
@@ -6007,6 +6503,19 @@ signed int host_int_get_rssi(struct WFIDrvHandle *hWFIDrv, s8 *ps8Rssi)
 	signed int s32Error = ATL_SUCCESS;
 	struct tstrHostIFmsg strHostIFmsg;
 	struct WILC_WFIDrv *pstrWFIDrv = (struct WILC_WFIDrv *)hWFIDrv;
+	struct tstrHostIFWait *pstrWait;
+	unsigned int u32Val;
+
+	if (pstrWFIDrv == NULL) {
+		PRINT_ER("Driver not initialized: pstrWFIDrv = NULL\n");
+		return ATL_INVALID_ARGUMENT;
+	}
+
+	if (ps8Rssi != NULL &&
+	    wid_cache_fetch(pstrWFIDrv, WID_CACHE_RSSI, 1, &u32Val)) {
+		*ps8Rssi = (s8)u32Val;
+		return ATL_SUCCESS;
+	}
 
 	/* prepare the Get RSSI Message */
 	memset(&strHostIFmsg, 0, sizeof(struct tstrHostIFmsg));
@@ -6014,22 +6523,22 @@ signed int host_int_get_rssi(struct WFIDrvHandle *hWFIDrv, s8 *ps8Rssi)
 	strHostIFmsg.u16MsgId = HOST_IF_MSG_GET_RSSI;
 	strHostIFmsg.drvHandler = hWFIDrv;
 
-	s32Error = ATL_MsgQueueSend(&gMsgQHostIF, &strHostIFmsg,
-				    sizeof(struct tstrHostIFmsg));
-	if (s32Error) {
-		PRINT_ER("Failed to send get host channel param's message queue\n");
-		return ATL_FAIL;
-	}
-
-	down(&(pstrWFIDrv->hSemGetRSSI));
-
 	if (ps8Rssi == NULL) {
 		PRINT_ER("RSS pointer value is null");
 		return ATL_FAIL;
 	}
 
-	*ps8Rssi = gs8Rssi;
+	pstrWait = host_if_wait_alloc();
+	if (pstrWait == NULL)
+		return ATL_NO_MEM;
+
+	s32Error = host_if_send_wait(&strHostIFmsg, pstrWait);
+	if (s32Error)
+		PRINT_ER("Failed to get RSSI\n");
+	else
+		*ps8Rssi = pstrWait->uniResult.s8Rssi;
 
+	host_if_wait_put(pstrWait);
 	return s32Error;
 }
 
@@ -6039,6 +6548,19 @@ signed int host_int_get_link_speed(struct WFIDrvHandle *hWFIDrv, s8 *ps8lnkspd)
 	signed int s32Error = ATL_SUCCESS;
 
 	struct WILC_WFIDrv *pstrWFIDrv = (struct WILC_WFIDrv *)hWFIDrv;
+	struct tstrHostIFWait *pstrWait;
+	unsigned int u32Val;
+
+	if (pstrWFIDrv == NULL) {
+		PRINT_ER("Driver not initialized: pstrWFIDrv = NULL\n");
+		return ATL_INVALID_ARGUMENT;
+	}
+
+	if (ps8lnkspd != NULL &&
+	    wid_cache_fetch(pstrWFIDrv, WID_CACHE_LINKSPEED, 1, &u32Val)) {
+		*ps8lnkspd = (s8)u32Val;
+		return ATL_SUCCESS;
+	}
 
 	/* prepare the Get LINKSPEED Message */
 	memset(&strHostIFmsg, 0, sizeof(struct tstrHostIFmsg));
@@ -6046,22 +6568,22 @@ signed int host_int_get_link_speed(struct WFIDrvHandle *hWFIDrv, s8 *ps8lnkspd)
 	strHostIFmsg.u16MsgId = HOST_IF_MSG_GET_LINKSPEED;
 	strHostIFmsg.drvHandler = hWFIDrv;
 
-	s32Error = ATL_MsgQueueSend(&gMsgQHostIF, &strHostIFmsg,
-				    sizeof(struct tstrHostIFmsg));
-	if (s32Error) {
-		PRINT_ER("Failed to send GET_LINKSPEED to message queue ");
-		return ATL_FAIL;
-	}
-
-	down(&(pstrWFIDrv->hSemGetLINKSPEED));
-
 	if (ps8lnkspd == NULL) {
 		PRINT_ER("LINKSPEED pointer value is null");
 		return ATL_FAIL;
 	}
 
-	*ps8lnkspd = gs8lnkspd;
+	pstrWait = host_if_wait_alloc();
+	if (pstrWait == NULL)
+		return ATL_NO_MEM;
+
+	s32Error = host_if_send_wait(&strHostIFmsg, pstrWait);
+	if (s32Error)
+		PRINT_ER("Failed to get LINKSPEED\n");
+	else
+		*ps8lnkspd = pstrWait->uniResult.s8LinkSpeed;
 
+	host_if_wait_put(pstrWait);
 	return s32Error;
 }
 
@@ -6070,22 +6592,38 @@ signed int host_int_get_statistics(struct WFIDrvHandle *hWFIDrv,
 {
 	signed int s32Error = ATL_SUCCESS;
 	struct tstrHostIFmsg strHostIFmsg;
+	struct WILC_WFIDrv *pstrWFIDrv = (struct WILC_WFIDrv *)hWFIDrv;
+	struct tstrHostIFWait *pstrWait;
+	unsigned int au32Val[WID_CACHE_TX_FAIL_COUNT + 1];
+
+	if (pstrWFIDrv != NULL &&
+	    wid_cache_fetch(pstrWFIDrv, WID_CACHE_LINKSPEED, ARRAY_SIZE(au32Val), au32Val)) {
+		pstrStatistics->u8LinkSpeed = au32Val[WID_CACHE_LINKSPEED];
+		pstrStatistics->s8RSSI = (s8)au32Val[WID_CACHE_RSSI];
+		pstrStatistics->u32TxCount = au32Val[WID_CACHE_TX_COUNT];
+		pstrStatistics->u32RxCount = au32Val[WID_CACHE_RX_COUNT];
+		pstrStatistics->u32TxFailureCount = au32Val[WID_CACHE_TX_FAIL_COUNT];
+		return ATL_SUCCESS;
+	}
 
 	/* prepare the Get RSSI Message */
 	memset(&strHostIFmsg, 0, sizeof(struct tstrHostIFmsg));
 
 	strHostIFmsg.u16MsgId = HOST_IF_MSG_GET_STATISTICS;
-	strHostIFmsg.uniHostIFmsgBody.pUserData = (char *)pstrStatistics;
 	strHostIFmsg.drvHandler = hWFIDrv;
 
-	s32Error = ATL_MsgQueueSend(&gMsgQHostIF, &strHostIFmsg,
-				    sizeof(struct tstrHostIFmsg));
-	if (s32Error) {
-		PRINT_ER("Failed to send get host channel param's message queue\n");
-		return ATL_FAIL;
-	}
+	pstrWait = host_if_wait_alloc();
+	if (pstrWait == NULL)
+		return ATL_NO_MEM;
 
-	down(&hWaitResponse);
+	s32Error = host_if_send_wait(&strHostIFmsg, pstrWait);
+	if (s32Error)
+		PRINT_ER("Failed to get statistics\n");
+	else
+		memcpy(pstrStatistics, &pstrWait->uniResult.strStatistics,
+		       sizeof(struct tstrStatistics));
+
+	host_if_wait_put(pstrWait);
 	return s32Error;
 }
 
@@ -6337,10 +6875,10 @@ void GetPeriodicRSSI(unsigned long function_context)
 		signed int s32Error = ATL_SUCCESS;
 		struct tstrHostIFmsg strHostIFmsg;
 
-		/* prepare the Get RSSI Message */
+		/* refresh the statistics held in the WID cache */
 		memset(&strHostIFmsg, 0, sizeof(struct tstrHostIFmsg));
 
-		strHostIFmsg.u16MsgId = HOST_IF_MSG_GET_RSSI;
+		strHostIFmsg.u16MsgId = HOST_IF_MSG_GET_STATISTICS;
 		strHostIFmsg.drvHandler = pstrWFIDrv;
 
 		s32Error = ATL_MsgQueueSend(&gMsgQHostIF, &strHostIFmsg,
@@ -6351,7 +6889,28 @@ void GetPeriodicRSSI(unsigned long function_context)
 		}
 	}
 	g_hPeriodicRSSI.data = (unsigned long)pstrWFIDrv;
-	mod_timer(&(g_hPeriodicRSSI), (jiffies + msecs_to_jiffies(5000)));
+	mod_timer(&(g_hPeriodicRSSI),
+		  jiffies + msecs_to_jiffies(pstrWFIDrv->pfRssiSample ?
+					     RSSI_MONITOR_PERIOD_MS : WID_CACHE_REFRESH_MS));
+}
+
+/*
+ * Register (or with a NULL pfRssiSample, remove) a callback fed with every
+ * background statistics refresh while connected. Polling speeds up to
+ * RSSI_MONITOR_PERIOD_MS while one is registered.
+ */
+void host_int_set_rssi_monitor(struct WFIDrvHandle *hWFIDrv,
+			       tWILCpfRssiSample pfRssiSample, void *pvUserArg)
+{
+	struct WILC_WFIDrv *pstrWFIDrv = (struct WILC_WFIDrv *)hWFIDrv;
+
+	if (pstrWFIDrv == NULL) {
+		PRINT_ER("Driver handler is NULL\n");
+		return;
+	}
+
+	pstrWFIDrv->pvRssiUserArg = pvUserArg;
+	pstrWFIDrv->pfRssiSample = pfRssiSample;
 }
 
 /*
@@ -6396,19 +6955,21 @@ signed int host_int_init(struct WFIDrvHandle **phWFIDrv)
 		sema_init(&hSemHostIntDeinit, 1);
 	}
 
-	sema_init(&hWaitResponse, 0);
 	sema_init(&(pstrWFIDrv->hSemTestKeyBlock), 0);
 	sema_init(&(pstrWFIDrv->hSemTestDisconnectBlock), 0);
-	sema_init(&(pstrWFIDrv->hSemGetRSSI), 0);
-	sema_init(&(pstrWFIDrv->hSemGetLINKSPEED), 0);
-	sema_init(&(pstrWFIDrv->hSemGetCHNL), 0);
-	sema_init(&(pstrWFIDrv->hSemInactiveTime), 0);
 	sema_init(&(pstrWFIDrv->gtOsCfgValuesSem), 1);
+	spin_lock_init(&pstrWFIDrv->strWidCacheLock);
 
 	PRINT_D(HOSTINF_DBG, "INIT: CLIENT COUNT %d\n", clients_count);
 
 	if (clients_count == 0)	{
-		ATL_MsgQueueCreate(&gMsgQHostIF);
+		s32Error = ATL_MsgQueueCreate(&gMsgQHostIF,
+					      sizeof(struct tstrHostIFmsg),
+					      host_if_msg_prio);
+		if (s32Error) {
+			PRINT_ER("Failed to create host interface message queue\n");
+			goto _fail_mq_;
+		}
 		msgQ_created = 1;
 
 		HostIFthreadHandler = kthread_run(hostIFthread, NULL,
@@ -6420,7 +6981,28 @@ signed int host_int_init(struct WFIDrvHandle **phWFIDrv)
 		}
 		setup_timer(&(g_hPeriodicRSSI), GetPeriodicRSSI, 0);
 		g_hPeriodicRSSI.data = (unsigned long)pstrWFIDrv;
-		mod_timer(&(g_hPeriodicRSSI), (jiffies + msecs_to_jiffies(5000)));
+		mod_timer(&(g_hPeriodicRSSI), (jiffies + msecs_to_jiffies(WID_CACHE_REFRESH_MS)));
+
+		host_if_debugfs_dir = debugfs_create_dir("wilc_host_if", NULL);
+		if (!IS_ERR_OR_NULL(host_if_debugfs_dir)) {
+			debugfs_create_u32("wid_cache_ttl_ms", S_IRUSR | S_IWUSR,
+					   host_if_debugfs_dir, &wid_cache_ttl_ms);
+			debugfs_create_u32("wid_cache_hits", S_IRUSR,
+					   host_if_debugfs_dir, &wid_cache_hits);
+			debugfs_create_u32("wid_cache_misses", S_IRUSR,
+					   host_if_debugfs_dir, &wid_cache_misses);
+			debugfs_create_u32("ntwrk_info_frames", S_IRUSR | S_IWUSR,
+					   host_if_debugfs_dir, &ntwrk_info_frames);
+			debugfs_create_u64("ntwrk_info_ns", S_IRUSR | S_IWUSR,
+					   host_if_debugfs_dir, &ntwrk_info_ns);
+#ifdef WILC_PARSE_SCAN_IN_HOST
+			debugfs_create_u32("join_params_pool_misses", S_IRUSR,
+					   host_if_debugfs_dir, &join_params_pool_misses);
+#endif /*WILC_PARSE_SCAN_IN_HOST*/
+			debugfs_create_file("msg_queue", S_IRUSR,
+					    host_if_debugfs_dir, NULL,
+					    &host_if_msgq_stats_fops);
+		}
 	}
 
 	setup_timer(&(pstrWFIDrv->hScanTimer), TimerCB_Scan, 0);
@@ -6475,6 +7057,8 @@ _fail_mem_:
 	del_timer_sync(&(pstrWFIDrv->hConnectTimer));
 	del_timer_sync(&(pstrWFIDrv->hScanTimer));
 	kthread_stop(HostIFthreadHandler);
+	debugfs_remove_recursive(host_if_debugfs_dir);
+	host_if_debugfs_dir = NULL;
 _fail_mq_:
 	ATL_MsgQueueDestroy(&gMsgQHostIF);
 	kfree(pstrWFIDrv);
@@ -6560,6 +7144,9 @@ signed int host_int_deinit(struct WFIDrvHandle *hWFIDrv, char* pcIfName, u8 u8If
 
 		ATL_MsgQueueDestroy(&gMsgQHostIF);
 		msgQ_created = 0;
+
+		debugfs_remove_recursive(host_if_debugfs_dir);
+		host_if_debugfs_dir = NULL;
 	}
 
 	down(&(pstrWFIDrv->gtOsCfgValuesSem));
@@ -6599,13 +7186,17 @@ void NetworkInfoReceived(u8 *pu8Buffer, unsigned int u32Length)
 
 	strHostIFmsg.uniHostIFmsgBody.strRcvdNetworkInfo.u32Length = u32Length;
 	strHostIFmsg.uniHostIFmsgBody.strRcvdNetworkInfo.pu8Buffer = kmalloc(u32Length, GFP_ATOMIC);
+	if (strHostIFmsg.uniHostIFmsgBody.strRcvdNetworkInfo.pu8Buffer == NULL)
+		return;
 	memcpy(strHostIFmsg.uniHostIFmsgBody.strRcvdNetworkInfo.pu8Buffer,
 	       pu8Buffer, u32Length);
 
 	s32Error = ATL_MsgQueueSend(&gMsgQHostIF, &strHostIFmsg,
 				    sizeof(struct tstrHostIFmsg));
-	if (s32Error)
+	if (s32Error) {
 		PRINT_ER("Error in sending network info message queue message parameters: Error(%d)\n", s32Error);
+		kfree(strHostIFmsg.uniHostIFmsgBody.strRcvdNetworkInfo.pu8Buffer);
+	}
 }
 
 /*
@@ -6648,13 +7239,20 @@ void GnrlAsyncInfoReceived(u8 *pu8Buffer, unsigned int u32Length)
 
 	strHostIFmsg.uniHostIFmsgBody.strRcvdGnrlAsyncInfo.u32Length = u32Length;
 	strHostIFmsg.uniHostIFmsgBody.strRcvdGnrlAsyncInfo.pu8Buffer = kmalloc(u32Length, GFP_ATOMIC);
+	if (strHostIFmsg.uniHostIFmsgBody.strRcvdGnrlAsyncInfo.pu8Buffer == NULL) {
+		PRINT_ER("No memory for asynchronous message info\n");
+		up(&hSemHostIntDeinit);
+		return;
+	}
 	memcpy(strHostIFmsg.uniHostIFmsgBody.strRcvdGnrlAsyncInfo.pu8Buffer,
 	       pu8Buffer, u32Length);
 
 	s32Error = ATL_MsgQueueSend(&gMsgQHostIF, &strHostIFmsg,
 				    sizeof(struct tstrHostIFmsg));
-	if (s32Error)
+	if (s32Error) {
 		PRINT_ER("Error in sending message queue asynchronous message info: Error(%d)\n", s32Error);
+		kfree(strHostIFmsg.uniHostIFmsgBody.strRcvdGnrlAsyncInfo.pu8Buffer);
+	}
 
 	/*BugID_5348*/
 	up(&hSemHostIntDeinit);
@@ -6879,6 +7477,7 @@ signed int host_int_del_beacon(struct WFIDrvHandle *hWFIDrv)
 		ATL_ERRORREPORT(s32Error, ATL_INVALID_ARGUMENT);
 
 	/* prepare the WiphyParams Message */
+	memset(&strHostIFmsg, 0, sizeof(struct tstrHostIFmsg));
 	strHostIFmsg.u16MsgId = HOST_IF_MSG_DEL_BEACON;
 	strHostIFmsg.drvHandler = hWFIDrv;
 	PRINT_D(HOSTINF_DBG, "Setting deleting beacon message queue params\n");
@@ -6982,6 +7581,7 @@ signed int host_int_del_allstation(struct WFIDrvHandle *hWFIDrv,
 	struct WILC_WFIDrv *pstrWFIDrv = (struct WILC_WFIDrv *)hWFIDrv;
 	struct tstrHostIFmsg strHostIFmsg;
 	struct tstrHostIFDelAllSta *pstrDelAllStationMsg = &strHostIFmsg.uniHostIFmsgBody.strHostIFDelAllSta;
+	struct tstrHostIFWait *pstrWait;
 	u8 au8Zero_Buff[ETH_ALEN] = {0};
 	unsigned int i;
 	u8 u8AssocNumb = 0;
@@ -7018,18 +7618,17 @@ signed int host_int_del_allstation(struct WFIDrvHandle *hWFIDrv,
 	}
 
 	pstrDelAllStationMsg->u8Num_AssocSta = u8AssocNumb;
-	s32Error = ATL_MsgQueueSend(&gMsgQHostIF, &strHostIFmsg,
-				    sizeof(struct tstrHostIFmsg));
 
-	if (s32Error)
-		ATL_ERRORREPORT(s32Error, s32Error);
+	pstrWait = host_if_wait_alloc();
+	if (pstrWait == NULL)
+		ATL_ERRORREPORT(s32Error, ATL_NO_MEM);
 
+	s32Error = host_if_send_wait(&strHostIFmsg, pstrWait);
+	host_if_wait_put(pstrWait);
 
 	ATL_CATCH(s32Error){
 	}
 
-	down(&hWaitResponse);
-
 	return s32Error;
 }
 
@@ -7088,6 +7687,8 @@ signed int host_int_set_power_mgmt(struct WFIDrvHandle *hWFIDrv,
 	if (pstrWFIDrv == NULL)
 		ATL_ERRORREPORT(s32Error, ATL_INVALID_ARGUMENT);
 
+	wilc_ps_policy_enable(pstrWFIDrv, bIsEnabled);
+
 	PRINT_D(HOSTINF_DBG, "Setting Power management message queue params\n");
 
 	memset(&strHostIFmsg, 0, sizeof(struct tstrHostIFmsg));
@@ -7110,6 +7711,40 @@ signed int host_int_set_power_mgmt(struct WFIDrvHandle *hWFIDrv,
 	return s32Error;
 }
 
+signed int host_int_set_power_mode(struct WFIDrvHandle *hWFIDrv,
+				   s8 s8PowerMode, u8 u8ListenInterval)
+{
+	signed int s32Error = ATL_SUCCESS;
+	struct WILC_WFIDrv *pstrWFIDrv = (struct WILC_WFIDrv *)hWFIDrv;
+	struct tstrHostIFmsg strHostIFmsg;
+	struct tstrHostIfPowerMgmtParam *pstrPowerMgmtParam = &strHostIFmsg.uniHostIFmsgBody.strPowerMgmtparam;
+
+	PRINT_D(HOSTINF_DBG, "Setting PS mode to %d, listen interval %d\n",
+		s8PowerMode, u8ListenInterval);
+
+	if (pstrWFIDrv == NULL)
+		ATL_ERRORREPORT(s32Error, ATL_INVALID_ARGUMENT);
+
+	memset(&strHostIFmsg, 0, sizeof(struct tstrHostIFmsg));
+
+	strHostIFmsg.u16MsgId = HOST_IF_MSG_POWER_MGMT;
+	strHostIFmsg.drvHandler = hWFIDrv;
+
+	pstrPowerMgmtParam->bIsEnabled = (s8PowerMode != NO_POWERSAVE);
+	pstrPowerMgmtParam->s8PowerMode = s8PowerMode;
+	pstrPowerMgmtParam->u8ListenInterval = u8ListenInterval;
+
+	s32Error = ATL_MsgQueueSend(&gMsgQHostIF, &strHostIFmsg,
+				    sizeof(struct tstrHostIFmsg));
+	if (s32Error)
+		ATL_ERRORREPORT(s32Error, s32Error);
+
+	ATL_CATCH(s32Error){
+	}
+
+	return s32Error;
+}
+
 signed int host_int_setup_multicast_filter(struct WFIDrvHandle *hWFIDrv,
 					   bool bIsEnabled,
 					   unsigned int u32count)
@@ -7146,8 +7781,43 @@ signed int host_int_setup_multicast_filter(struct WFIDrvHandle *hWFIDrv,
 }
 
 #ifdef WILC_PARSE_SCAN_IN_HOST
+static struct tstrJoinBssParam *join_params_alloc(void)
+{
+	unsigned long flags;
+	unsigned int u32Slot;
+
+	spin_lock_irqsave(&gsJoinParamsLock, flags);
+	u32Slot = find_first_zero_bit(gaulJoinParamsUsed, JOIN_PARAMS_POOL_SIZE);
+	if (u32Slot < JOIN_PARAMS_POOL_SIZE)
+		__set_bit(u32Slot, gaulJoinParamsUsed);
+	else
+		join_params_pool_misses++;
+	spin_unlock_irqrestore(&gsJoinParamsLock, flags);
+
+	if (u32Slot < JOIN_PARAMS_POOL_SIZE)
+		return &gastrJoinParamsPool[u32Slot];
+	return kmalloc(sizeof(struct tstrJoinBssParam), GFP_ATOMIC);
+}
+
+static void join_params_free(struct tstrJoinBssParam *pstrJoinParams)
+{
+	unsigned long flags;
+
+	if (pstrJoinParams < gastrJoinParamsPool ||
+	    pstrJoinParams >= gastrJoinParamsPool + JOIN_PARAMS_POOL_SIZE) {
+		kfree(pstrJoinParams);
+		return;
+	}
+
+	spin_lock_irqsave(&gsJoinParamsLock, flags);
+	__clear_bit(pstrJoinParams - gastrJoinParamsPool, gaulJoinParamsUsed);
+	spin_unlock_irqrestore(&gsJoinParamsLock, flags);
+}
+
 /*
- * Parse Needed Join Parameters and save it in a new JoinBssParam entry
+ * Parse Needed Join Parameters and save it in a new JoinBssParam entry.
+ * The single walk over the IEs also sets the network's channel and DTIM
+ * period, which ParseNetworkInfo() leaves out.
  */
 static void *host_int_ParseJoinBssParam(struct tstrNetworkInfo *ptstrNetworkInfo)
 {
@@ -7163,14 +7833,15 @@ static void *host_int_ParseJoinBssParam(struct tstrNetworkInfo *ptstrNetworkInfo
 	u8 pcipherTotalCount = 0;
 	u8 authTotalCount = 0;
 	u8 i, j;
+	bool bDsFound = false;
+	bool bTimFound = false;
 
 	pu8IEs = ptstrNetworkInfo->pu8IEs;
 	u16IEsLen = ptstrNetworkInfo->u16IEsLen;
 
-	pNewJoinBssParam = kmalloc(sizeof(struct tstrJoinBssParam), GFP_ATOMIC);
+	pNewJoinBssParam = join_params_alloc();
 	if (pNewJoinBssParam != NULL) {
 		memset(pNewJoinBssParam, 0, sizeof(struct tstrJoinBssParam));
-		pNewJoinBssParam->dtim_period = ptstrNetworkInfo->u8DtimPeriod;
 		pNewJoinBssParam->beacon_period = ptstrNetworkInfo->u16BeaconPeriod;
 		pNewJoinBssParam->cap_info = ptstrNetworkInfo->u16CapInfo;
 		memcpy(pNewJoinBssParam->au8bssid, ptstrNetworkInfo->au8bssid, 6);
@@ -7182,8 +7853,23 @@ static void *host_int_ParseJoinBssParam(struct tstrNetworkInfo *ptstrNetworkInfo
 
 		/*parse supported rates:*/
 		while (index < u16IEsLen) {
+			/*DS Param. and TIM IEs: first of each, if complete*/
+			if (pu8IEs[index] == DS_PARAMS_IE || pu8IEs[index] == TIM_IE) {
+				u8 u8ElmLen = pu8IEs[index + 1];
+
+				if ((index + IE_HDR_LEN + u8ElmLen) > u16IEsLen)
+					break;
+				if (pu8IEs[index] == DS_PARAMS_IE && !bDsFound && u8ElmLen >= 1) {
+					ptstrNetworkInfo->u8channel = pu8IEs[index + 2];
+					bDsFound = true;
+				} else if (pu8IEs[index] == TIM_IE && !bTimFound && u8ElmLen >= 2) {
+					ptstrNetworkInfo->u8DtimPeriod = pu8IEs[index + 3];
+					bTimFound = true;
+				}
+				index += u8ElmLen + IE_HDR_LEN;
+				continue;
 			/*supportedRates IE*/
-			if (pu8IEs[index] == SUPP_RATES_IE) {
+			} else if (pu8IEs[index] == SUPP_RATES_IE) {
 				suppRatesNo = pu8IEs[index + 1];
 				pNewJoinBssParam->supp_rates[0] = suppRatesNo;
 				index += 2;
@@ -7325,6 +8011,9 @@ static void *host_int_ParseJoinBssParam(struct tstrNetworkInfo *ptstrNetworkInfo
 				index += pu8IEs[index + 1] + 2;
 			}
 		}
+		pNewJoinBssParam->dtim_period = ptstrNetworkInfo->u8DtimPeriod;
+	} else {
+		ParseNetworkInfoIEs(ptstrNetworkInfo);
 	}
 
 	return (void *)pNewJoinBssParam;
@@ -7333,10 +8022,30 @@ static void *host_int_ParseJoinBssParam(struct tstrNetworkInfo *ptstrNetworkInfo
 void host_int_freeJoinParams(void *pJoinParams)
 {
 	if ((struct tstrJoinBssParam *)pJoinParams != NULL)
-		kfree((struct tstrJoinBssParam *)pJoinParams);
+		join_params_free((struct tstrJoinBssParam *)pJoinParams);
 	else
 		PRINT_ER("Unable to FREE null pointer\n");
 }
+
+/*
+ * Copy join parameters into pDest, allocating it when NULL. Returns the
+ * copy, or NULL if there is nothing to copy or no memory. Atomic, as it
+ * is called under the scan shadow lock.
+ */
+void *host_int_dupJoinParams(void *pJoinParams, void *pDest)
+{
+	if (pJoinParams == NULL)
+		return NULL;
+
+	if (pDest == NULL) {
+		pDest = join_params_alloc();
+		if (pDest == NULL)
+			return NULL;
+	}
+	memcpy(pDest, pJoinParams, sizeof(struct tstrJoinBssParam));
+
+	return pDest;
+}
 #endif  /*WILC_PARSE_SCAN_IN_HOST*/
 
 /*
@@ -7383,6 +8092,7 @@ signed int host_int_delBASession(struct WFIDrvHandle *hWFIDrv, char *pBSSID,
 	struct WILC_WFIDrv *pstrWFIDrv = (struct WILC_WFIDrv *)hWFIDrv;
 	struct tstrHostIFmsg strHostIFmsg;
 	struct tstrHostIfBASessionInfo *pBASessionInfo = &strHostIFmsg.uniHostIFmsgBody.strHostIfBASessionInfo;
+	struct tstrHostIFWait *pstrWait;
 
 	if (pstrWFIDrv == NULL)
 		ATL_ERRORREPORT(s32Error, ATL_INVALID_ARGUMENT);
@@ -7396,16 +8106,16 @@ signed int host_int_delBASession(struct WFIDrvHandle *hWFIDrv, char *pBSSID,
 	pBASessionInfo->u8Ted = TID;
 	strHostIFmsg.drvHandler = hWFIDrv;
 
-	s32Error = ATL_MsgQueueSend(&gMsgQHostIF, &strHostIFmsg,
-				    sizeof(struct tstrHostIFmsg));
-	if (s32Error)
-		ATL_ERRORREPORT(s32Error, s32Error);
+	pstrWait = host_if_wait_alloc();
+	if (pstrWait == NULL)
+		ATL_ERRORREPORT(s32Error, ATL_NO_MEM);
+
+	s32Error = host_if_send_wait(&strHostIFmsg, pstrWait);
+	host_if_wait_put(pstrWait);
 
 	ATL_CATCH(s32Error){
 	}
 
-	down(&hWaitResponse);
-
 	return s32Error;
 }
 
@@ -7488,6 +8198,7 @@ signed int  host_int_get_tx_power(struct WFIDrvHandle * hWFIDrv, u8 *tx_power)
 {
 	signed int s32Error = ATL_SUCCESS;	
 	struct tstrHostIFmsg strHostIFmsg;
+	struct tstrHostIFWait *pstrWait;
 
 	
 	/* prepare the Get RSSI Message */
@@ -7495,16 +8206,19 @@ signed int  host_int_get_tx_power(struct WFIDrvHandle * hWFIDrv, u8 *tx_power)
 
 	strHostIFmsg.u16MsgId = HOST_IF_MSG_GET_TX_POWER;
 	strHostIFmsg.drvHandler=hWFIDrv;
-	/* send the message */
-	s32Error = 	ATL_MsgQueueSend(&gMsgQHostIF, &strHostIFmsg, sizeof(struct tstrHostIFmsg));
-	if(s32Error){
-		PRINT_ER("Failed to send get host channel param's message queue ");
-		return ATL_FAIL;
-		}
 
-	down(&hWaitResponse);	
+	pstrWait = host_if_wait_alloc();
+	if (pstrWait == NULL)
+		return ATL_NO_MEM;
+
+	/* send the message */
+	s32Error = host_if_send_wait(&strHostIFmsg, pstrWait);
+	if (s32Error)
+		PRINT_ER("Failed to get tx power\n");
+	else
+		*tx_power = pstrWait->uniResult.u8TxPwr;
 
-	*tx_power = strHostIFmsg.uniHostIFmsgBody.strHostIFTxPwr.u8TxPwr;
+	host_if_wait_put(pstrWait);
 	return s32Error;
 }
 
@@ -24,6 +24,7 @@
 #include <linux/sched.h>
 #include <linux/delay.h>
 #include <linux/workqueue.h>
+#include <linux/ktime.h>
 #include <linux/interrupt.h>
 #include <linux/irq.h>
 #include <linux/gpio.h>
@@ -297,6 +298,9 @@ static int DebuggingThreadTask(void *vp)
 						gbScanWhileConnected = false;
 					}
 					gbCrashRecover = 0;
+
+					/* Rejoin the station link the restart dropped */
+					WILC_WFI_fast_reconn_recover(g_linux_wlan->strInterfaceInfo[0].wilc_netdev);
 				}
 			}
 		} else {
@@ -399,6 +403,164 @@ static int dev_state_ev_handler(struct notifier_block *this, unsigned long event
 }
 #endif /* DISABLE_PWRSAVE_AND_SCAN_DURING_IP */
 
+/*
+ * Power save policy engine. While power save is enabled through
+ * host_int_set_power_mgmt(), the traffic is sampled every
+ * PS_POLICY_PERIOD_MS and the firmware power mode follows it:
+ * busy   - no power save, for bursts or a deep TX queue
+ * active - MIN_FAST_PS, wake up on every DTIM
+ * idle   - MAX_FAST_PS, wake up every PS_POLICY_IDLE_LISTEN_INTERVAL beacons
+ * Going to a busier level happens at the next sample. Going down needs
+ * the link to stay quiet for a number of samples, and at least
+ * PS_POLICY_HOLD_MS since the previous change.
+ */
+#define PS_POLICY_PERIOD_MS		200
+#define PS_POLICY_HOLD_MS		1000
+#define PS_POLICY_BUSY_PPS		200
+#define PS_POLICY_IDLE_PPS		10
+#define PS_POLICY_BUSY_QDEPTH		(FLOW_CONTROL_UPPER_THRESHOLD / 4)
+#define PS_POLICY_BUSY_QUIET_TICKS	5
+#define PS_POLICY_IDLE_QUIET_TICKS	25
+#define PS_POLICY_IDLE_LISTEN_INTERVAL	3
+
+enum ps_policy_level {
+	PS_POLICY_IDLE		= 0,
+	PS_POLICY_ACTIVE	= 1,
+	PS_POLICY_BUSY		= 2,
+};
+
+struct wilc_ps_policy {
+	struct WILC_WFIDrv *drv;
+	bool enabled;
+	enum ps_policy_level level;
+	atomic_t pkts;
+	atomic_t max_qdepth;
+	unsigned int quiet_ticks;
+	unsigned long last_change;
+};
+
+static struct wilc_ps_policy g_ps_policy;
+
+static void wilc_ps_policy_work_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(ps_policy_work, wilc_ps_policy_work_fn);
+
+static void wilc_ps_policy_count(int qdepth)
+{
+	atomic_inc(&g_ps_policy.pkts);
+	if (qdepth > atomic_read(&g_ps_policy.max_qdepth))
+		atomic_set(&g_ps_policy.max_qdepth, qdepth);
+}
+
+static void wilc_ps_policy_apply(enum ps_policy_level level)
+{
+	struct wilc_ps_policy *pol = &g_ps_policy;
+
+	PRINT_D(GENERIC_DBG, "PS policy level %d -> %d\n", pol->level, level);
+
+	switch (level) {
+	case PS_POLICY_BUSY:
+		host_int_set_power_mode((struct WFIDrvHandle *)pol->drv,
+					NO_POWERSAVE, 0);
+		break;
+	case PS_POLICY_ACTIVE:
+		host_int_set_power_mode((struct WFIDrvHandle *)pol->drv,
+					MIN_FAST_PS, 0);
+		break;
+	case PS_POLICY_IDLE:
+		host_int_set_power_mode((struct WFIDrvHandle *)pol->drv,
+					MAX_FAST_PS,
+					PS_POLICY_IDLE_LISTEN_INTERVAL);
+		break;
+	}
+
+	pol->level = level;
+	pol->quiet_ticks = 0;
+	pol->last_change = jiffies;
+}
+
+static void wilc_ps_policy_work_fn(struct work_struct *work)
+{
+	struct wilc_ps_policy *pol = &g_ps_policy;
+	unsigned int pps;
+	int qdepth;
+	enum ps_policy_level target = pol->level;
+
+	if (!pol->enabled)
+		return;
+
+	pps = atomic_xchg(&pol->pkts, 0) * 1000 / PS_POLICY_PERIOD_MS;
+	qdepth = atomic_xchg(&pol->max_qdepth, 0);
+
+	if ((pps >= PS_POLICY_BUSY_PPS) || (qdepth >= PS_POLICY_BUSY_QDEPTH)) {
+		target = PS_POLICY_BUSY;
+		pol->quiet_ticks = 0;
+	} else {
+		switch (pol->level) {
+		case PS_POLICY_BUSY:
+			if (pps < PS_POLICY_BUSY_PPS / 2)
+				pol->quiet_ticks++;
+			else
+				pol->quiet_ticks = 0;
+			if (pol->quiet_ticks >= PS_POLICY_BUSY_QUIET_TICKS)
+				target = PS_POLICY_ACTIVE;
+			break;
+		case PS_POLICY_ACTIVE:
+			if (pps < PS_POLICY_IDLE_PPS)
+				pol->quiet_ticks++;
+			else
+				pol->quiet_ticks = 0;
+			if (pol->quiet_ticks >= PS_POLICY_IDLE_QUIET_TICKS)
+				target = PS_POLICY_IDLE;
+			break;
+		case PS_POLICY_IDLE:
+			if (pps >= PS_POLICY_IDLE_PPS)
+				target = PS_POLICY_ACTIVE;
+			break;
+		}
+	}
+
+	if ((target > pol->level) ||
+	    ((target < pol->level) &&
+	     time_after_eq(jiffies, pol->last_change +
+			   msecs_to_jiffies(PS_POLICY_HOLD_MS))))
+		wilc_ps_policy_apply(target);
+
+	schedule_delayed_work(&ps_policy_work,
+			      msecs_to_jiffies(PS_POLICY_PERIOD_MS));
+}
+
+/*
+ * Called whenever power save is switched on or off for an interface.
+ * Enabling starts the engine at the active level, which is the mode the
+ * firmware is being set to by the caller.
+ */
+void wilc_ps_policy_enable(struct WILC_WFIDrv *drv, bool enabled)
+{
+	struct wilc_ps_policy *pol = &g_ps_policy;
+
+	if (enabled) {
+		pol->drv = drv;
+		pol->level = PS_POLICY_ACTIVE;
+		pol->quiet_ticks = 0;
+		pol->last_change = jiffies;
+		atomic_set(&pol->pkts, 0);
+		atomic_set(&pol->max_qdepth, 0);
+		pol->enabled = true;
+		schedule_delayed_work(&ps_policy_work,
+				      msecs_to_jiffies(PS_POLICY_PERIOD_MS));
+	} else if (pol->drv == drv) {
+		pol->enabled = false;
+		cancel_delayed_work_sync(&ps_policy_work);
+	}
+}
+
+void wilc_ps_policy_stop(void)
+{
+	g_ps_policy.enabled = false;
+	cancel_delayed_work_sync(&ps_policy_work);
+	g_ps_policy.drv = NULL;
+}
+
 /*
  * Interrupt initialization and handling functions
  */
@@ -831,6 +993,7 @@ int linux_wlan_get_firmware(struct perInterface_wlan *p_nic)
 #ifdef DOWNLOAD_BT_FW
 	const struct firmware *wilc_bt_firmware;
 #endif /* DOWNLOAD_BT_FW */
+	struct device *dev;
 	char *firmware;
 
 	firmware = WIFI_FIRMWARE;
@@ -845,41 +1008,34 @@ int linux_wlan_get_firmware(struct perInterface_wlan *p_nic)
 		goto _fail_;
 	}
 
+#ifdef WILC_SDIO
+	dev = &g_linux_wlan->wilc_sdio_func->dev;
+#else
+	dev = &g_linux_wlan->wilc_spidev->dev;
+#endif /* WILC_SDIO */
+
 	/*	the firmare should be located in /lib/firmware in 
 	 *	root file system with the name specified above
 	 */
-	PRINT_WRN(PWRDEV_DBG, "WLAN firmware: %s\n", firmware);
-#ifdef WILC_SDIO
-	if (request_firmware(&wilc_firmware, firmware,
-			     &g_linux_wlan->wilc_sdio_func->dev) != 0) {
-		PRINT_ER("%s - firmare not available\n", firmware);
-		ret = -1;
-		goto _fail_;
+	if (g_linux_wlan->wilc_firmware == NULL) {
+		PRINT_WRN(PWRDEV_DBG, "WLAN firmware: %s\n", firmware);
+		if (request_firmware(&wilc_firmware, firmware, dev) != 0) {
+			PRINT_ER("%s - firmare not available\n", firmware);
+			ret = -1;
+			goto _fail_;
+		}
+		g_linux_wlan->wilc_firmware = wilc_firmware;
+	} else {
+		PRINT_D(INIT_DBG, "Using cached WLAN firmware\n");
 	}
 #ifdef DOWNLOAD_BT_FW
-	if (request_firmware(&wilc_bt_firmware, BT_FIRMWARE,
-			     &g_linux_wlan->wilc_sdio_func->dev) != 0)
-		PRINT_ER("%s - firmare not available. Skip!\n", BT_FIRMWARE);
-
-#endif /* DOWNLOAD_BT_FW */
-#else
-	if (request_firmware(&wilc_firmware, firmware,
-			     &g_linux_wlan->wilc_spidev->dev) != 0) {
-		PRINT_ER("%s - firmare not available\n", firmware);
-		ret = -1;
-		goto _fail_;
+	if (g_linux_wlan->wilc_bt_firmware == NULL) {
+		PRINT_WRN(PWRDEV_DBG, "Bluetooth firmware: %s\n", BT_FIRMWARE);
+		if (request_firmware(&wilc_bt_firmware, BT_FIRMWARE, dev) != 0)
+			PRINT_ER("%s - firmare not available. Skip!\n", BT_FIRMWARE);
+		else
+			g_linux_wlan->wilc_bt_firmware = wilc_bt_firmware;
 	}
-#ifdef DOWNLOAD_BT_FW
-	PRINT_WRN(PWRDEV_DBG, "Bluetooth firmware: %s\n", BT_FIRMWARE);
-	if (request_firmware(&wilc_bt_firmware, BT_FIRMWARE,
-			     &g_linux_wlan->wilc_spidev->dev) != 0)
-		PRINT_ER("%s - firmare not available. Skip\n", BT_FIRMWARE);
-
-#endif /* DOWNLOAD_BT_FW */
-#endif /* WILC_SDIO */
-	g_linux_wlan->wilc_firmware = wilc_firmware;
-#ifdef DOWNLOAD_BT_FW
-	g_linux_wlan->wilc_bt_firmware = wilc_bt_firmware;
 #endif /* DOWNLOAD_BT_FW */
 
 _fail_:
@@ -979,11 +1135,6 @@ static int linux_bt_firmware_download(void)
 	if (ret < 0)
 		goto _FAIL_;
 
-	/* Freeing FW buffer */
-	PRINT_D(GENERIC_DBG, "Releasing BT firmware\n");
-	release_firmware(g_linux_wlan->wilc_bt_firmware);
-	g_linux_wlan->wilc_bt_firmware = NULL;
-
 	PRINT_D(INIT_DBG, "BT Download Succeeded\n");
 
 _FAIL_:
@@ -992,10 +1143,143 @@ _FAIL_:
 #endif
 
 /* startup configuration - could be changed later using iconfig*/
+/*
+ * Firmware configuration sent at bring-up. The entries are packed into as
+ * few config frames as fit, see wilc_wlan_cfg_set(). Numeric values are
+ * taken from val, strings and raw bytes from str.
+ */
+struct wilc_init_cfg {
+	u16 wid;
+	u8 size;
+	u32 val;
+	const char *str;
+};
+
+static const struct wilc_init_cfg init_cfg_table[] = {
+	/* to tell fw that we are going to use PC test - WILC specific */
+	{WID_PC_TEST_MODE,		1, 0},
+	{WID_BSS_TYPE,			1, INFRASTRUCTURE},
+	{WID_CURRENT_TX_RATE,		1, RATE_AUTO},
+	{WID_11G_OPERATING_MODE,	1, G_MIXED_11B_2_MODE},
+	{WID_CURRENT_CHANNEL,		1, 1},
+	{WID_PREAMBLE,			1, G_SHORT_PREAMBLE},
+	{WID_11N_PROT_MECH,		1, AUTO_PROT},
+#ifdef SWITCH_LOG_TERMINAL
+	{WID_LOGTerminal_Switch,	1, AUTO_PROT},
+#endif /* SWITCH_LOG_TERMINAL */
+	{WID_SCAN_TYPE,			1, ACTIVE_SCAN},
+	{WID_SITE_SURVEY,		1, SITE_SURVEY_OFF},
+	/* Never use RTS-CTS */
+	{WID_RTS_THRESHOLD,		2, 0xffff},
+	{WID_FRAG_THRESHOLD,		2, 2346},
+	{WID_BCAST_SSID,		1, 0},
+	{WID_QOS_ENABLE,		1, 1},
+	{WID_POWER_MANAGEMENT,		1, NO_POWERSAVE},
+	{WID_11I_MODE,			1, NO_ENCRYPT},
+	{WID_AUTH_TYPE,			1, OPEN_SYSTEM},
+	/* WEP40 uses the first 5 bytes, WEP104 the first 13 */
+	{WID_WEP_KEY_VALUE,		26, 0, "123456790abcdef1234567890"},
+	/* WPA/RSNA PSK, 8 to 63 characters */
+	{WID_11I_PSK,			8, 0, "12345678"},
+	/* Radius server secret key, 8 to 64 characters */
+	{WID_1X_KEY,			9, 0, "password"},
+	/* Radius server IP address, 192.168.1.112 */
+	{WID_1X_SERV_ADDR,		4, 0, "\xc0\xa8\x01\x70"},
+	{WID_LISTEN_INTERVAL,		1, 3},
+	{WID_DTIM_PERIOD,		1, 3},
+	{WID_ACK_POLICY,		1, NORMAL_ACK},
+	{WID_USER_CONTROL_ON_TX_POWER,	1, 0},
+	{WID_TX_POWER_LEVEL_11A,	1, 48},
+	{WID_TX_POWER_LEVEL_11B,	1, 28},
+	{WID_BEACON_INTERVAL,		2, 100},
+	{WID_REKEY_POLICY,		1, REKEY_DISABLE},
+	/* Rekey time (s), used only when the rekey policy is 2 or 4 */
+	{WID_REKEY_PERIOD,		4, 84600},
+	/* Rekey group packet count (in 1000s), used when the policy is 3 */
+	{WID_REKEY_PACKET_COUNT,	4, 500},
+	{WID_SHORT_SLOT_ALLOWED,	1, 1},
+	{WID_11N_ERP_PROT_TYPE,		1, G_SELF_CTS_PROT},
+	/* Enable N */
+	{WID_11N_ENABLE,		1, 1},
+	{WID_11N_OPERATING_MODE,	1, HT_MIXED_MODE},
+	/* TXOP Prot disable in N mode: No RTS-CTS on TX A-MPDUs to save air-time. */
+	{WID_11N_TXOP_PROT_DISABLE,	1, 1},
+	/* AP only */
+	{WID_11N_OBSS_NONHT_DETECTION,	1, DETECT_PROTECT_REPORT},
+	{WID_11N_HT_PROT_TYPE,		1, RTS_CTS_NONHT_PROT},
+	{WID_11N_RIFS_PROT_ENABLE,	1, 0},
+	{WID_11N_SMPS_MODE,		1, MIMO_MODE},
+	{WID_11N_CURRENT_TX_MCS,	1, 7},
+	/* Enable N with immediate block ack, keep last: commits the frame */
+	{WID_11N_IMMEDIATE_BA_ENABLED,	1, 1},
+};
+
+/* Numeric entries the cfg layer keeps a value for */
+static bool linux_wlan_init_cfg_verifiable(const struct wilc_init_cfg *cfg)
+{
+	u32 val;
+
+	/* reads back the rate in use, not the setting */
+	if (cfg->wid == WID_CURRENT_TX_RATE)
+		return false;
+
+	if (cfg->str || (cfg->size > 4))
+		return false;
+
+	return (g_linux_wlan->oup.wlan_cfg_get_value(cfg->wid, (u8 *)&val,
+						     sizeof(val)) > 0);
+}
+
+/*
+ * The firmware answers a config frame as a whole, so a WID it refused
+ * doesn't fail the set. Read back the entries the cfg layer caches, in
+ * one query, and name the ones that didn't take. Returns the number of
+ * mismatches, -1 if the query itself failed.
+ */
+static int linux_wlan_verify_init_config(void)
+{
+	const struct wilc_init_cfg *cfg;
+	int i, n = 0, last = -1, bad = 0;
+	u32 val, mask;
+
+	for (i = 0; i < ARRAY_SIZE(init_cfg_table); i++) {
+		if (linux_wlan_init_cfg_verifiable(&init_cfg_table[i]))
+			last = i;
+	}
+	if (last < 0)
+		return 0;
+
+	for (i = 0; i <= last; i++) {
+		cfg = &init_cfg_table[i];
+		if (!linux_wlan_init_cfg_verifiable(cfg))
+			continue;
+		if (!g_linux_wlan->oup.wlan_cfg_get(!n++, cfg->wid,
+						    (i == last), 0))
+			return -1;
+	}
+
+	for (i = 0; i <= last; i++) {
+		cfg = &init_cfg_table[i];
+		if (!linux_wlan_init_cfg_verifiable(cfg))
+			continue;
+		val = 0;
+		g_linux_wlan->oup.wlan_cfg_get_value(cfg->wid, (u8 *)&val, sizeof(val));
+		mask = (cfg->size == 4) ? 0xffffffff : (BIT(cfg->size * 8) - 1);
+		if ((val & mask) != (cfg->val & mask)) {
+			PRINT_ER("WID 0x%x not taken: set %u, reads %u\n",
+				 cfg->wid, cfg->val & mask, val & mask);
+			bad++;
+		}
+	}
+
+	return bad;
+}
+
 static int linux_wlan_init_test_config(struct net_device *dev, struct linux_wlan *p_nic)
 {
 	u8 c_val[64];
-	
+	const struct wilc_init_cfg *cfg;
+	int i;
 
 	/*BugID_5077*/
 	struct WILC_WFI_priv *priv;
@@ -1015,267 +1299,44 @@ static int linux_wlan_init_test_config(struct net_device *dev, struct linux_wlan
 	}
 
 	*(int *)c_val = (unsigned int)nic->iftype;
-	
 	if (!g_linux_wlan->oup.wlan_cfg_set(1, WID_SET_OPERATION_MODE, c_val,
 					    4, 0, 0))
 		goto _fail_;
 
-	/*to tell fw that we are going to use PC test - WILC specific*/
-	c_val[0] = 0;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_PC_TEST_MODE, c_val,
-					    1, 0, 0))
-		goto _fail_;
-
-	c_val[0] = INFRASTRUCTURE;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_BSS_TYPE, c_val, 1, 0, 0))
-		goto _fail_;
-
-	c_val[0] = RATE_AUTO;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_CURRENT_TX_RATE, c_val,
-					    1, 0, 0))
-		goto _fail_;
-
-	c_val[0] = G_MIXED_11B_2_MODE;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_11G_OPERATING_MODE, c_val,
-					    1, 0, 0))
-		goto _fail_;
-
-	c_val[0] = 1;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_CURRENT_CHANNEL, c_val,
-					    1, 0, 0))
-		goto _fail_;
-
-	c_val[0] = G_SHORT_PREAMBLE;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_PREAMBLE, c_val, 1, 0, 0))
-		goto _fail_;
-
-	c_val[0] = AUTO_PROT;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_11N_PROT_MECH, c_val,
-					    1, 0, 0))
-		goto _fail_;
-
-#ifdef SWITCH_LOG_TERMINAL
-	c_val[0] = AUTO_PROT;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_LOGTerminal_Switch, c_val,
-					    1, 0, 0))
-		goto _fail_;
-#endif /* SWITCH_LOG_TERMINAL */
-
-	c_val[0] = ACTIVE_SCAN;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_SCAN_TYPE, c_val, 1, 0, 0))
-		goto _fail_;
-
-	c_val[0] = SITE_SURVEY_OFF;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_SITE_SURVEY, c_val,
-					    1, 0, 0))
-		goto _fail_;
-
-	/* Never use RTS-CTS */
-	*((int *)c_val) = 0xffff;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_RTS_THRESHOLD, c_val,
-					    2, 0, 0))
-		goto _fail_;
-
-	*((int *)c_val) = 2346;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_FRAG_THRESHOLD, c_val,
-					    2, 0, 0))
-		goto _fail_;
-
-	c_val[0] = 0;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_BCAST_SSID, c_val, 1, 0, 0))
-		goto _fail_;
-
-	c_val[0] = 1;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_QOS_ENABLE, c_val, 1, 0, 0))
-		goto _fail_;
-
-	c_val[0] = NO_POWERSAVE;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_POWER_MANAGEMENT, c_val,
-					    1, 0, 0))
-		goto _fail_;
-
-	c_val[0] = NO_ENCRYPT;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_11I_MODE, c_val, 1, 0, 0))
-		goto _fail_;
-
-	c_val[0] = OPEN_SYSTEM;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_AUTH_TYPE, c_val, 1, 0, 0))
-		goto _fail_;
-
-/*  WEP/802 11I Configuration
- *  Configuration : WEP Key
- *  Values (0x)   : 5 byte for WEP40 and 13 bytes for WEP104
- *                  In case more than 5 bytes are passed on for WEP 40
- *                  only first 5 bytes will be used as the key
- */
-
-	strcpy(c_val, "123456790abcdef1234567890");
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_WEP_KEY_VALUE, c_val,
-					    (strlen(c_val) + 1), 0, 0))
-		goto _fail_;
-
-/*  WEP/802 11I Configuration
- *  Configuration : AES/TKIP WPA/RSNA Pre-Shared Key
- *  Values to set : Any string with length greater than equal to 8 bytes
- *                  and less than 64 bytes
- */
-	strcpy(c_val, "12345678");
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_11I_PSK, c_val,
-					    (strlen(c_val)), 0, 0))
-		goto _fail_;
-
-/*  IEEE802.1X Key Configuration
- *  Configuration : Radius Server Access Secret Key
- *  Values to set : Any string with length greater than equal to 8 bytes
- *                  and less than 65 bytes
- */
-	strcpy(c_val, "password");
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_1X_KEY, c_val,
-					   (strlen(c_val) + 1), 0, 0))
-		goto _fail_;
-
-/*   IEEE802.1X Server Address Configuration
- *  Configuration : Radius Server IP Address
- *  Values to set : Any valid IP Address
- */
-	c_val[0] = 192;
-	c_val[1] = 168;
-	c_val[2] = 1;
-	c_val[3] = 112;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_1X_SERV_ADDR, c_val,
-					    4, 0, 0))
-		goto _fail_;
-
-	c_val[0] = 3;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_LISTEN_INTERVAL, c_val,
-					    1, 0, 0))
-		goto _fail_;
-
-	c_val[0] = 3;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_DTIM_PERIOD, c_val,
-					    1, 0, 0))
-		goto _fail_;
-
-	c_val[0] = NORMAL_ACK;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_ACK_POLICY, c_val, 1, 0, 0))
-		goto _fail_;
-
-	c_val[0] = 0;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_USER_CONTROL_ON_TX_POWER,
-					    c_val, 1, 0, 0))
-		goto _fail_;
-
-	c_val[0] = 48;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_TX_POWER_LEVEL_11A, c_val,
-					    1, 0, 0))
-		goto _fail_;
-
-	c_val[0] = 28;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_TX_POWER_LEVEL_11B, c_val,
-					    1, 0, 0))
-		goto _fail_;
-
-/*  Beacon Interval
- *  Configuration : Sets the beacon interval value
- *  Values to set : Any 16-bit value
- */
-
-	*((int *)c_val) = 100;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_BEACON_INTERVAL, c_val,
-					    2, 0, 0))
-		goto _fail_;
-
-	c_val[0] = REKEY_DISABLE;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_REKEY_POLICY, c_val,
-					    1, 0, 0))
-		goto _fail_;
-
-/*  Rekey Time (s) (Used only when the Rekey policy is 2 or 4)
- *  Configuration : Sets the Rekey Time (s)
- *  Values to set : 32-bit value
- */
-	*((int *)c_val) = 84600;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_REKEY_PERIOD, c_val,
-					    4, 0, 0))
-		goto _fail_;
-
-/*  Rekey Packet Count (in 1000s; used when Rekey Policy is 3)
- *  Configuration : Sets Rekey Group Packet count
- *  Values to set : 32-bit Value
- */
-	*((int *)c_val) = 500;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_REKEY_PACKET_COUNT,
-					    c_val, 4, 0, 0))
-		goto _fail_;
-
-	c_val[0] = 1;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_SHORT_SLOT_ALLOWED,
-					    c_val, 1, 0, 0))
-		goto _fail_;
-
-	c_val[0] = G_SELF_CTS_PROT;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_11N_ERP_PROT_TYPE, c_val,
-					    1, 0, 0))
-		goto _fail_;
-
-	/* Enable N */	
-	c_val[0] = 1;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_11N_ENABLE, c_val, 1, 0, 0))
-		goto _fail_;
-
-	c_val[0] = HT_MIXED_MODE;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_11N_OPERATING_MODE, c_val,
-					    1, 0, 0))
-		goto _fail_;
-
-	/* TXOP Prot disable in N mode: No RTS-CTS on TX A-MPDUs to save air-time. */
-	c_val[0] = 1;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_11N_TXOP_PROT_DISABLE,
-					    c_val, 1, 0, 0))
-		goto _fail_;
-
-	/* AP only */
-	c_val[0] = DETECT_PROTECT_REPORT;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_11N_OBSS_NONHT_DETECTION,
-					    c_val, 1, 0, 0))
-		goto _fail_;
-
-	c_val[0] = RTS_CTS_NONHT_PROT;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_11N_HT_PROT_TYPE, c_val,
-					    1, 0, 0))
-		goto _fail_;
-
-	c_val[0] = 0;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_11N_RIFS_PROT_ENABLE, c_val,
-					    1, 0, 0))
-		goto _fail_;
-
-	c_val[0] = MIMO_MODE;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_11N_SMPS_MODE, c_val,
-					    1, 0, 0))
-		goto _fail_;
-
-	c_val[0] = 7;
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_11N_CURRENT_TX_MCS, c_val,
-					    1, 0, 0))
-		goto _fail_;
-
-	
+	for (i = 0; i < ARRAY_SIZE(init_cfg_table); i++) {
+		cfg = &init_cfg_table[i];
 #ifdef WILC_BT_COEXISTENCE
-	/*TicketId842*/
-	/*If Hostspot is turning on,  set COEX_FORCE_WIFI mode.*/
-	if(nic->iftype == AP_MODE)
-	{
-		/* Disable coexistence in the initialization */
-		c_val[0] = COEX_FORCE_WIFI;
-		if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_BT_COEX_MODE, c_val, 1, 0, 0))
+		/*TicketId842*/
+		/*If Hostspot is turning on,  set COEX_FORCE_WIFI mode.*/
+		if ((i == ARRAY_SIZE(init_cfg_table) - 1) &&
+		    (nic->iftype == AP_MODE)) {
+			/* Disable coexistence in the initialization */
+			c_val[0] = COEX_FORCE_WIFI;
+			if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_BT_COEX_MODE,
+							    c_val, 1, 0, 0))
+				goto _fail_;
+		}
+#endif /* WILC_BT_COEXISTENCE */
+		if (cfg->str)
+			memcpy(c_val, cfg->str, cfg->size);
+		else
+			memcpy(c_val, &cfg->val, sizeof(cfg->val));
+		if (!g_linux_wlan->oup.wlan_cfg_set(0, cfg->wid, c_val,
+						    cfg->size,
+						    (i == ARRAY_SIZE(init_cfg_table) - 1),
+						    0)) {
+			PRINT_ER("Failed to configure WID 0x%x\n", cfg->wid);
 			goto _fail_;
+		}
 	}
-#endif /* WILC_BT_COEXISTENCE */
-	c_val[0] = 1; /* Enable N with immediate block ack. */
-	/* changed from zero to 1 */
-	if (!g_linux_wlan->oup.wlan_cfg_set(0, WID_11N_IMMEDIATE_BA_ENABLED, c_val, 1, 1,0))
-		goto _fail_;
+
+	/* Diagnostic only, the firmware runs with whatever it took */
+	i = linux_wlan_verify_init_config();
+	if (i < 0)
+		PRINT_WRN(INIT_DBG, "Failed to read back init config\n");
+	else if (i > 0)
+		PRINT_ER("%d init config WIDs not taken by the firmware\n", i);
+
 	return 0;
 
 _fail_:
@@ -1292,6 +1353,8 @@ void wilc_wlan_deinit(struct linux_wlan *nic)
 			return;
 		}
 
+		wilc_ps_policy_stop();
+
 		PRINT_D(INIT_DBG, "Disabling IRQ\n");
 #if (!defined WILC_SDIO) || (defined WILC_SDIO_IRQ_GPIO)
 		linux_wlan_disable_irq(IRQ_WAIT);
@@ -1318,16 +1381,31 @@ void wilc_wlan_deinit(struct linux_wlan *nic)
 		deinit_irq(g_linux_wlan);
 
 		if (&g_linux_wlan->oup != NULL)
-			if (g_linux_wlan->oup.wlan_stop != NULL)
-				g_linux_wlan->oup.wlan_stop();
+			if (g_linux_wlan->oup.wlan_stop != NULL) {
+				ktime_t start = ktime_get();
+
+				/*
+				 * Note what of the firmware survives for the next
+				 * open; not after a crash, its memory is suspect.
+				 */
+				if (g_linux_wlan->oup.wlan_stop() && !gbCrashRecover &&
+				    g_linux_wlan->wilc_firmware != NULL)
+					g_linux_wlan->oup.wlan_fw_snapshot(
+						g_linux_wlan->wilc_firmware->data,
+						g_linux_wlan->wilc_firmware->size);
+				PRINT_D(INIT_DBG, "Stop and fw snapshot %lld us\n",
+					ktime_us_delta(ktime_get(), start));
+			}
 
 		PRINT_D(INIT_DBG, "Deinitializing WILC Wlan\n");
 		at_wlan_deinit(nic);
 #if (defined WILC_SDIO) && (!defined WILC_SDIO_IRQ_GPIO)
     	PRINT_D(INIT_DBG,"Disabling IRQ 2\n");
-		mutex_lock(g_linux_wlan->hif_cs);
+		/*
+		 * Not under the bus: this waits for a running ISR, which
+		 * acquires the bus itself, and claims the host on its own.
+		 */
 		disable_sdio_interrupt();
-		mutex_unlock(g_linux_wlan->hif_cs);
 #endif
 
 		/*De-Initialize locks*/
@@ -1357,7 +1435,6 @@ int wlan_init_locks(struct linux_wlan *p_nic)
 	sema_init(&g_linux_wlan->txq_add_to_head_cs, 1);
 	sema_init(&g_linux_wlan->txq_event, 0);
 	sema_init(&g_linux_wlan->rxq_event, 0);
-	sema_init(&g_linux_wlan->cfg_event, 0);
 	sema_init(&g_linux_wlan->sync_event, 0);
 	sema_init(&g_linux_wlan->rxq_thread_started, 0);
 	sema_init(&g_linux_wlan->txq_thread_started, 0);
@@ -1400,7 +1477,6 @@ void linux_to_wlan(struct wilc_wlan_inp *nwi, struct linux_wlan *nic)
 #endif
 	nwi->os_context.rxq_critical_section = (void *)&g_linux_wlan->rxq_cs;
 	nwi->os_context.rxq_wait_event = (void *)&g_linux_wlan->rxq_event;
-	nwi->os_context.cfg_wait_event = (void *)&g_linux_wlan->cfg_event;
 
 #ifdef WILC_SDIO
 	nwi->io_func.io_type = HIF_SDIO;
@@ -1560,7 +1636,7 @@ static void wlan_deinitialize_threads(struct linux_wlan *nic)
 #endif
 }
 
-/* Release firmware after downloading and starting it */
+/* Release firmware that failed to download or start */
 void linux_wlan_free_firmware(void)
 {
 	if (g_linux_wlan->wilc_firmware == NULL) {
@@ -1572,6 +1648,46 @@ void linux_wlan_free_firmware(void)
 	g_linux_wlan->wilc_firmware = NULL;
 }
 
+/* Per phase bring-up time of the last wilc_wlan_init(), in us */
+static struct {
+	s64 fetch;
+	s64 download;
+	s64 host;
+	s64 wait;
+	s64 start;
+	s64 config;
+} boot_time;
+
+/*
+ * Fetches (first open only, the blobs are cached afterwards) and downloads
+ * the firmware. Runs on a work item so the threads and IRQ come up in the
+ * meantime; wilc_wlan_init() joins it before starting the firmware.
+ */
+static void linux_wlan_fw_dl_work(struct work_struct *work)
+{
+	ktime_t start = ktime_get();
+	int ret;
+
+	ret = linux_wlan_get_firmware(g_linux_wlan->fw_dl_nic);
+	boot_time.fetch = ktime_us_delta(ktime_get(), start);
+	if (ret) {
+		PRINT_ER("Can't get firmware\n");
+		g_linux_wlan->fw_dl_ret = -EIO;
+		return;
+	}
+
+	start = ktime_get();
+	ret = linux_wlan_firmware_download(g_linux_wlan);
+	boot_time.download = ktime_us_delta(ktime_get(), start);
+	if (ret < 0) {
+		PRINT_ER("Failed to download firmware\n");
+		/* Freeing FW buffer */
+		linux_wlan_free_firmware();
+		ret = -EIO;
+	}
+	g_linux_wlan->fw_dl_ret = ret;
+}
+
 int wilc_wlan_init(struct net_device *dev, struct perInterface_wlan *p_nic)
 {
 	struct wilc_wlan_inp nwi;
@@ -1579,8 +1695,10 @@ int wilc_wlan_init(struct net_device *dev, struct perInterface_wlan *p_nic)
 	struct perInterface_wlan *nic = p_nic;
 	int ret = 0;
 	int timeout = 5;
+	ktime_t init_start, start;
 
 	if (!g_linux_wlan->wilc_initialized) {
+		init_start = ktime_get();
 		g_linux_wlan->mac_status = WILC_MAC_STATUS_INIT;
 		g_linux_wlan->close = 0;
 		g_linux_wlan->wilc_initialized = 0;
@@ -1601,6 +1719,14 @@ int wilc_wlan_init(struct net_device *dev, struct perInterface_wlan *p_nic)
 		/* Save the oup structre into global pointer */
 		gpstrWlanOps = &g_linux_wlan->oup;
 
+		/* Fetch and download the firmware while the host side comes up */
+		memset(&boot_time, 0, sizeof(boot_time));
+		g_linux_wlan->fw_dl_nic = nic;
+		g_linux_wlan->fw_dl_ret = 0;
+		INIT_WORK(&g_linux_wlan->fw_dl_work, linux_wlan_fw_dl_work);
+		schedule_work(&g_linux_wlan->fw_dl_work);
+
+		start = ktime_get();
 		ret = wlan_initialize_threads(nic);
 		if (ret < 0) {
 			PRINT_ER("Initializing Threads FAILED\n");
@@ -1624,43 +1750,40 @@ int wilc_wlan_init(struct net_device *dev, struct perInterface_wlan *p_nic)
 		}
 #endif
 
-		if (linux_wlan_get_firmware(nic)) {
-			PRINT_ER("Can't get firmware\n");
-			ret = -EIO;
+		boot_time.host = ktime_us_delta(ktime_get(), start);
+
+		start = ktime_get();
+		flush_work(&g_linux_wlan->fw_dl_work);
+		boot_time.wait = ktime_us_delta(ktime_get(), start);
+		ret = g_linux_wlan->fw_dl_ret;
+		if (ret < 0)
 			goto _fail_irq_enable_;
-		}
 
 /* TicketId908
  * Keep trying to download+start firmware in case of failures
  * This to workaround problem of firmware startup being stuck somewhere in turing_on_rf_blocks
  */
-		do {
-			/*Download firmware*/
-			ret = linux_wlan_firmware_download(g_linux_wlan);
-			if (ret < 0) {
-				PRINT_ER("Failed to download firmware\n");
+		start = ktime_get();
+		while (linux_wlan_start_firmware(nic) < 0) {
+			PRINT_ER("Failed to start firmware - timeout = %d\n", timeout);
+			if (timeout-- == 0) {
 				/* Freeing FW buffer */
 				linux_wlan_free_firmware();
-
 				ret = -EIO;
 				goto _fail_irq_enable_;
 			}
 
-			/* Start firmware*/
-			ret = linux_wlan_start_firmware(nic);
+			/*Download firmware*/
+			ret = linux_wlan_firmware_download(g_linux_wlan);
 			if (ret < 0) {
-				PRINT_ER("Failed to start firmware - timeout = %d\n", timeout);
+				PRINT_ER("Failed to download firmware\n");
+				/* Freeing FW buffer */
+				linux_wlan_free_firmware();
 				ret = -EIO;
-				if (timeout-- == 0) {
-					/* Freeing FW buffer */
-					linux_wlan_free_firmware();
-					goto _fail_irq_enable_;
-				}
+				goto _fail_irq_enable_;
 			}
-		} while (ret == -EIO);
-
-		/* Freeing FW buffer */
-		linux_wlan_free_firmware();
+		}
+		boot_time.start = ktime_us_delta(ktime_get(), start);
 
 #ifdef DOWNLOAD_BT_FW
 		/*Download BT firmware*/
@@ -1687,7 +1810,9 @@ int wilc_wlan_init(struct net_device *dev, struct perInterface_wlan *p_nic)
 			PRINT_D(GENERIC_DBG, "**** Firmware Ver = %s ****\n", Firmware_ver);
 		}
 		/* Initialize firmware with default configuration */
+		start = ktime_get();
 		ret = linux_wlan_init_test_config(dev, g_linux_wlan);
+		boot_time.config = ktime_us_delta(ktime_get(), start);
 
 		if (ret < 0) {
 			PRINT_ER("Failed to configure firmware\n");
@@ -1695,6 +1820,11 @@ int wilc_wlan_init(struct net_device *dev, struct perInterface_wlan *p_nic)
 			goto _fail_fw_start_;
 		}
 
+		PRINT_D(INIT_DBG, "Bring-up %lld us: fetch %lld download %lld host %lld wait %lld start %lld config %lld\n",
+			ktime_us_delta(ktime_get(), init_start), boot_time.fetch,
+			boot_time.download, boot_time.host, boot_time.wait,
+			boot_time.start, boot_time.config);
+
 		g_linux_wlan->wilc_initialized = 1;
 		return 0;
 
@@ -1716,6 +1846,7 @@ _fail_threads_:
 #endif
 		wlan_deinitialize_threads(g_linux_wlan);
 _fail_wilc_wlan_:
+		flush_work(&g_linux_wlan->fw_dl_work);
 		at_wlan_deinit(g_linux_wlan);
 _fail_locks_:
 		wlan_deinit_locks(g_linux_wlan);
@@ -2026,6 +2157,8 @@ int mac_xmit(struct sk_buff *skb, struct net_device *ndev)
 	QueueCount = WILC_Xmit_data((void *)tx_data, HOST_TO_WLAN);
 	#endif /* WILC_FULLY_HOSTING_AP */
 
+	wilc_ps_policy_count(QueueCount);
+
 	if (QueueCount > FLOW_CONTROL_UPPER_THRESHOLD) {
 		netif_stop_queue(g_linux_wlan->strInterfaceInfo[0].wilc_netdev);
 		netif_stop_queue(g_linux_wlan->strInterfaceInfo[1].wilc_netdev);
@@ -2296,6 +2429,7 @@ void frmw_to_linux(uint8_t *buff, uint32_t size, uint32_t pkt_offset)
 #endif
 		nic->netstats.rx_packets++;
 		nic->netstats.rx_bytes += frame_len;
+		wilc_ps_policy_count(0);
 		skb->ip_summed = CHECKSUM_UNNECESSARY;
 		stats = netif_rx(skb);
 		PRINT_D(RX_DBG, "netif_rx ret value is: %d\n", stats);
@@ -2477,6 +2611,12 @@ static void __exit exit_wilc_driver(void)
 		release_firmware(g_linux_wlan->wilc_firmware);
 		g_linux_wlan->wilc_firmware = NULL;
 	}
+#ifdef DOWNLOAD_BT_FW
+	if ((g_linux_wlan != NULL) && g_linux_wlan->wilc_bt_firmware != NULL) {
+		release_firmware(g_linux_wlan->wilc_bt_firmware);
+		g_linux_wlan->wilc_bt_firmware = NULL;
+	}
+#endif
 
 	if ((g_linux_wlan != NULL) &&
 	    (((g_linux_wlan->strInterfaceInfo[0].wilc_netdev) != NULL) ||
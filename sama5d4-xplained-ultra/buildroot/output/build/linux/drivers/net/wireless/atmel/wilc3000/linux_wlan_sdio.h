@@ -20,6 +20,7 @@
 #define LINUX_WLAN_SDIO_H
 
 #include <linux/mmc/sdio_func.h>
+#include <linux/scatterlist.h>
 #include "wilc_type.h"
 
 #ifdef WILC_SDIO
@@ -52,8 +53,14 @@ int linux_sdio_init(void *);
 void linux_sdio_deinit(void *);
 int linux_sdio_cmd52(struct sdio_cmd52_t *cmd);
 int linux_sdio_cmd53(struct sdio_cmd53_t *cmd);
+int linux_sdio_cmd53_sg(struct sdio_cmd53_t *cmd, struct scatterlist *sg,
+			unsigned int sg_len);
 int enable_sdio_interrupt(isr_handler_t isr_handler);
 void disable_sdio_interrupt(void);
 int linux_sdio_set_max_speed(void);
+int linux_sdio_set_speed(int speed);
+uint32_t linux_sdio_crc_errors(void);
+void linux_sdio_xact_begin(void);
+void linux_sdio_xact_end(void);
 
 #endif /* LINUX_WLAN_SDIO_H */
@@ -28,4 +28,5 @@ void linux_spi_deinit(void *vp);
 int linux_spi_write(uint8_t *b, uint32_t len);
 int linux_spi_read(uint8_t *rb, uint32_t rlen);
 int linux_spi_write_read(u8 *wb, u8 *rb, unsigned int rlen);
+int linux_spi_set_speed(uint32_t speed);
 #endif
@@ -19,16 +19,46 @@
 #include "at_pwr_dev.h"
 #include "wilc_wlan_if.h"
 #include "wilc_wlan.h"
+#include <linux/ktime.h>
 
 
 #define WILC_SDIO_BLOCK_SIZE 512
 
+/*
+ * Bus settings tried at probe, fastest first. The linux layer clamps the
+ * clock to what the host and the card support.
+ */
+static const int sdio_tune_speeds[] = {
+	50000000, 40000000, 33000000, 25000000, 20000000, 12500000,
+};
+static const uint32_t sdio_tune_block_sizes[] = { 512, 256 };
+
+#define SDIO_TUNE_ADDR		WILC_AHB_DATA_MEM_BASE
+#define SDIO_TUNE_LEN		(8 * 1024)
+#define SDIO_TUNE_ROUNDS	4
+/* CRC errors tolerated at runtime before stepping the clock down */
+#define SDIO_CRC_ERR_THRESHOLD	3
+
+/* tuning result, kept across sdio_init() so re-init and resume reuse it */
+static int sdio_tune_idx = -1;
+static uint32_t sdio_tune_block_size = WILC_SDIO_BLOCK_SIZE;
+
 struct wilc_sdio {
 	void *os_context;
 	uint32_t block_size;
 	int (*sdio_cmd52)(struct sdio_cmd52_t *);
 	int (*sdio_cmd53)(struct sdio_cmd53_t *);
+	int (*sdio_cmd53_sg)(struct sdio_cmd53_t *, struct scatterlist *,
+			     unsigned int);
 	int (*sdio_set_max_speed)(void);
+	int (*sdio_set_speed)(int);
+	uint32_t (*sdio_crc_errors)(void);
+	void (*sdio_xact_begin)(void);
+	void (*sdio_xact_end)(void);
+	int speed;
+	uint32_t crc_err_base;
+	/* bounce block for the padded tail of a func 1 transfer */
+	uint8_t *pad_buf;
 	int nint;
 	/* Max num interrupts allowed in registers 0xf7, 0xf8 */
 	#define MAX_NUN_INT_THRPT_ENH2 (5)
@@ -277,6 +307,89 @@ _fail_:
 	return 0;
 }
 
+/*
+ * func 1 data port transfer in one block mode CMD53. A partial last block
+ * goes through the bounce buffer padded to the block size, instead of
+ * being sent as an extra byte mode CMD53.
+ */
+static int sdio_xfer_sg(struct sdio_cmd53_t *cmd, uint8_t *buf, uint32_t size)
+{
+	uint32_t block_size = g_sdio.block_size;
+	struct scatterlist sg[2];
+	unsigned int nents = 0;
+	uint32_t nblk, nleft;
+
+	nblk = size / block_size;
+	nleft = size % block_size;
+
+	sg_init_table(sg, ARRAY_SIZE(sg));
+	if (nblk > 0)
+		sg_set_buf(&sg[nents++], buf, nblk * block_size);
+
+	if (nleft > 0) {
+		if (cmd->read_write) {
+			memcpy(g_sdio.pad_buf, &buf[nblk * block_size], nleft);
+			memset(&g_sdio.pad_buf[nleft], 0, block_size - nleft);
+		}
+		sg_set_buf(&sg[nents++], g_sdio.pad_buf, block_size);
+	}
+	sg_mark_end(&sg[nents - 1]);
+
+	cmd->block_mode = 1;
+	cmd->increment = 1;
+	cmd->count = nblk + ((nleft > 0) ? 1 : 0);
+	cmd->buffer = buf;
+	cmd->block_size = block_size;
+
+	if (!g_sdio.sdio_cmd53_sg(cmd, sg, nents))
+		return 0;
+
+	if ((nleft > 0) && !cmd->read_write)
+		memcpy(&buf[nblk * block_size], g_sdio.pad_buf, nleft);
+
+	return 1;
+}
+
+static int sdio_can_xfer_sg(uint32_t addr, uint32_t size)
+{
+	/* an empty transfer would leave no entry to mark as the end */
+	if ((addr > 0) || (size == 0) || (NULL == g_sdio.sdio_cmd53_sg) ||
+	    (NULL == g_sdio.pad_buf))
+		return 0;
+
+	/* block count field of CMD53 is 9 bits */
+	return (DIV_ROUND_UP(size, g_sdio.block_size) <= 0x1ff);
+}
+
+/*
+ * Called when a transfer failed. Repeated CRC errors mean the tuned clock
+ * is marginal on this board, so step down to the next slower one.
+ */
+static void sdio_check_crc_errors(void)
+{
+	uint32_t errs;
+	int speed;
+
+	if ((sdio_tune_idx < 0) || (NULL == g_sdio.sdio_crc_errors))
+		return;
+
+	errs = g_sdio.sdio_crc_errors();
+	if ((errs - g_sdio.crc_err_base) < SDIO_CRC_ERR_THRESHOLD)
+		return;
+	g_sdio.crc_err_base = errs;
+
+	while (sdio_tune_idx < (ARRAY_SIZE(sdio_tune_speeds) - 1)) {
+		sdio_tune_idx++;
+		speed = g_sdio.sdio_set_speed(sdio_tune_speeds[sdio_tune_idx]);
+		if (speed && (speed != g_sdio.speed)) {
+			PRINT_WRN(BUS_DBG, "SDIO CRC errors, clock %d -> %d Hz\n",
+				  g_sdio.speed, speed);
+			g_sdio.speed = speed;
+			break;
+		}
+	}
+}
+
 static int sdio_write(uint32_t addr, uint8_t *buf, uint32_t size)
 {
 	uint32_t block_size = g_sdio.block_size;
@@ -314,6 +427,14 @@ static int sdio_write(uint32_t addr, uint8_t *buf, uint32_t size)
 		cmd.address = 0;
 	}
 
+	if (sdio_can_xfer_sg(addr, size)) {
+		if (!sdio_xfer_sg(&cmd, buf, size)) {
+			PRINT_ER("Failed cmd53 [%x], sg send\n", addr);
+			goto _fail_;
+		}
+		return 1;
+	}
+
 	nblk = size / block_size;
 	nleft = size % block_size;
 
@@ -357,6 +478,7 @@ static int sdio_write(uint32_t addr, uint8_t *buf, uint32_t size)
 
 	return 1;
 _fail_:
+	sdio_check_crc_errors();
 	return 0;
 }
 
@@ -441,6 +563,14 @@ static int sdio_read(uint32_t addr, uint8_t *buf, uint32_t size)
 		cmd.address = 0;
 	}
 
+	if (sdio_can_xfer_sg(addr, size)) {
+		if (!sdio_xfer_sg(&cmd, buf, size)) {
+			PRINT_ER("Failed cmd53 [%x], sg read\n", addr);
+			goto _fail_;
+		}
+		return 1;
+	}
+
 	nblk = size / block_size;
 	nleft = size % block_size;
 
@@ -484,6 +614,7 @@ static int sdio_read(uint32_t addr, uint8_t *buf, uint32_t size)
 
 	return 1;
 _fail_:
+	sdio_check_crc_errors();
 	return 0;
 }
 
@@ -581,6 +712,133 @@ static int sdio_sync(void)
 }
 #endif
 
+static int sdio_set_block_size(uint32_t block_size)
+{
+	if (!sdio_set_func0_block_size(block_size) ||
+	    !sdio_set_func1_block_size(block_size))
+		return 0;
+
+	g_sdio.block_size = block_size;
+	return 1;
+}
+
+/*
+ * Loop a pattern through chip data memory at each candidate clock and
+ * block size, and keep the fastest setting that moved it intact without
+ * CRC errors. Runs before the firmware is downloaded, so the func1 data
+ * port (which needs the firmware to grant VMM buffers) can't be used yet;
+ * the pattern goes as block mode CMD53s through the func0 window, with
+ * both functions set to the block size under test. Whatever was in the
+ * window is put back afterwards at the chosen setting.
+ */
+static void sdio_tune_bus(void)
+{
+	uint8_t *tx, *rx, *save;
+	uint32_t rate, best_rate = 0;
+	uint32_t best_block_size = WILC_SDIO_BLOCK_SIZE;
+	int best_idx = -1, prev_speed = 0, speed;
+	int i, j, k, round, ok;
+	uint32_t crc;
+	ktime_t start;
+	s64 us;
+
+	if ((NULL == g_sdio.sdio_set_speed) || (NULL == g_sdio.sdio_crc_errors))
+		return;
+
+	tx = kmalloc(SDIO_TUNE_LEN * 3, GFP_KERNEL);
+	if (NULL == tx) {
+		PRINT_ER("Can't allocate sdio tuning buffer\n");
+		return;
+	}
+	rx = tx + SDIO_TUNE_LEN;
+	save = rx + SDIO_TUNE_LEN;
+
+	/* at the enumeration clock, before anything is changed */
+	if (!sdio_read(SDIO_TUNE_ADDR, save, SDIO_TUNE_LEN)) {
+		PRINT_ER("Can't save sdio tuning window, not tuning\n");
+		kfree(tx);
+		return;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(sdio_tune_speeds); i++) {
+		speed = g_sdio.sdio_set_speed(sdio_tune_speeds[i]);
+		/* clamped to a clock already measured */
+		if ((0 == speed) || (speed == prev_speed))
+			continue;
+		prev_speed = speed;
+
+		for (j = 0; j < ARRAY_SIZE(sdio_tune_block_sizes); j++) {
+			if (!sdio_set_block_size(sdio_tune_block_sizes[j]))
+				continue;
+
+			crc = g_sdio.sdio_crc_errors();
+			ok = 1;
+			start = ktime_get();
+			for (round = 0; ok && (round < SDIO_TUNE_ROUNDS); round++) {
+				for (k = 0; k < SDIO_TUNE_LEN; k++)
+					tx[k] = (uint8_t)(k + round) ^
+						((k & 1) ? 0xaa : 0x55);
+
+				if (!sdio_write(SDIO_TUNE_ADDR, tx, SDIO_TUNE_LEN) ||
+				    !sdio_read(SDIO_TUNE_ADDR, rx, SDIO_TUNE_LEN) ||
+				    memcmp(tx, rx, SDIO_TUNE_LEN))
+					ok = 0;
+			}
+			us = ktime_us_delta(ktime_get(), start);
+
+			if (!ok || (g_sdio.sdio_crc_errors() != crc)) {
+				PRINT_D(BUS_DBG, "SDIO %d Hz, block %d: unstable\n",
+					speed, sdio_tune_block_sizes[j]);
+				continue;
+			}
+
+			/* bytes per ms, i.e. KB/s */
+			rate = (2 * SDIO_TUNE_LEN * SDIO_TUNE_ROUNDS * 1000) /
+			       (uint32_t)((us > 0) ? us : 1);
+			PRINT_D(BUS_DBG, "SDIO %d Hz, block %d: %d KB/s\n",
+				speed, sdio_tune_block_sizes[j], rate);
+
+			if (rate > best_rate) {
+				best_rate = rate;
+				best_idx = i;
+				best_block_size = sdio_tune_block_sizes[j];
+			}
+		}
+	}
+
+	if (best_idx < 0) {
+		PRINT_ER("No stable SDIO setting, using slowest clock\n");
+		best_idx = ARRAY_SIZE(sdio_tune_speeds) - 1;
+	}
+
+	sdio_tune_idx = best_idx;
+	sdio_tune_block_size = best_block_size;
+	g_sdio.sdio_set_speed(sdio_tune_speeds[best_idx]);
+	if (!sdio_set_block_size(best_block_size))
+		PRINT_ER("Fail set tuned block size\n");
+
+	if (!sdio_write(SDIO_TUNE_ADDR, save, SDIO_TUNE_LEN) ||
+	    !sdio_read(SDIO_TUNE_ADDR, rx, SDIO_TUNE_LEN) ||
+	    memcmp(save, rx, SDIO_TUNE_LEN))
+		PRINT_ER("Fail restore sdio tuning window\n");
+
+	kfree(tx);
+
+	PRINT_D(INIT_DBG, "SDIO tuned to %d Hz, block size %d\n",
+		sdio_tune_speeds[best_idx], best_block_size);
+}
+
+static void sdio_apply_speed(void)
+{
+	if ((sdio_tune_idx < 0) || (NULL == g_sdio.sdio_set_speed)) {
+		g_sdio.sdio_set_max_speed();
+		return;
+	}
+
+	g_sdio.speed = g_sdio.sdio_set_speed(sdio_tune_speeds[sdio_tune_idx]);
+	g_sdio.crc_err_base = g_sdio.sdio_crc_errors();
+}
+
 int sdio_init(struct wilc_wlan_inp *inp, wilc_debug_func func)
 {
 	struct sdio_cmd52_t cmd;
@@ -588,6 +846,7 @@ int sdio_init(struct wilc_wlan_inp *inp, wilc_debug_func func)
 	uint32_t chipid;
 	if(inp != NULL)
 	{
+		kfree(g_sdio.pad_buf);
 		memset(&g_sdio, 0, sizeof(struct wilc_sdio));
 
 		g_sdio.os_context = inp->os_context.os_private;
@@ -603,7 +862,15 @@ int sdio_init(struct wilc_wlan_inp *inp, wilc_debug_func func)
 
 		g_sdio.sdio_cmd52	= inp->io_func.u.sdio.sdio_cmd52;
 		g_sdio.sdio_cmd53	= inp->io_func.u.sdio.sdio_cmd53;
+		g_sdio.sdio_cmd53_sg	= inp->io_func.u.sdio.sdio_cmd53_sg;
+		g_sdio.pad_buf = kmalloc(WILC_SDIO_BLOCK_SIZE, GFP_KERNEL);
+		if (NULL == g_sdio.pad_buf)
+			PRINT_ER("Can't allocate sdio pad buffer, no sg path\n");
 		g_sdio.sdio_set_max_speed 	= inp->io_func.u.sdio.sdio_set_max_speed;
+		g_sdio.sdio_set_speed	= inp->io_func.u.sdio.sdio_set_speed;
+		g_sdio.sdio_crc_errors	= inp->io_func.u.sdio.sdio_crc_errors;
+		g_sdio.sdio_xact_begin	= inp->io_func.u.sdio.sdio_xact_begin;
+		g_sdio.sdio_xact_end	= inp->io_func.u.sdio.sdio_xact_end;
 	}
 	/*
 	 * function 0 csa enable
@@ -621,12 +888,12 @@ int sdio_init(struct wilc_wlan_inp *inp, wilc_debug_func func)
 	/*
 	 * function 0 block size
 	 */
-	if (!sdio_set_func0_block_size(WILC_SDIO_BLOCK_SIZE)) {
+	if (!sdio_set_func0_block_size(sdio_tune_block_size)) {
 		PRINT_ER("Fail cmd 52, set func 0 block size\n");
 		goto _fail_;
 	}
 
-	g_sdio.block_size = WILC_SDIO_BLOCK_SIZE;
+	g_sdio.block_size = sdio_tune_block_size;
 
 	/*
 	 * enable func1 IO
@@ -667,7 +934,7 @@ int sdio_init(struct wilc_wlan_inp *inp, wilc_debug_func func)
 	/*
 	 * func 1 is ready, set func 1 block size
 	 */
-	if (!sdio_set_func1_block_size(WILC_SDIO_BLOCK_SIZE)) {
+	if (!sdio_set_func1_block_size(sdio_tune_block_size)) {
 		PRINT_ER("Fail set func 1 block size\n");
 		goto _fail_;
 	}
@@ -701,7 +968,9 @@ int sdio_init(struct wilc_wlan_inp *inp, wilc_debug_func func)
 	 	}
 	int_clrd = 0;
 
-	g_sdio.sdio_set_max_speed();
+	if ((inp != NULL) && (sdio_tune_idx < 0))
+		sdio_tune_bus();
+	sdio_apply_speed();
 
 	return 1;
 _fail_:
@@ -1111,6 +1380,21 @@ static int sdio_sync_ext(int nint)
 }
 #endif
 
+/*
+ * Keep the host claimed across one acquire_bus()/release_bus() window.
+ */
+static void sdio_xact_begin(void)
+{
+	if (g_sdio.sdio_xact_begin)
+		g_sdio.sdio_xact_begin();
+}
+
+static void sdio_xact_end(void)
+{
+	if (g_sdio.sdio_xact_end)
+		g_sdio.sdio_xact_end();
+}
+
 /*
  * Global sdio HIF function table
  */
@@ -1129,6 +1413,8 @@ struct wilc_hif_func hif_sdio = {
 	sdio_write,
 	sdio_read,
 	sdio_sync_ext,
+	sdio_xact_begin,
+	sdio_xact_end,
 };
 EXPORT_SYMBOL(hif_sdio);
 
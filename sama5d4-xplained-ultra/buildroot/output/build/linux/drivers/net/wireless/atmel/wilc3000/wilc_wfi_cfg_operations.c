@@ -19,14 +19,95 @@
 #include "wilc_wfi_cfg_operations.h"
 #include "linux_wlan.h"
 #include "core_configurator.h"
+#include <linux/hash.h>
+#include <linux/debugfs.h>
 
 #define IS_MANAGMEMENT				0x100
 #define IS_MANAGMEMENT_CALLBACK			0x080
 #define IS_MGMT_STATUS_SUCCES			0x040
 #define GET_PKT_OFFSET(a)			(((a) >> 22) & 0x1ff)
 
-struct tstrNetworkInfo astrLastScannedNtwrksShadow[MAX_NUM_SCANNED_NETWORKS_SHADOW];
+/*
+ * Scan shadow: networks seen in recent scans, hashed by BSSID for lookup
+ * and kept on an age list (least recently seen first) so that expiry and
+ * eviction only ever touch the entries they remove.
+ */
+#define SHADOW_HASH_BITS	6
+#define SHADOW_MAX_BYTES	(96 * 1024)
+/* Re-inform unchanged networks this often so cfg80211 does not expire them */
+#define SHADOW_REINFORM_TIME	(10 * HZ)
+/* Average RSSI drift (dBm) that makes a network worth re-reporting */
+#define SHADOW_RSSI_DELTA	5
+
+struct tstrShadowEntry {
+	struct hlist_node strHashNode;
+	struct list_head strAgeNode;
+	u16 u16IEsCap;
+	/* changed since cfg80211 was last informed */
+	bool bDirty;
+	unsigned long ulInformed;
+	int s32InformedRssi;
+	struct tstrNetworkInfo strNetworkInfo;
+};
+
+/* What cfg80211 is told about a shadow entry, taken under gsShadowLock */
+struct tstrShadowReport {
+	u8 au8bssid[ETH_ALEN];
+	u8 u8channel;
+	u16 u16CapInfo;
+	u16 u16BeaconPeriod;
+	u16 u16IEsLen;
+	int s32Rssi;
+	u64 u64Tsf;
+	const u8 *pu8IEs;
+};
+
+static const u8 au8WpaOui[4] = {0x00, 0x50, 0xF2, 0x01};
+
+static struct hlist_head gastrShadowHash[1 << SHADOW_HASH_BITS];
+static LIST_HEAD(gstrShadowAgeList);
+static DEFINE_SPINLOCK(gsShadowLock);
+static u32 u32ShadowBytes;
+static u32 shadow_max_bytes = SHADOW_MAX_BYTES;
+static struct dentry *shadow_debugfs_dir;
 unsigned int u32LastScannedNtwrksCountShadow;
+
+/*
+ * Channel occupancy history. Networks seen in scans and, far more, networks
+ * we connected to raise their channel's score; directed and scheduled scans
+ * probe the best scored channels first and only widen to the rest when the
+ * wanted network was not there. Every SMART_SCAN_FULL_EVERY-th scan is a
+ * full sweep, which also halves the scores so stale history fades out.
+ */
+#define SMART_SCAN_MAX_CHNL	14
+#define SMART_SCAN_SEEN_SCORE	1
+#define SMART_SCAN_CONN_SCORE	64
+#define SMART_SCAN_MAX_FIRST	3
+#define SMART_SCAN_FULL_EVERY	5
+#define SMART_SCAN_MAX_REQ	32
+
+static u8 gau8ChnlScore[SMART_SCAN_MAX_CHNL + 1];
+static unsigned int u32SmartScanCount;
+
+/*
+ * Fast reconnect: when the firmware drops the link, rejoin the last BSS with
+ * the join parameters of that connection instead of reporting the loss and
+ * waiting for the supplicant to scan. A successful rejoin is reported as a
+ * roam so the interface keeps its IP configuration; only a failed one is
+ * reported as a disconnection. Attempts closer together than
+ * FAST_RECONN_HOLDOFF fall back to the normal path so a BSS that keeps
+ * dropping us cannot loop, and so does a BSS not seen on the cached
+ * channel, by a join or a scan, for FAST_RECONN_MAX_AGE.
+ */
+#define FAST_RECONN_HOLDOFF	(10 * HZ)
+#define FAST_RECONN_MAX_AGE	(120 * HZ)
+
+static u32 fast_reconn_enable = 1;
+static u32 u32FastReconnAttempts;
+static u32 u32FastReconnSuccesses;
+static u32 u32FastReconnFailures;
+static u32 u32FastReconnLatencyMs;
+static struct dentry *fast_reconn_debugfs_dir;
 #ifdef DISABLE_PWRSAVE_AND_SCAN_DURING_IP
 struct timer_list hDuringIpTimer;
 #endif
@@ -127,129 +208,393 @@ bool g_wep_keys_saved = false;
 #define AGING_TIME		(9 * 1000)
 #define duringIP_TIME		15000
 
-void clear_shadow_scan(void *pUserVoid)
+static inline struct hlist_head *shadow_bucket(const u8 *pu8Bssid)
+{
+	u32 u32Key = ((u32)pu8Bssid[2] << 24) | ((u32)pu8Bssid[3] << 16) |
+		     ((u32)pu8Bssid[4] << 8) | pu8Bssid[5];
+
+	return &gastrShadowHash[hash_32(u32Key, SHADOW_HASH_BITS)];
+}
+
+/* Called with gsShadowLock held */
+static struct tstrShadowEntry *shadow_find(const u8 *pu8Bssid)
+{
+	struct tstrShadowEntry *pstrEntry;
+	struct hlist_node *pstrNode;
+
+	hlist_for_each(pstrNode, shadow_bucket(pu8Bssid)) {
+		pstrEntry = hlist_entry(pstrNode, struct tstrShadowEntry, strHashNode);
+		if (memcmp(pstrEntry->strNetworkInfo.au8bssid, pu8Bssid, ETH_ALEN) == 0)
+			return pstrEntry;
+	}
+	return NULL;
+}
+
+static void smart_scan_note(u8 u8Chnl, u8 u8Score)
+{
+	if (u8Chnl == 0 || u8Chnl > SMART_SCAN_MAX_CHNL)
+		return;
+	gau8ChnlScore[u8Chnl] = min_t(unsigned int, gau8ChnlScore[u8Chnl] + u8Score, 0xFF);
+}
+
+static u8 smart_scan_score(struct ieee80211_channel *channel)
+{
+	int s32Chnl = ieee80211_frequency_to_channel(channel->center_freq);
+
+	if (s32Chnl <= 0 || s32Chnl > SMART_SCAN_MAX_CHNL)
+		return 0;
+	return gau8ChnlScore[s32Chnl];
+}
+
+/*
+ * Picks the channels of a scan worth probing first. Returns how many were
+ * put in apstrFirst, best first, and flags the others in *pu32Rest; 0 means
+ * the scan should sweep all of its channels.
+ */
+static u32 smart_scan_split(struct ieee80211_channel **channels, u32 n_channels,
+			    struct ieee80211_channel **apstrFirst, u32 *pu32Rest)
+{
+	u32 au32Idx[SMART_SCAN_MAX_FIRST];
+	u32 n_first = 0;
+	u32 i, j;
+
+	*pu32Rest = 0;
+	if (n_channels <= SMART_SCAN_MAX_FIRST || n_channels > SMART_SCAN_MAX_REQ)
+		return 0;
+
+	if (++u32SmartScanCount % SMART_SCAN_FULL_EVERY == 0) {
+		for (i = 0; i <= SMART_SCAN_MAX_CHNL; i++)
+			gau8ChnlScore[i] >>= 1;
+		return 0;
+	}
+
+	for (i = 0; i < n_channels; i++) {
+		u8 u8Score = smart_scan_score(channels[i]);
+
+		if (u8Score == 0)
+			continue;
+		/* Insert by score, dropping the lowest once the list is full */
+		j = (n_first < SMART_SCAN_MAX_FIRST) ? n_first++ : SMART_SCAN_MAX_FIRST;
+		while (j > 0 && smart_scan_score(channels[au32Idx[j - 1]]) < u8Score) {
+			if (j < SMART_SCAN_MAX_FIRST)
+				au32Idx[j] = au32Idx[j - 1];
+			j--;
+		}
+		if (j < SMART_SCAN_MAX_FIRST)
+			au32Idx[j] = i;
+	}
+	if (n_first == 0)
+		return 0;
+
+	for (i = 0; i < n_channels; i++)
+		*pu32Rest |= BIT(i);
+	for (i = 0; i < n_first; i++) {
+		apstrFirst[i] = channels[au32Idx[i]];
+		*pu32Rest &= ~BIT(au32Idx[i]);
+	}
+	return n_first;
+}
+
+static bool smart_scan_directed(struct cfg80211_ssid *ssids, int n_ssids)
 {
-	struct WILC_WFI_priv *priv;
 	int i;
 
-	priv = (struct WILC_WFI_priv *)pUserVoid;
+	for (i = 0; i < n_ssids; i++) {
+		if (ssids[i].ssid_len)
+			return true;
+	}
+	return false;
+}
+
+static bool smart_scan_wanted(struct cfg80211_ssid *ssids, int n_ssids,
+			      struct tstrNetworkInfo *pstrNetworkInfo)
+{
+	int i;
+
+	for (i = 0; i < n_ssids; i++) {
+		if (ssids[i].ssid_len && ssids[i].ssid_len == pstrNetworkInfo->u8SsidLen &&
+		    memcmp(ssids[i].ssid, pstrNetworkInfo->au8ssid, ssids[i].ssid_len) == 0)
+			return true;
+	}
+	return false;
+}
+
+/* First element with the given ID (and vendor OUI and type), or NULL */
+static const u8 *shadow_find_ie(const u8 *pu8IEs, u16 u16IEsLen, u8 u8Id,
+				const u8 *pu8Oui)
+{
+	u16 u16Index = 0;
+
+	while ((u16Index + 2) <= u16IEsLen) {
+		u8 u8Len = pu8IEs[u16Index + 1];
+
+		if ((u16Index + 2 + u8Len) > u16IEsLen)
+			break;
+		if (pu8IEs[u16Index] == u8Id &&
+		    (pu8Oui == NULL ||
+		     (u8Len >= 4 && memcmp(&pu8IEs[u16Index + 2], pu8Oui, 4) == 0)))
+			return &pu8IEs[u16Index];
+		u16Index += 2 + u8Len;
+	}
+	return NULL;
+}
+
+static bool shadow_ie_changed(struct tstrNetworkInfo *pstrOld,
+			      struct tstrNetworkInfo *pstrNew,
+			      u8 u8Id, const u8 *pu8Oui)
+{
+	const u8 *pu8Old = shadow_find_ie(pstrOld->pu8IEs, pstrOld->u16IEsLen, u8Id, pu8Oui);
+	const u8 *pu8New = shadow_find_ie(pstrNew->pu8IEs, pstrNew->u16IEsLen, u8Id, pu8Oui);
+
+	if (pu8Old == NULL || pu8New == NULL)
+		return pu8Old != pu8New;
+	return pu8Old[1] != pu8New[1] || memcmp(pu8Old, pu8New, pu8Old[1] + 2);
+}
+
+/*
+ * Whether a new sighting changes what cfg80211 was told. Only fields that
+ * are stable from beacon to beacon count: TIM/DTIM counts, TSF and the
+ * like change every time and are only refreshed on the periodic re-inform.
+ * Called with gsShadowLock held.
+ */
+static bool shadow_changed(struct tstrShadowEntry *pstrEntry,
+			   struct tstrNetworkInfo *pstrNetworkInfo)
+{
+	struct tstrNetworkInfo *pstrShadow = &pstrEntry->strNetworkInfo;
+
+	return pstrShadow->u8SsidLen != pstrNetworkInfo->u8SsidLen ||
+	       memcmp(pstrShadow->au8ssid, pstrNetworkInfo->au8ssid, pstrNetworkInfo->u8SsidLen) ||
+	       pstrShadow->u16CapInfo != pstrNetworkInfo->u16CapInfo ||
+	       pstrShadow->u8channel != pstrNetworkInfo->u8channel ||
+	       pstrShadow->u16BeaconPeriod != pstrNetworkInfo->u16BeaconPeriod ||
+	       shadow_ie_changed(pstrShadow, pstrNetworkInfo, WLAN_EID_RSN, NULL) ||
+	       shadow_ie_changed(pstrShadow, pstrNetworkInfo, WLAN_EID_VENDOR_SPECIFIC, au8WpaOui);
+}
+
+/* Called with gsShadowLock held */
+static void shadow_touch(struct tstrShadowEntry *pstrEntry)
+{
+	pstrEntry->strNetworkInfo.u32TimeRcvdInScan = jiffies;
+	list_move_tail(&pstrEntry->strAgeNode, &gstrShadowAgeList);
+}
+
+/* Called with gsShadowLock held */
+static void shadow_free_entry(struct tstrShadowEntry *pstrEntry)
+{
+	hlist_del(&pstrEntry->strHashNode);
+	list_del(&pstrEntry->strAgeNode);
+	u32ShadowBytes -= sizeof(*pstrEntry) + pstrEntry->u16IEsCap;
+	u32LastScannedNtwrksCountShadow--;
+
+	kfree(pstrEntry->strNetworkInfo.pu8IEs);
+	host_int_freeJoinParams(pstrEntry->strNetworkInfo.pJoinParams);
+	kfree(pstrEntry);
+}
+
+void clear_shadow_scan(void *pUserVoid)
+{
+	struct tstrShadowEntry *pstrEntry, *pstrTmp;
+
 	if (op_ifcs == 0) {
 		del_timer_sync(&hAgingTimer);
 		PRINT_D(CFG80211_DBG, "destroy aging timer\n");
 
-		for (i = 0; i < u32LastScannedNtwrksCountShadow; i++) {
-			if (NULL != astrLastScannedNtwrksShadow[u32LastScannedNtwrksCountShadow].pu8IEs) {
-				kfree(astrLastScannedNtwrksShadow[i].pu8IEs);
-				astrLastScannedNtwrksShadow[u32LastScannedNtwrksCountShadow].pu8IEs = NULL;
-			}
+		spin_lock_bh(&gsShadowLock);
+		list_for_each_entry_safe(pstrEntry, pstrTmp, &gstrShadowAgeList, strAgeNode)
+			shadow_free_entry(pstrEntry);
+		spin_unlock_bh(&gsShadowLock);
 
-			host_int_freeJoinParams(astrLastScannedNtwrksShadow[i].pJoinParams);
-			astrLastScannedNtwrksShadow[i].pJoinParams = NULL;
-		}
-		u32LastScannedNtwrksCountShadow = 0;
+		debugfs_remove_recursive(shadow_debugfs_dir);
+		shadow_debugfs_dir = NULL;
 	}
 }
 
-uint32_t get_rssi_avg(struct tstrNetworkInfo *pstrNetworkInfo)
+static void rssi_add(struct tstrRSSI *pstrRssi, s8 s8Rssi)
+{
+	pstrRssi->as8RSSI[pstrRssi->u8Index++] = s8Rssi;
+	if (pstrRssi->u8Index == NUM_RSSI) {
+		pstrRssi->u8Index = 0;
+		pstrRssi->u8Full = 1;
+	}
+}
+
+static int rssi_avg(struct tstrRSSI *pstrRssi)
 {
 	uint8_t i;
 	int rssi_v = 0;
-	uint8_t num_rssi = (pstrNetworkInfo->strRssi.u8Full) ? NUM_RSSI : (pstrNetworkInfo->strRssi.u8Index);
+	uint8_t num_rssi = (pstrRssi->u8Full) ? NUM_RSSI : (pstrRssi->u8Index);
+
+	if (num_rssi == 0)
+		return 0;
 
 	for (i = 0; i < num_rssi; i++)
-		rssi_v += pstrNetworkInfo->strRssi.as8RSSI[i];
+		rssi_v += pstrRssi->as8RSSI[i];
 
 	rssi_v /= num_rssi;
 	return rssi_v;
 }
 
+uint32_t get_rssi_avg(struct tstrNetworkInfo *pstrNetworkInfo)
+{
+	return rssi_avg(&pstrNetworkInfo->strRssi);
+}
+
+/*
+ * Fills the report of an entry, except its IEs, and counts the entry as
+ * informed. Called with gsShadowLock held.
+ */
+static void shadow_claim(struct tstrShadowEntry *pstrEntry,
+			 struct tstrShadowReport *pstrReport)
+{
+	struct tstrNetworkInfo *pstrNetworkInfo = &pstrEntry->strNetworkInfo;
+
+	memcpy(pstrReport->au8bssid, pstrNetworkInfo->au8bssid, ETH_ALEN);
+	pstrReport->u8channel = pstrNetworkInfo->u8channel;
+	pstrReport->u16CapInfo = pstrNetworkInfo->u16CapInfo;
+	pstrReport->u16BeaconPeriod = pstrNetworkInfo->u16BeaconPeriod;
+	pstrReport->u16IEsLen = pstrNetworkInfo->u16IEsLen;
+	pstrReport->s32Rssi = get_rssi_avg(pstrNetworkInfo);
+	pstrReport->u64Tsf = pstrNetworkInfo->u64Tsf;
+
+	pstrEntry->bDirty = false;
+	pstrEntry->ulInformed = jiffies;
+	pstrEntry->s32InformedRssi = pstrReport->s32Rssi;
+}
+
+/* Not under gsShadowLock: cfg80211 allocates with GFP_KERNEL */
+static void shadow_inform(struct wiphy *wiphy,
+			  const struct tstrShadowReport *pstrReport)
+{
+	struct cfg80211_bss *bss = NULL;
+	struct ieee80211_channel *channel;
+	signed int s32Freq;
+
+	s32Freq = ieee80211_channel_to_frequency((signed int)pstrReport->u8channel, IEEE80211_BAND_2GHZ);
+	channel = ieee80211_get_channel(wiphy, s32Freq);
+	bss = cfg80211_inform_bss(wiphy, channel, pstrReport->au8bssid, pstrReport->u64Tsf, pstrReport->u16CapInfo,
+				  pstrReport->u16BeaconPeriod, pstrReport->pu8IEs,
+				  (size_t)pstrReport->u16IEsLen, (((signed int)pstrReport->s32Rssi) * 100), GFP_KERNEL);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 9, 0)
+	cfg80211_put_bss(wiphy, bss);
+#else
+	cfg80211_put_bss(bss);
+#endif
+}
+
+/* Called with gsShadowLock held */
+static bool shadow_wants_inform(struct tstrShadowEntry *pstrEntry, uint8_t all,
+				bool bDirectScan, unsigned long now)
+{
+	if (!all && !pstrEntry->bDirty &&
+	    !time_after(now, pstrEntry->ulInformed + SHADOW_REINFORM_TIME))
+		return false;
+
+	return (memcmp("DIRECT-", pstrEntry->strNetworkInfo.au8ssid, 7) || bDirectScan);
+}
+
+/*
+ * Informs cfg80211 of the cached networks. Unless all is set, only those
+ * that changed since they were last reported, or that were reported long
+ * enough ago for cfg80211 to be close to dropping them, are sent again.
+ * The entries are copied out under the lock and reported after dropping
+ * it; entries that no longer fit the copy stay dirty for the next pass.
+ */
 void refresh_scan(void *pUserVoid, uint8_t all, bool bDirectScan)
 {
 	struct WILC_WFI_priv *priv;
 	struct wiphy *wiphy;
-	struct cfg80211_bss *bss = NULL;
-	int i;
-	int rssi = 0;
+	struct tstrShadowEntry *pstrEntry;
+	struct tstrShadowReport *pstrReports;
+	unsigned long now = jiffies;
+	u32 u32Count = 0, u32Bytes = 0, n = 0;
+	u8 *pu8IEs;
+	u32 i;
 
 	priv = (struct WILC_WFI_priv *)pUserVoid;
 	wiphy = priv->dev->ieee80211_ptr->wiphy;
 
-	for (i = 0; i < u32LastScannedNtwrksCountShadow; i++) {
-		struct tstrNetworkInfo *pstrNetworkInfo;
+	spin_lock_bh(&gsShadowLock);
+	list_for_each_entry(pstrEntry, &gstrShadowAgeList, strAgeNode) {
+		if (shadow_wants_inform(pstrEntry, all, bDirectScan, now)) {
+			u32Count++;
+			u32Bytes += pstrEntry->strNetworkInfo.u16IEsLen;
+		}
+	}
+	spin_unlock_bh(&gsShadowLock);
 
-		pstrNetworkInfo = &astrLastScannedNtwrksShadow[i];
+	if (u32Count == 0)
+		return;
 
-		if ((!pstrNetworkInfo->u8Found) || all) {
-			signed int s32Freq;
-			struct ieee80211_channel *channel;
+	pstrReports = kmalloc(u32Count * sizeof(*pstrReports) + u32Bytes, GFP_KERNEL);
+	if (NULL == pstrReports) {
+		PRINT_ER("No memory to refresh %d networks\n", u32Count);
+		return;
+	}
+	pu8IEs = (u8 *)&pstrReports[u32Count];
 
-			if (NULL != pstrNetworkInfo) {
-				s32Freq = ieee80211_channel_to_frequency((signed int)pstrNetworkInfo->u8channel, IEEE80211_BAND_2GHZ);
-				channel = ieee80211_get_channel(wiphy, s32Freq);
-				rssi = get_rssi_avg(pstrNetworkInfo);
-				if (memcmp("DIRECT-", pstrNetworkInfo->au8ssid, 7) || bDirectScan) {
-					bss = cfg80211_inform_bss(wiphy, channel, pstrNetworkInfo->au8bssid, pstrNetworkInfo->u64Tsf, pstrNetworkInfo->u16CapInfo,
-								  pstrNetworkInfo->u16BeaconPeriod, (const u8 *)pstrNetworkInfo->pu8IEs,
-								  (size_t)pstrNetworkInfo->u16IEsLen, (((signed int)rssi) * 100), GFP_KERNEL);
-				#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 9, 0)
-					cfg80211_put_bss(wiphy, bss);
-				#else
-					cfg80211_put_bss(bss);
-				#endif
-				}
-			}
-		}
+	spin_lock_bh(&gsShadowLock);
+	list_for_each_entry(pstrEntry, &gstrShadowAgeList, strAgeNode) {
+		if (n == u32Count)
+			break;
+		if (!shadow_wants_inform(pstrEntry, all, bDirectScan, now) ||
+		    pstrEntry->strNetworkInfo.u16IEsLen > u32Bytes)
+			continue;
+
+		shadow_claim(pstrEntry, &pstrReports[n]);
+		memcpy(pu8IEs, pstrEntry->strNetworkInfo.pu8IEs, pstrReports[n].u16IEsLen);
+		pstrReports[n].pu8IEs = pu8IEs;
+		pu8IEs += pstrReports[n].u16IEsLen;
+		u32Bytes -= pstrReports[n].u16IEsLen;
+		n++;
 	}
+	spin_unlock_bh(&gsShadowLock);
+
+	for (i = 0; i < n; i++)
+		shadow_inform(wiphy, &pstrReports[i]);
+	kfree(pstrReports);
 }
 
 void reset_shadow_found(void *pUserVoid)
 {
-	struct WILC_WFI_priv *priv;
-	int i;
+	struct tstrShadowEntry *pstrEntry;
 
-	priv = (struct WILC_WFI_priv *)pUserVoid;
-	for (i = 0; i < u32LastScannedNtwrksCountShadow; i++)
-		astrLastScannedNtwrksShadow[i].u8Found = 0;
+	spin_lock_bh(&gsShadowLock);
+	list_for_each_entry(pstrEntry, &gstrShadowAgeList, strAgeNode)
+		pstrEntry->strNetworkInfo.u8Found = 0;
+	spin_unlock_bh(&gsShadowLock);
 }
 
 void update_scan_time(void *pUserVoid)
 {
-	struct WILC_WFI_priv *priv;
-	int i;
+	struct tstrShadowEntry *pstrEntry;
 
-	priv = (struct WILC_WFI_priv *)pUserVoid;
-	for (i = 0; i < u32LastScannedNtwrksCountShadow; i++)
-		astrLastScannedNtwrksShadow[i].u32TimeRcvdInScan = jiffies;
+	/* Every entry gets the same stamp, so the age order stays valid */
+	spin_lock_bh(&gsShadowLock);
+	list_for_each_entry(pstrEntry, &gstrShadowAgeList, strAgeNode)
+		pstrEntry->strNetworkInfo.u32TimeRcvdInScan = jiffies;
+	spin_unlock_bh(&gsShadowLock);
 }
 
 void remove_network_from_shadow(unsigned long pUserVoid)
 {
-	struct WILC_WFI_priv *priv;
+	struct tstrShadowEntry *pstrEntry, *pstrTmp;
 	unsigned long now = jiffies;
-	int i, j;
+	unsigned int u32Count;
 
-	priv = (struct WILC_WFI_priv *)pUserVoid;
-
-	for (i = 0; i < u32LastScannedNtwrksCountShadow; i++) {
-		if (time_after(now, astrLastScannedNtwrksShadow[i].u32TimeRcvdInScan + (unsigned long)(SCAN_RESULT_EXPIRE))) {
-			PRINT_D(CFG80211_DBG, "Network expired in ScanShadow: %s\n", astrLastScannedNtwrksShadow[i].au8ssid);
-
-			if (NULL != astrLastScannedNtwrksShadow[i].pu8IEs) {
-				kfree(astrLastScannedNtwrksShadow[i].pu8IEs);
-				astrLastScannedNtwrksShadow[i].pu8IEs = NULL;
-			}
-
-			host_int_freeJoinParams(astrLastScannedNtwrksShadow[i].pJoinParams);
-
-			for (j = i; (j < u32LastScannedNtwrksCountShadow - 1); j++)
-				astrLastScannedNtwrksShadow[j] = astrLastScannedNtwrksShadow[j + 1];
+	spin_lock(&gsShadowLock);
+	list_for_each_entry_safe(pstrEntry, pstrTmp, &gstrShadowAgeList, strAgeNode) {
+		/* The list is in age order; stop at the first live entry */
+		if (!time_after(now, pstrEntry->strNetworkInfo.u32TimeRcvdInScan + (unsigned long)(SCAN_RESULT_EXPIRE)))
+			break;
 
-			u32LastScannedNtwrksCountShadow--;
-		}
+		PRINT_D(CFG80211_DBG, "Network expired in ScanShadow: %s\n", pstrEntry->strNetworkInfo.au8ssid);
+		shadow_free_entry(pstrEntry);
 	}
+	u32Count = u32LastScannedNtwrksCountShadow;
+	spin_unlock(&gsShadowLock);
 
-	PRINT_D(CFG80211_DBG, "Number of cached networks: %d\n", u32LastScannedNtwrksCountShadow);
-	if (u32LastScannedNtwrksCountShadow != 0) {
+	PRINT_D(CFG80211_DBG, "Number of cached networks: %d\n", u32Count);
+	if (u32Count != 0) {
 		hAgingTimer.data = (unsigned long)pUserVoid;
 		mod_timer(&(hAgingTimer), (jiffies + msecs_to_jiffies(AGING_TIME)));
 	} else {
@@ -265,92 +610,118 @@ void clear_duringIP(unsigned long pUserVoid)
 }
 #endif
 
-int8_t is_network_in_shadow(struct tstrNetworkInfo *pstrNetworkInfo, void *pUserVoid)
+void add_network_to_shadow(struct tstrNetworkInfo *pstrNetworkInfo, void *pUserVoid, void *pJoinParams)
 {
-	struct WILC_WFI_priv *priv;
-	int8_t state = -1;
-	int i;
+	struct WILC_WFI_priv *priv = (struct WILC_WFI_priv *)pUserVoid;
+	struct tstrShadowEntry *pstrEntry;
+	struct tstrNetworkInfo *pstrShadow;
+	struct tstrShadowReport strReport;
+	bool bInform = false;
 
-	priv = (struct WILC_WFI_priv *)pUserVoid;
+	spin_lock_bh(&gsShadowLock);
 	if (u32LastScannedNtwrksCountShadow == 0) {
 		PRINT_D(CFG80211_DBG, "Starting Aging timer\n");
 		hAgingTimer.data = (unsigned long)pUserVoid;
 		mod_timer(&(hAgingTimer), (jiffies + msecs_to_jiffies(AGING_TIME)));
-		state = -1;
-	} else {
-		/* Linear search for now */
-		for (i = 0; i < u32LastScannedNtwrksCountShadow; i++) {
-			if (memcmp(astrLastScannedNtwrksShadow[i].au8bssid,
-				   pstrNetworkInfo->au8bssid, 6) == 0) {
-				state = i;
-				break;
-			}
-		}
 	}
-	return state;
-}
 
-void add_network_to_shadow(struct tstrNetworkInfo *pstrNetworkInfo, void *pUserVoid, void *pJoinParams)
-{
-	struct WILC_WFI_priv *priv;
-	int8_t ap_found = is_network_in_shadow(pstrNetworkInfo, pUserVoid);
-	uint32_t ap_index = 0;
-	uint8_t rssi_index = 0;
-
-	priv = (struct WILC_WFI_priv *)pUserVoid;
+	pstrEntry = shadow_find(pstrNetworkInfo->au8bssid);
+	if (NULL == pstrEntry) {
+		/* Make room by dropping the networks we have not heard for longest */
+		while (!list_empty(&gstrShadowAgeList) &&
+		       (u32LastScannedNtwrksCountShadow >= MAX_NUM_SCANNED_NETWORKS_SHADOW ||
+			u32ShadowBytes + sizeof(*pstrEntry) + pstrNetworkInfo->u16IEsLen > shadow_max_bytes)) {
+			PRINT_D(CFG80211_DBG, "Shadow network reached its maximum limit\n");
+			shadow_free_entry(list_first_entry(&gstrShadowAgeList,
+							   struct tstrShadowEntry, strAgeNode));
+		}
 
-	if (u32LastScannedNtwrksCountShadow >= MAX_NUM_SCANNED_NETWORKS_SHADOW) {
-		PRINT_D(CFG80211_DBG, "Shadow network reached its maximum limit\n");
-		return;
-	}
-	if (ap_found == -1) {
-		ap_index = u32LastScannedNtwrksCountShadow;
+		pstrEntry = kzalloc(sizeof(*pstrEntry), GFP_ATOMIC);
+		if (NULL == pstrEntry) {
+			PRINT_ER("No memory for shadow network\n");
+			goto _fail_;
+		}
+		hlist_add_head(&pstrEntry->strHashNode, shadow_bucket(pstrNetworkInfo->au8bssid));
+		list_add_tail(&pstrEntry->strAgeNode, &gstrShadowAgeList);
+		u32ShadowBytes += sizeof(*pstrEntry);
 		u32LastScannedNtwrksCountShadow++;
+		pstrEntry->bDirty = true;
+		smart_scan_note(pstrNetworkInfo->u8channel, SMART_SCAN_SEEN_SCORE);
 	} else {
-		ap_index = ap_found;
+		list_move_tail(&pstrEntry->strAgeNode, &gstrShadowAgeList);
+		if (shadow_changed(pstrEntry, pstrNetworkInfo))
+			pstrEntry->bDirty = true;
 	}
-	rssi_index = astrLastScannedNtwrksShadow[ap_index].strRssi.u8Index;
-	astrLastScannedNtwrksShadow[ap_index].strRssi.as8RSSI[rssi_index++] = pstrNetworkInfo->s8rssi;
-	if (rssi_index == NUM_RSSI) {
-		rssi_index = 0;
-		astrLastScannedNtwrksShadow[ap_index].strRssi.u8Full = 1;
+	pstrShadow = &pstrEntry->strNetworkInfo;
+
+	/* Reuse the IE buffer unless the new IEs do not fit in it */
+	if (pstrNetworkInfo->u16IEsLen > pstrEntry->u16IEsCap) {
+		u8 *pu8IEs = kmalloc(pstrNetworkInfo->u16IEsLen, GFP_ATOMIC);
+
+		if (NULL == pu8IEs) {
+			PRINT_ER("No memory for shadow network IEs\n");
+			shadow_free_entry(pstrEntry);
+			goto _fail_;
+		}
+		kfree(pstrShadow->pu8IEs);
+		pstrShadow->pu8IEs = pu8IEs;
+		u32ShadowBytes += pstrNetworkInfo->u16IEsLen - pstrEntry->u16IEsCap;
+		pstrEntry->u16IEsCap = pstrNetworkInfo->u16IEsLen;
 	}
-	astrLastScannedNtwrksShadow[ap_index].strRssi.u8Index = rssi_index;
+	memcpy(pstrShadow->pu8IEs, pstrNetworkInfo->pu8IEs, pstrNetworkInfo->u16IEsLen);
+	pstrShadow->u16IEsLen = pstrNetworkInfo->u16IEsLen;
+
+	rssi_add(&pstrShadow->strRssi, pstrNetworkInfo->s8rssi);
+
+	pstrShadow->s8rssi = pstrNetworkInfo->s8rssi;
+	pstrShadow->u16CapInfo = pstrNetworkInfo->u16CapInfo;
 
-	astrLastScannedNtwrksShadow[ap_index].s8rssi = pstrNetworkInfo->s8rssi;
-	astrLastScannedNtwrksShadow[ap_index].u16CapInfo = pstrNetworkInfo->u16CapInfo;
+	pstrShadow->u8SsidLen = pstrNetworkInfo->u8SsidLen;
+	memcpy(pstrShadow->au8ssid, pstrNetworkInfo->au8ssid, pstrNetworkInfo->u8SsidLen);
 
-	astrLastScannedNtwrksShadow[ap_index].u8SsidLen = pstrNetworkInfo->u8SsidLen;
-	memcpy(astrLastScannedNtwrksShadow[ap_index].au8ssid,
-	       pstrNetworkInfo->au8ssid, pstrNetworkInfo->u8SsidLen);
+	memcpy(pstrShadow->au8bssid, pstrNetworkInfo->au8bssid, ETH_ALEN);
 
-	memcpy(astrLastScannedNtwrksShadow[ap_index].au8bssid,
-	       pstrNetworkInfo->au8bssid, ETH_ALEN);
+	pstrShadow->u16BeaconPeriod = pstrNetworkInfo->u16BeaconPeriod;
+	pstrShadow->u8DtimPeriod = pstrNetworkInfo->u8DtimPeriod;
+	pstrShadow->u8channel = pstrNetworkInfo->u8channel;
+	pstrShadow->u64Tsf = pstrNetworkInfo->u64Tsf;
 
-	astrLastScannedNtwrksShadow[ap_index].u16BeaconPeriod = pstrNetworkInfo->u16BeaconPeriod;
-	astrLastScannedNtwrksShadow[ap_index].u8DtimPeriod = pstrNetworkInfo->u8DtimPeriod;
-	astrLastScannedNtwrksShadow[ap_index].u8channel = pstrNetworkInfo->u8channel;
+	pstrShadow->u32TimeRcvdInScan = jiffies;
+	pstrShadow->u32TimeRcvdInScanCached = jiffies;
+	pstrShadow->u8Found = 1;
 
-	astrLastScannedNtwrksShadow[ap_index].u16IEsLen = pstrNetworkInfo->u16IEsLen;
-	astrLastScannedNtwrksShadow[ap_index].u64Tsf = pstrNetworkInfo->u64Tsf;
-	if (ap_found != -1)
-		kfree(astrLastScannedNtwrksShadow[ap_index].pu8IEs);
-	/* will be deallocated by the WILC_WFI_CfgScan() function */
-	astrLastScannedNtwrksShadow[ap_index].pu8IEs =
-		(u8 *)kmalloc(pstrNetworkInfo->u16IEsLen, GFP_ATOMIC);
-	memcpy(astrLastScannedNtwrksShadow[ap_index].pu8IEs,
-	       pstrNetworkInfo->pu8IEs, pstrNetworkInfo->u16IEsLen);
+	host_int_freeJoinParams(pstrShadow->pJoinParams);
+	pstrShadow->pJoinParams = pJoinParams;
 
-	astrLastScannedNtwrksShadow[ap_index].u32TimeRcvdInScan = jiffies;
-	astrLastScannedNtwrksShadow[ap_index].u32TimeRcvdInScanCached = jiffies;
-	astrLastScannedNtwrksShadow[ap_index].u8Found = 1;
+	if (abs((int)get_rssi_avg(pstrShadow) - pstrEntry->s32InformedRssi) >= SHADOW_RSSI_DELTA)
+		pstrEntry->bDirty = true;
 
-	if (ap_found != -1)
-		host_int_freeJoinParams(astrLastScannedNtwrksShadow[ap_index].pJoinParams);
+	/* Report it now rather than at scan done; P2P peers are reported by the caller */
+	if (pstrEntry->bDirty && memcmp("DIRECT-", pstrShadow->au8ssid, 7)) {
+		shadow_claim(pstrEntry, &strReport);
+		bInform = true;
+	}
+	spin_unlock_bh(&gsShadowLock);
+
+	/* The result's own IEs are what the entry now holds, and stay ours */
+	if (bInform) {
+		strReport.pu8IEs = pstrNetworkInfo->pu8IEs;
+		shadow_inform(priv->dev->ieee80211_ptr->wiphy, &strReport);
+	}
+	return;
 
-	astrLastScannedNtwrksShadow[ap_index].pJoinParams = pJoinParams;
+_fail_:
+	spin_unlock_bh(&gsShadowLock);
+	host_int_freeJoinParams(pJoinParams);
 }
 
+static bool smart_scan_widen(struct WILC_WFI_priv *priv, u32 *pu32Rest, bool bHit,
+			     struct ieee80211_channel **channels,
+			     struct cfg80211_ssid *ssids, int n_ssids,
+			     const u8 *ie, size_t ie_len,
+			     tWILCpfScanResult pfScanResult);
+static void cqm_reset(struct WILC_WFI_priv *priv);
+
 /*
  * Callback function which returns the scan results found
  * param[in] enum tenuScanEvent enuScanEvent: enum, indicating the scan event
@@ -395,6 +766,10 @@ static void CfgScanResult(enum tenuScanEvent enuScanEvent,
 						channel->center_freq, (((signed int)pstrNetworkInfo->s8rssi) * 100),
 						pstrNetworkInfo->u16CapInfo, pstrNetworkInfo->u16BeaconPeriod);
 
+				if (priv->u32SmartScanRest && NULL != priv->pstrScanReq &&
+				    smart_scan_wanted(priv->pstrScanReq->ssids, priv->pstrScanReq->n_ssids, pstrNetworkInfo))
+					priv->bSmartScanHit = true;
+
 				if (pstrNetworkInfo->bNewNetwork == true) {
 				/*TODO: mostafa: to be replaced by max_scan_ssids */
 					if (priv->u32RcvdChCount < MAX_NUM_SCANNED_NETWORKS) {
@@ -421,23 +796,32 @@ static void CfgScanResult(enum tenuScanEvent enuScanEvent,
 						PRINT_ER("Discovered networks exceeded the max limit\n");
 					}
 				} else {
-					unsigned int i;
+					struct tstrShadowEntry *pstrEntry;
+
 					/* So this network is discovered before, we'll just update its RSSI */
-					for (i = 0; i < priv->u32RcvdChCount; i++) {
-						if (memcmp(astrLastScannedNtwrksShadow[i].au8bssid, pstrNetworkInfo->au8bssid, 6) == 0)	{
-							PRINT_D(CFG80211_DBG, "Update RSSI of %s\n", astrLastScannedNtwrksShadow[i].au8ssid);
+					spin_lock_bh(&gsShadowLock);
+					pstrEntry = shadow_find(pstrNetworkInfo->au8bssid);
+					if (NULL != pstrEntry) {
+						PRINT_D(CFG80211_DBG, "Update RSSI of %s\n", pstrEntry->strNetworkInfo.au8ssid);
 
-							astrLastScannedNtwrksShadow[i].s8rssi = pstrNetworkInfo->s8rssi;
-							astrLastScannedNtwrksShadow[i].u32TimeRcvdInScan = jiffies;
-							break;
-						}
+						pstrEntry->strNetworkInfo.s8rssi = pstrNetworkInfo->s8rssi;
+						shadow_touch(pstrEntry);
 					}
+					spin_unlock_bh(&gsShadowLock);
 				}
 			}
 		} else if (enuScanEvent == SCAN_EVENT_DONE) {
+			if (NULL != priv->pstrScanReq &&
+			    smart_scan_widen(priv, &priv->u32SmartScanRest, priv->bSmartScanHit,
+					     priv->pstrScanReq->channels,
+					     priv->pstrScanReq->ssids, priv->pstrScanReq->n_ssids,
+					     (const u8 *)priv->pstrScanReq->ie, priv->pstrScanReq->ie_len,
+					     CfgScanResult))
+				return;
+
 			PRINT_D(CFG80211_DBG, "Scan Done[%p]\n", priv->dev);
 			PRINT_D(CFG80211_DBG, "Refreshing Scan ...\n");
-			refresh_scan(priv, 1, false);
+			refresh_scan(priv, 0, false);
 
 			if (priv->u32RcvdChCount > 0)
 				PRINT_D(CFG80211_DBG, "%d Network(s) found\n", priv->u32RcvdChCount);
@@ -459,6 +843,7 @@ static void CfgScanResult(enum tenuScanEvent enuScanEvent,
 			down(&(priv->hSemScanReq));
 
 			PRINT_D(CFG80211_DBG, "Scan Aborted \n");
+			priv->u32SmartScanRest = 0;
 			if (NULL != priv->pstrScanReq) {
 				update_scan_time(priv);
 				refresh_scan(priv, 1, false);
@@ -500,6 +885,241 @@ int WILC_WFI_Set_PMKSA(u8 *bssid, struct WILC_WFI_priv *priv)
 	return s32Error;
 }
 
+int connecting = 0;
+
+/*
+ * Remember the parameters of a join request so the link can be rejoined
+ * without a scan.
+ */
+static void fast_reconn_save(struct WILC_WFI_priv *priv, u8 *pu8bssid,
+			     const u8 *pu8ssid, size_t ssidLen,
+			     const u8 *pu8IEs, size_t IEsLen, u8 u8security,
+			     enum AUTHTYPE tenuAuth_type, u8 u8channel,
+			     void *pJoinParams)
+{
+	struct wilc_fast_reconn *pstrFR = &priv->strFastReconn;
+	void *pCopy;
+
+	pstrFR->bValid = false;
+	pstrFR->bInProgress = false;
+	pstrFR->bAborted = false;
+	memset(pstrFR->au8bssid, 0, ETH_ALEN);
+
+	kfree(pstrFR->pu8IEs);
+	pstrFR->pu8IEs = NULL;
+	pstrFR->IEsLen = 0;
+	if (IEsLen) {
+		pstrFR->pu8IEs = kmemdup(pu8IEs, IEsLen, GFP_KERNEL);
+		if (pstrFR->pu8IEs == NULL)
+			return;
+		pstrFR->IEsLen = IEsLen;
+	}
+
+	/* Reuses the previous copy; queued joins get their own */
+	pCopy = host_int_dupJoinParams(pJoinParams, pstrFR->pJoinParams);
+	if (pCopy == NULL)
+		return;
+	pstrFR->pJoinParams = pCopy;
+
+	memcpy(pstrFR->au8bssid, pu8bssid, ETH_ALEN);
+	memcpy(pstrFR->au8ssid, pu8ssid, ssidLen);
+	pstrFR->ssidLen = ssidLen;
+	pstrFR->u8security = u8security;
+	pstrFR->tenuAuth_type = tenuAuth_type;
+	pstrFR->u8channel = u8channel;
+	/* Allow a rejoin right away on this connection */
+	pstrFR->ulStart = jiffies - FAST_RECONN_HOLDOFF;
+	pstrFR->ulSeen = jiffies;
+}
+
+static void fast_reconn_forget(struct WILC_WFI_priv *priv)
+{
+	priv->strFastReconn.bValid = false;
+	/* A rejoin already queued is dropped when its result comes back */
+	if (priv->strFastReconn.bInProgress)
+		priv->strFastReconn.bAborted = true;
+	memset(priv->strFastReconn.au8bssid, 0, ETH_ALEN);
+}
+
+/*
+ * The cached join is only replayed if the BSS was seen on the cached
+ * channel recently, by our own join or by a scan.
+ */
+static bool fast_reconn_fresh(struct wilc_fast_reconn *pstrFR)
+{
+	struct tstrShadowEntry *pstrEntry;
+	unsigned long ulSeen = pstrFR->ulSeen;
+	bool bMoved = false;
+
+	spin_lock_bh(&gsShadowLock);
+	pstrEntry = shadow_find(pstrFR->au8bssid);
+	if (NULL != pstrEntry &&
+	    time_after(pstrEntry->strNetworkInfo.u32TimeRcvdInScanCached, ulSeen)) {
+		ulSeen = pstrEntry->strNetworkInfo.u32TimeRcvdInScanCached;
+		bMoved = (pstrEntry->strNetworkInfo.u8channel != pstrFR->u8channel);
+	}
+	spin_unlock_bh(&gsShadowLock);
+
+	return !bMoved && time_before(jiffies, ulSeen + FAST_RECONN_MAX_AGE);
+}
+
+static void CfgConnectResult(enum tenuConnDisconnEvent enuConnDisconnEvent,
+			     struct tstrConnectInfo *pstrConnectInfo,
+			     u8 u8MacStatus,
+			     struct tstrDisconnectNotifInfo *pstrDisconnectNotifInfo,
+			     void *pUserVoid);
+
+/*
+ * Called on link loss; queues a join to the last BSS. Returns true if the
+ * rejoin is under way and the loss must not be reported yet.
+ */
+static bool fast_reconn_start(struct WILC_WFI_priv *priv)
+{
+	struct wilc_fast_reconn *pstrFR = &priv->strFastReconn;
+	u8 NullBssid[ETH_ALEN] = {0};
+	signed int s32Error;
+	void *pJoinParams;
+
+	if (!fast_reconn_enable || !pstrFR->bValid || pstrFR->bInProgress)
+		return false;
+
+	/* P2P links are left to the supplicant */
+	if (priv->dev != g_linux_wlan->strInterfaceInfo[0].wilc_netdev)
+		return false;
+
+	if (time_before(jiffies, pstrFR->ulStart + FAST_RECONN_HOLDOFF)) {
+		PRINT_D(CFG80211_DBG, "Link lost again shortly after a fast reconnect\n");
+		return false;
+	}
+
+	if (!fast_reconn_fresh(pstrFR)) {
+		PRINT_D(CFG80211_DBG, "Cached join to %pM is stale, not replaying it\n",
+			pstrFR->au8bssid);
+		return false;
+	}
+
+	/* the CONNECT message owns and frees its join params */
+	pJoinParams = host_int_dupJoinParams(pstrFR->pJoinParams, NULL);
+	if (pJoinParams == NULL)
+		return false;
+
+	pstrFR->bValid = false;
+	pstrFR->bInProgress = true;
+	pstrFR->bAborted = false;
+	pstrFR->ulStart = jiffies;
+	u32FastReconnAttempts++;
+
+	PRINT_D(CFG80211_DBG, "Fast reconnect to %pM on channel %d\n",
+		pstrFR->au8bssid, pstrFR->u8channel);
+
+	u8CurrChannel = pstrFR->u8channel;
+	u8WLANChannel = pstrFR->u8channel;
+	linux_wlan_set_bssid(priv->dev, pstrFR->au8bssid);
+	WILC_WFI_Set_PMKSA(pstrFR->au8bssid, priv);
+
+	s32Error = host_int_set_join_req(priv->hWILCWFIDrv, pstrFR->au8bssid,
+					 pstrFR->au8ssid, pstrFR->ssidLen,
+					 pstrFR->pu8IEs, pstrFR->IEsLen,
+					 CfgConnectResult, (void *)priv,
+					 pstrFR->u8security,
+					 pstrFR->tenuAuth_type,
+					 pstrFR->u8channel,
+					 pJoinParams);
+	if (s32Error != ATL_SUCCESS) {
+		PRINT_ER("Fast reconnect not queued: Error(%d)\n", s32Error);
+		pstrFR->bInProgress = false;
+		u32FastReconnFailures++;
+		u8WLANChannel = INVALID_CHANNEL;
+		linux_wlan_set_bssid(priv->dev, NullBssid);
+		return false;
+	}
+
+	connecting = 1;
+	return true;
+}
+
+/*
+ * Report the outcome of a fast reconnect: a roam to the same BSS on success,
+ * the original link loss otherwise.
+ */
+static void fast_reconn_done(struct WILC_WFI_priv *priv,
+			     struct tstrConnectInfo *pstrConnectInfo,
+			     u16 u16ConnectStatus)
+{
+	struct wilc_fast_reconn *pstrFR = &priv->strFastReconn;
+	struct net_device *dev = priv->dev;
+	u8 NullBssid[ETH_ALEN] = {0};
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 0, 0)
+	struct ieee80211_channel *channel;
+	signed int s32Freq;
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 12, 0)
+	struct cfg80211_roam_info strRoamInfo;
+#endif
+
+	pstrFR->bInProgress = false;
+
+	/*
+	 * The user disconnected meanwhile: a failed rejoin completes that
+	 * disconnection, a successful one is torn down by the queued
+	 * DISCONNECT, which reports it.
+	 */
+	if (pstrFR->bAborted) {
+		pstrFR->bAborted = false;
+		PRINT_D(CFG80211_DBG, "Fast reconnect aborted by disconnect\n");
+		if (u16ConnectStatus != WLAN_STATUS_SUCCESS)
+			cfg80211_disconnected(dev, pstrFR->u16Reason, NULL, 0, GFP_KERNEL);
+		return;
+	}
+
+	if (u16ConnectStatus != WLAN_STATUS_SUCCESS) {
+		u32FastReconnFailures++;
+		PRINT_D(CFG80211_DBG, "Fast reconnect failed, reporting the link loss\n");
+		u8WLANChannel = INVALID_CHANNEL;
+		linux_wlan_set_bssid(dev, NullBssid);
+		cfg80211_disconnected(dev, pstrFR->u16Reason, NULL, 0, GFP_KERNEL);
+		return;
+	}
+
+	u32FastReconnSuccesses++;
+	u32FastReconnLatencyMs = jiffies_to_msecs(jiffies - pstrFR->ulStart);
+	pstrFR->bValid = true;
+	pstrFR->ulSeen = jiffies;
+	PRINT_D(CFG80211_DBG, "Fast reconnect done in %u ms\n", u32FastReconnLatencyMs);
+
+#ifdef DISABLE_PWRSAVE_AND_SCAN_DURING_IP
+	/* The IP configuration survives a roam, so no address is awaited */
+	g_obtainingIP = false;
+	if (bEnablePS)
+		host_int_set_power_mgmt(priv->hWILCWFIDrv, 1, 0);
+#endif
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 0, 0)
+	s32Freq = ieee80211_channel_to_frequency(pstrFR->u8channel, IEEE80211_BAND_2GHZ);
+	channel = ieee80211_get_channel(priv->dev->ieee80211_ptr->wiphy, s32Freq);
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 12, 0)
+	memset(&strRoamInfo, 0, sizeof(strRoamInfo));
+	strRoamInfo.channel = channel;
+	strRoamInfo.bssid = pstrConnectInfo->au8bssid;
+	strRoamInfo.req_ie = pstrConnectInfo->pu8ReqIEs;
+	strRoamInfo.req_ie_len = pstrConnectInfo->ReqIEsLen;
+	strRoamInfo.resp_ie = pstrConnectInfo->pu8RespIEs;
+	strRoamInfo.resp_ie_len = pstrConnectInfo->u16RespIEsLen;
+	cfg80211_roamed(dev, &strRoamInfo, GFP_KERNEL);
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(3, 0, 0)
+	cfg80211_roamed(dev, channel, pstrConnectInfo->au8bssid,
+			pstrConnectInfo->pu8ReqIEs, pstrConnectInfo->ReqIEsLen,
+			pstrConnectInfo->pu8RespIEs, pstrConnectInfo->u16RespIEsLen,
+			GFP_KERNEL);
+#else
+	cfg80211_roamed(dev, pstrConnectInfo->au8bssid,
+			pstrConnectInfo->pu8ReqIEs, pstrConnectInfo->ReqIEsLen,
+			pstrConnectInfo->pu8RespIEs, pstrConnectInfo->u16RespIEsLen,
+			GFP_KERNEL);
+#endif
+}
+
 /*
  * param[in] enum tenuConnDisconnEvent enuConnDisconnEvent: Type of connection
  * response either connection response or disconnection notification.
@@ -509,8 +1129,6 @@ int WILC_WFI_Set_PMKSA(u8 *bssid, struct WILC_WFI_priv *priv)
  * Notification
  * void* pUserVoid: Private data associated with wireless interface
  */
-int connecting = 0;
-
 static void CfgConnectResult(enum tenuConnDisconnEvent enuConnDisconnEvent,
 			     struct tstrConnectInfo *pstrConnectInfo,
 			     u8 u8MacStatus,
@@ -563,7 +1181,7 @@ static void CfgConnectResult(enum tenuConnDisconnEvent enuConnDisconnEvent,
 
 		if (u16ConnectStatus == WLAN_STATUS_SUCCESS) {
 			bool bNeedScanRefresh = false;
-			unsigned int i;
+			struct tstrShadowEntry *pstrEntry;
 
 			PRINT_INFO(CFG80211_DBG, "Connection Successful:: BSSID: %x%x%x%x%x%x\n", pstrConnectInfo->au8bssid[0],
 				   pstrConnectInfo->au8bssid[1], pstrConnectInfo->au8bssid[2], pstrConnectInfo->au8bssid[3], pstrConnectInfo->au8bssid[4], pstrConnectInfo->au8bssid[5]);
@@ -574,19 +1192,15 @@ static void CfgConnectResult(enum tenuConnDisconnEvent enuConnDisconnEvent,
 		 * cfg80211_inform_bss() with the last Scan results before calling cfg80211_connect_result() to avoid 
 		 * Linux kernel warning generated at the nl80211 layer
 		 */
-			for (i = 0; i < u32LastScannedNtwrksCountShadow; i++) {
-				if (memcmp(astrLastScannedNtwrksShadow[i].au8bssid,
-					   pstrConnectInfo->au8bssid, ETH_ALEN) == 0) {
-					unsigned long now = jiffies;
-
-					if (time_after(now,
-						       astrLastScannedNtwrksShadow[i].u32TimeRcvdInScanCached + (unsigned long)(nl80211_SCAN_RESULT_EXPIRE - (1 * HZ)))) {
-						bNeedScanRefresh = true;
-					}
-
-					break;
-				}
-			}
+			spin_lock_bh(&gsShadowLock);
+			pstrEntry = shadow_find(pstrConnectInfo->au8bssid);
+			if (NULL != pstrEntry)
+				smart_scan_note(pstrEntry->strNetworkInfo.u8channel, SMART_SCAN_CONN_SCORE);
+			if (NULL != pstrEntry &&
+			    time_after(jiffies,
+				       pstrEntry->strNetworkInfo.u32TimeRcvdInScanCached + (unsigned long)(nl80211_SCAN_RESULT_EXPIRE - (1 * HZ))))
+				bNeedScanRefresh = true;
+			spin_unlock_bh(&gsShadowLock);
 
 			if (bNeedScanRefresh) {
 				refresh_scan(priv, 1, true);
@@ -596,6 +1210,20 @@ static void CfgConnectResult(enum tenuConnDisconnEvent enuConnDisconnEvent,
 		PRINT_INFO(CFG80211_DBG, "Association request info elements length = %d\n", pstrConnectInfo->ReqIEsLen);
 		PRINT_INFO(CFG80211_DBG, "Association response info elements length = %d\n", pstrConnectInfo->u16RespIEsLen);
 
+		cqm_reset(priv);
+
+		if (priv->strFastReconn.bInProgress) {
+			fast_reconn_done(priv, pstrConnectInfo, u16ConnectStatus);
+			return;
+		}
+
+		/* Only a join that went through is worth replaying */
+		priv->strFastReconn.bValid = (u16ConnectStatus == WLAN_STATUS_SUCCESS) &&
+					     !memcmp(priv->strFastReconn.au8bssid,
+						     pstrConnectInfo->au8bssid, ETH_ALEN);
+		if (priv->strFastReconn.bValid)
+			priv->strFastReconn.ulSeen = jiffies;
+
 		cfg80211_connect_result(dev, pstrConnectInfo->au8bssid,
 					pstrConnectInfo->pu8ReqIEs, pstrConnectInfo->ReqIEsLen,
 					pstrConnectInfo->pu8RespIEs, pstrConnectInfo->u16RespIEsLen,
@@ -634,6 +1262,12 @@ static void CfgConnectResult(enum tenuConnDisconnEvent enuConnDisconnEvent,
 		else if ((!pstrWFIDrv->IFC_UP) && (dev == g_linux_wlan->strInterfaceInfo[1].wilc_netdev))
 			pstrDisconnectNotifInfo->u16reason = 1;
 
+		priv->strFastReconn.u16Reason = pstrDisconnectNotifInfo->u16reason;
+		/* the loss is handled here, the recovery need not rejoin */
+		priv->strFastReconn.bResume = false;
+		if (fast_reconn_start(priv))
+			return;
+
 		cfg80211_disconnected(dev, pstrDisconnectNotifInfo->u16reason, pstrDisconnectNotifInfo->ie,
 				      pstrDisconnectNotifInfo->ie_len, GFP_KERNEL);
 	}
@@ -679,6 +1313,99 @@ static int WILC_WFI_CfgSetChannel(struct wiphy *wiphy,
 	return s32Error;
 }
 
+/*
+ * Hands a scan over the given channels and (hidden) SSIDs to the host
+ * interface. Shared by the user scan and the scheduled scan.
+ */
+static signed int wilc_scan_trigger(struct WILC_WFI_priv *priv,
+				    struct ieee80211_channel **channels, u32 n_channels,
+				    struct cfg80211_ssid *ssids, int n_ssids,
+				    const u8 *ie, size_t ie_len,
+				    tWILCpfScanResult pfScanResult)
+{
+	u8 au8ScanChanList[MAX_NUM_SCANNED_NETWORKS];
+	struct tstrHiddenNetwork strHiddenNetwork;
+	unsigned int i;
+
+	/* TODO: mostafa: to be replaced by max_scan_ssids */
+	if (n_channels > MAX_NUM_SCANNED_NETWORKS) {
+		PRINT_ER("Requested num of scanned channels is greater than the max, supported channels\n");
+		return ATL_FAIL;
+	}
+
+	for (i = 0; i < n_channels; i++) {
+		au8ScanChanList[i] = (u8)ieee80211_frequency_to_channel(channels[i]->center_freq);
+		PRINT_INFO(CFG80211_DBG, "ScanChannel List[%d] = %d,", i, au8ScanChanList[i]);
+	}
+
+	PRINT_D(CFG80211_DBG, "Requested num of scan channel %d\n", n_channels);
+	PRINT_D(CFG80211_DBG, "Scan Request IE len =  %d\n", ie_len);
+	PRINT_D(CFG80211_DBG, "Number of SSIDs %d\n", n_ssids);
+
+	if (n_ssids < 1) {
+		PRINT_D(CFG80211_DBG, "Trigger Scan Request\n");
+		return host_int_scan(priv->hWILCWFIDrv, USER_SCAN, ACTIVE_SCAN,
+				     au8ScanChanList, n_channels, ie, ie_len,
+				     pfScanResult, (void *)priv, NULL);
+	}
+
+	strHiddenNetwork.pstrHiddenNetworkInfo = kmalloc(n_ssids * sizeof(struct tstrHiddenNetworkInfo), GFP_ATOMIC);
+	if (NULL == strHiddenNetwork.pstrHiddenNetworkInfo)
+		return ATL_NO_MEM;
+	strHiddenNetwork.u8ssidnum = 0;
+
+	for (i = 0; i < n_ssids; i++) {
+		struct tstrHiddenNetworkInfo *pstrInfo;
+
+		if (NULL == ssids[i].ssid || ssids[i].ssid_len == 0) {
+			PRINT_D(CFG80211_DBG, "Received one NULL SSID\n");
+			continue;
+		}
+		pstrInfo = &strHiddenNetwork.pstrHiddenNetworkInfo[strHiddenNetwork.u8ssidnum];
+		pstrInfo->pu8ssid = kmalloc(ssids[i].ssid_len, GFP_ATOMIC);
+		if (NULL == pstrInfo->pu8ssid)
+			continue;
+		memcpy(pstrInfo->pu8ssid, ssids[i].ssid, ssids[i].ssid_len);
+		pstrInfo->u8ssidlen = ssids[i].ssid_len;
+		strHiddenNetwork.u8ssidnum++;
+	}
+
+	PRINT_D(CFG80211_DBG, "Trigger Scan Request\n");
+	return host_int_scan(priv->hWILCWFIDrv, USER_SCAN, ACTIVE_SCAN,
+			     au8ScanChanList, n_channels, ie, ie_len,
+			     pfScanResult, (void *)priv, &strHiddenNetwork);
+}
+
+/*
+ * Runs the second pass of a split scan over the channels the first pass
+ * skipped, unless the first pass already found what was wanted. Returns
+ * true if a pass was started and the scan is therefore not finished yet.
+ */
+static bool smart_scan_widen(struct WILC_WFI_priv *priv, u32 *pu32Rest, bool bHit,
+			     struct ieee80211_channel **channels,
+			     struct cfg80211_ssid *ssids, int n_ssids,
+			     const u8 *ie, size_t ie_len,
+			     tWILCpfScanResult pfScanResult)
+{
+	struct ieee80211_channel *apstrChnl[SMART_SCAN_MAX_REQ];
+	u32 u32Rest = *pu32Rest;
+	u32 n_channels = 0;
+	u32 i;
+
+	*pu32Rest = 0;
+	if (u32Rest == 0 || bHit)
+		return false;
+
+	for (i = 0; i < SMART_SCAN_MAX_REQ; i++) {
+		if (u32Rest & BIT(i))
+			apstrChnl[n_channels++] = channels[i];
+	}
+	PRINT_D(CFG80211_DBG, "Smart scan: widening to %d channels\n", n_channels);
+
+	return wilc_scan_trigger(priv, apstrChnl, n_channels, ssids, n_ssids,
+				 ie, ie_len, pfScanResult) == ATL_SUCCESS;
+}
+
 /*
  * Request to do a scan. If returning zero, the scan request is given the
  * driver, and will be valid until passed to cfg80211_scan_done().
@@ -693,70 +1420,484 @@ static int WILC_WFI_CfgScan(struct wiphy *wiphy, struct net_device *dev, struct
 #endif
 {
 	struct WILC_WFI_priv *priv;
-	unsigned int i;
 	signed int s32Error = ATL_SUCCESS;
-	u8 au8ScanChanList[MAX_NUM_SCANNED_NETWORKS];
-	struct tstrHiddenNetwork strHiddenNetwork;
+	struct ieee80211_channel *apstrFirst[SMART_SCAN_MAX_FIRST];
+	struct ieee80211_channel **channels = request->channels;
+	u32 n_channels = request->n_channels;
+	u32 n_first = 0;
 
 	priv = wiphy_priv(wiphy);
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(3, 6, 0)
 	PRINT_INFO(GENERIC_DBG, "Scan on netdev\n");
 #endif
+	/* A sched or roam pass owns the scan until its callback ends it */
+	if (priv->bSchedScanning || priv->bRoamScanning) {
+		PRINT_D(CFG80211_DBG, "Driver scan pass in flight, busy\n");
+		return -EBUSY;
+	}
+
 	priv->pstrScanReq = request;
 	priv->u32RcvdChCount = 0;
 
 	reset_shadow_found(priv);
 
 	priv->bCfgScanning = true;
-	/* TODO: mostafa: to be replaced by max_scan_ssids */
-	if (request->n_channels <= MAX_NUM_SCANNED_NETWORKS) {
-		for (i = 0; i < request->n_channels; i++) {
-			au8ScanChanList[i] = (u8)ieee80211_frequency_to_channel(request->channels[i]->center_freq);
-			PRINT_INFO(CFG80211_DBG, "ScanChannel List[%d] = %d,", i, au8ScanChanList[i]);
+	priv->bSmartScanHit = false;
+	priv->u32SmartScanRest = 0;
+	if (smart_scan_directed(request->ssids, request->n_ssids))
+		n_first = smart_scan_split(channels, n_channels, apstrFirst, &priv->u32SmartScanRest);
+	if (n_first) {
+		PRINT_D(CFG80211_DBG, "Smart scan: %d of %d channels first\n", n_first, n_channels);
+		channels = apstrFirst;
+		n_channels = n_first;
+	}
+
+	s32Error = wilc_scan_trigger(priv, channels, n_channels,
+				     request->ssids, request->n_ssids,
+				     (const u8 *)request->ie, request->ie_len,
+				     CfgScanResult);
+
+	if (s32Error != ATL_SUCCESS) {
+		s32Error = -EBUSY;
+		PRINT_WRN(CFG80211_DBG,"Device is busy: Error(%d)\n", s32Error);
+	}
+
+	return s32Error;
+}
+
+/* Record a result of a driver-initiated scan in the shadow */
+static void scan_result_to_shadow(struct WILC_WFI_priv *priv,
+				  struct tstrNetworkInfo *pstrNetworkInfo,
+				  void *pJoinParams)
+{
+	struct tstrShadowEntry *pstrEntry;
+
+	if (pstrNetworkInfo->bNewNetwork == true) {
+		add_network_to_shadow(pstrNetworkInfo, priv, pJoinParams);
+		return;
+	}
+
+	spin_lock_bh(&gsShadowLock);
+	pstrEntry = shadow_find(pstrNetworkInfo->au8bssid);
+	if (NULL != pstrEntry) {
+		pstrEntry->strNetworkInfo.s8rssi = pstrNetworkInfo->s8rssi;
+		shadow_touch(pstrEntry);
+	}
+	spin_unlock_bh(&gsShadowLock);
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 4, 0)
+/*
+ * Scheduled scan: the driver runs the periodic scans itself and only
+ * tells userspace when a network matching one of the request's match
+ * sets shows up, instead of userspace waking up to scan on its own.
+ */
+static bool sched_scan_match(struct cfg80211_sched_scan_request *request,
+			     struct tstrNetworkInfo *pstrNetworkInfo)
+{
+	int i;
+
+	if (request->n_match_sets == 0)
+		return true;
+
+	for (i = 0; i < request->n_match_sets; i++) {
+		struct cfg80211_match_set *pstrMatch = &request->match_sets[i];
+
+		if (pstrMatch->ssid.ssid_len &&
+		    (pstrMatch->ssid.ssid_len != pstrNetworkInfo->u8SsidLen ||
+		     memcmp(pstrMatch->ssid.ssid, pstrNetworkInfo->au8ssid, pstrMatch->ssid.ssid_len)))
+			continue;
+	#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 9, 0)
+		if (pstrMatch->rssi_thold && pstrNetworkInfo->s8rssi < pstrMatch->rssi_thold)
+			continue;
+	#endif
+		return true;
+	}
+	return false;
+}
+
+/* Delay before the next scheduled scan pass, walking the scan plans */
+static unsigned long sched_scan_next_delay(struct WILC_WFI_priv *priv)
+{
+	struct cfg80211_sched_scan_request *request = priv->pstrSchedScanReq;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 4, 0)
+	struct cfg80211_sched_scan_plan *pstrPlan = &request->scan_plans[priv->u8SchedScanPlan];
+	unsigned long ulDelay = msecs_to_jiffies(pstrPlan->interval * 1000);
+
+	if (pstrPlan->iterations && ++priv->u32SchedScanIter >= pstrPlan->iterations &&
+	    priv->u8SchedScanPlan + 1 < request->n_scan_plans) {
+		priv->u8SchedScanPlan++;
+		priv->u32SchedScanIter = 0;
+	}
+	return ulDelay;
+#else
+	return msecs_to_jiffies(request->interval);
+#endif
+}
+
+static void CfgSchedScanResult(enum tenuScanEvent enuScanEvent,
+			       struct tstrNetworkInfo *pstrNetworkInfo,
+			       void *pUserVoid,
+			       void *pJoinParams)
+{
+	struct WILC_WFI_priv *priv = (struct WILC_WFI_priv *)pUserVoid;
+	struct wiphy *wiphy = priv->dev->ieee80211_ptr->wiphy;
+	struct cfg80211_sched_scan_request *request;
+
+	/* cfg80211 frees the request once sched_scan_stop returns */
+	mutex_lock(&priv->hSchedScanLock);
+	request = priv->pstrSchedScanReq;
+
+	if (enuScanEvent == SCAN_EVENT_NETWORK_FOUND) {
+		if (NULL == pstrNetworkInfo || NULL == request) {
+			host_int_freeJoinParams(pJoinParams);
+			goto unlock;
 		}
 
-		PRINT_D(CFG80211_DBG, "Requested num of scan channel %d\n", request->n_channels);
-		PRINT_D(CFG80211_DBG, "Scan Request IE len =  %d\n", request->ie_len);
+		scan_result_to_shadow(priv, pstrNetworkInfo, pJoinParams);
 
-		PRINT_D(CFG80211_DBG, "Number of SSIDs %d\n", request->n_ssids);
+		if (!priv->bSchedScanMatched && sched_scan_match(request, pstrNetworkInfo)) {
+			PRINT_D(CFG80211_DBG, "Sched scan matched %s\n", pstrNetworkInfo->au8ssid);
+			priv->bSchedScanMatched = true;
+		}
+		goto unlock;
+	}
 
-		if (request->n_ssids >= 1) {
-			strHiddenNetwork.pstrHiddenNetworkInfo = kmalloc(request->n_ssids * sizeof(struct tstrHiddenNetwork), GFP_ATOMIC);
-			strHiddenNetwork.u8ssidnum = request->n_ssids;
+	/* SCAN_EVENT_DONE or SCAN_EVENT_ABORTED */
+	if (enuScanEvent == SCAN_EVENT_DONE && NULL != request &&
+	    smart_scan_widen(priv, &priv->u32SchedScanRest, priv->bSchedScanMatched,
+			     request->channels, request->ssids, request->n_ssids,
+			     (const u8 *)request->ie, request->ie_len,
+			     CfgSchedScanResult))
+		goto unlock;
+
+	priv->u32SchedScanRest = 0;
+	priv->bSchedScanning = false;
+	if (NULL == request)
+		goto unlock;
+
+	if (enuScanEvent == SCAN_EVENT_DONE && priv->bSchedScanMatched) {
+		refresh_scan(priv, 0, false);
+	#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 12, 0)
+		cfg80211_sched_scan_results(wiphy, request->reqid);
+	#else
+		cfg80211_sched_scan_results(wiphy);
+	#endif
+	}
 
-			for (i = 0; i < request->n_ssids; i++) {
-				if (NULL != request->ssids[i].ssid && request->ssids[i].ssid_len != 0) {
-					strHiddenNetwork.pstrHiddenNetworkInfo[i].pu8ssid = kmalloc(request->ssids[i].ssid_len, GFP_ATOMIC);
-					memcpy(strHiddenNetwork.pstrHiddenNetworkInfo[i].pu8ssid, request->ssids[i].ssid, request->ssids[i].ssid_len);
-					strHiddenNetwork.pstrHiddenNetworkInfo[i].u8ssidlen = request->ssids[i].ssid_len;
-				} else {
-					PRINT_D(CFG80211_DBG, "Received one NULL SSID\n");
-					strHiddenNetwork.u8ssidnum -= 1;
-				}
+	/* An aborted pass (e.g. scan timeout) still counts; keep the schedule */
+	schedule_delayed_work(&priv->strSchedScanWork, sched_scan_next_delay(priv));
+unlock:
+	mutex_unlock(&priv->hSchedScanLock);
+}
+
+static void sched_scan_work(struct work_struct *work)
+{
+	struct WILC_WFI_priv *priv = container_of(to_delayed_work(work),
+						  struct WILC_WFI_priv,
+						  strSchedScanWork);
+	struct cfg80211_sched_scan_request *request;
+	struct ieee80211_channel *apstrFirst[SMART_SCAN_MAX_FIRST];
+	struct ieee80211_channel **channels;
+	u32 n_channels;
+	u32 n_first;
+
+	mutex_lock(&priv->hSchedScanLock);
+	request = priv->pstrSchedScanReq;
+	if (NULL == request)
+		goto unlock;
+
+	/* Let a user scan or a pass still in flight finish first */
+	if (priv->bCfgScanning || priv->bSchedScanning || priv->bRoamScanning) {
+		schedule_delayed_work(&priv->strSchedScanWork, msecs_to_jiffies(SCHED_SCAN_RETRY_MS));
+		goto unlock;
+	}
+
+	channels = request->channels;
+	n_channels = request->n_channels;
+	n_first = smart_scan_split(channels, n_channels, apstrFirst, &priv->u32SchedScanRest);
+	if (n_first) {
+		channels = apstrFirst;
+		n_channels = n_first;
+	}
+
+	priv->bSchedScanMatched = false;
+	priv->bSchedScanning = true;
+	if (wilc_scan_trigger(priv, channels, n_channels,
+			      request->ssids, request->n_ssids,
+			      (const u8 *)request->ie, request->ie_len,
+			      CfgSchedScanResult) != ATL_SUCCESS) {
+		PRINT_WRN(CFG80211_DBG, "Sched scan pass could not start\n");
+		priv->u32SchedScanRest = 0;
+		priv->bSchedScanning = false;
+		schedule_delayed_work(&priv->strSchedScanWork, msecs_to_jiffies(SCHED_SCAN_RETRY_MS));
+	}
+unlock:
+	mutex_unlock(&priv->hSchedScanLock);
+}
+
+static int WILC_WFI_sched_scan_start(struct wiphy *wiphy, struct net_device *dev,
+				     struct cfg80211_sched_scan_request *request)
+{
+	struct WILC_WFI_priv *priv = wiphy_priv(wiphy);
+
+	mutex_lock(&priv->hSchedScanLock);
+	if (NULL != priv->pstrSchedScanReq) {
+		mutex_unlock(&priv->hSchedScanLock);
+		return -EBUSY;
+	}
+
+	PRINT_D(CFG80211_DBG, "Sched scan start: %d channels, %d match sets\n",
+		request->n_channels, request->n_match_sets);
+	priv->pstrSchedScanReq = request;
+	priv->u8SchedScanPlan = 0;
+	priv->u32SchedScanIter = 0;
+	schedule_delayed_work(&priv->strSchedScanWork, 0);
+	mutex_unlock(&priv->hSchedScanLock);
+
+	return 0;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 12, 0)
+static int WILC_WFI_sched_scan_stop(struct wiphy *wiphy, struct net_device *dev, u64 reqid)
+#else
+static int WILC_WFI_sched_scan_stop(struct wiphy *wiphy, struct net_device *dev)
+#endif
+{
+	struct WILC_WFI_priv *priv = wiphy_priv(wiphy);
+
+	PRINT_D(CFG80211_DBG, "Sched scan stop\n");
+	/*
+	 * Waits out a result callback or scan work still using the request;
+	 * a pass in flight then finds it gone and reports nothing.
+	 */
+	mutex_lock(&priv->hSchedScanLock);
+	priv->pstrSchedScanReq = NULL;
+	mutex_unlock(&priv->hSchedScanLock);
+	cancel_delayed_work_sync(&priv->strSchedScanWork);
+
+	return 0;
+}
+#endif
+
+/*
+ * Roaming assist. Link RSSI samples from the periodic statistics refresh
+ * are averaged over NUM_RSSI samples and checked against the CQM threshold
+ * set by userspace. While the link is below it, short scans of a few
+ * candidate channels run every ROAM_SCAN_INTERVAL, preferably while the
+ * link is idle, and a BSS of the same ESS clearly stronger than ours is
+ * reported with a fresh CQM low event so the supplicant roams before the
+ * link is lost.
+ */
+#define ROAM_SCAN_INTERVAL	(10 * HZ)
+#define ROAM_SCAN_CHNL_PER_PASS	3
+/* frames per sample below which the link counts as idle */
+#define ROAM_SCAN_IDLE_FRAMES	20
+/* busy samples tolerated before scanning anyway */
+#define ROAM_SCAN_MAX_DEFER	5
+/* dB a candidate must beat the link average by */
+#define ROAM_CANDIDATE_DELTA	8
+
+static void cqm_rssi_notify(struct WILC_WFI_priv *priv,
+			    enum nl80211_cqm_rssi_threshold_event enuEvent, s32 s32Rssi)
+{
+	PRINT_D(CFG80211_DBG, "CQM RSSI %s at %d dBm\n",
+		enuEvent == NL80211_CQM_RSSI_THRESHOLD_EVENT_LOW ? "low" : "high", s32Rssi);
+	priv->bCqmReported = true;
+	priv->enuCqmLast = enuEvent;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0)
+	cfg80211_cqm_rssi_notify(priv->dev, enuEvent, s32Rssi, GFP_KERNEL);
+#else
+	cfg80211_cqm_rssi_notify(priv->dev, enuEvent, GFP_KERNEL);
+#endif
+}
+
+static void cqm_reset(struct WILC_WFI_priv *priv)
+{
+	memset(&priv->strLinkRssi, 0, sizeof(priv->strLinkRssi));
+	priv->bCqmReported = false;
+	priv->u8RoamScanDefer = 0;
+	priv->ulRoamScanStamp = jiffies - ROAM_SCAN_INTERVAL;
+}
+
+/*
+ * Fill apstrChnl with the next few channels worth probing for a roam:
+ * those the ESS was seen on plus the historically busy ones, or all of
+ * them when nothing is known. Successive passes rotate through the set.
+ */
+static u32 roam_scan_channels(struct WILC_WFI_priv *priv, struct cfg80211_ssid *pstrSsid,
+			      struct ieee80211_channel **apstrChnl)
+{
+	struct wiphy *wiphy = priv->dev->ieee80211_ptr->wiphy;
+	struct tstrShadowEntry *pstrEntry;
+	u32 u32Mask = 0;
+	u32 n_channels = 0;
+	u32 i, u32Chnl;
+
+	spin_lock_bh(&gsShadowLock);
+	list_for_each_entry(pstrEntry, &gstrShadowAgeList, strAgeNode) {
+		struct tstrNetworkInfo *pstrNetworkInfo = &pstrEntry->strNetworkInfo;
+
+		if (pstrNetworkInfo->u8SsidLen == pstrSsid->ssid_len &&
+		    pstrNetworkInfo->u8channel <= SMART_SCAN_MAX_CHNL &&
+		    memcmp(pstrNetworkInfo->au8ssid, pstrSsid->ssid, pstrSsid->ssid_len) == 0)
+			u32Mask |= BIT(pstrNetworkInfo->u8channel);
+	}
+	spin_unlock_bh(&gsShadowLock);
+
+	for (i = 1; i <= SMART_SCAN_MAX_CHNL; i++) {
+		if (gau8ChnlScore[i])
+			u32Mask |= BIT(i);
+	}
+	if (u32Mask == 0)
+		u32Mask = BIT(SMART_SCAN_MAX_CHNL + 1) - 2;
+
+	for (i = 0; i < SMART_SCAN_MAX_CHNL && n_channels < ROAM_SCAN_CHNL_PER_PASS; i++) {
+		u32Chnl = (priv->u8RoamScanNext + i) % SMART_SCAN_MAX_CHNL + 1;
+		if (!(u32Mask & BIT(u32Chnl)))
+			continue;
+		apstrChnl[n_channels] = ieee80211_get_channel(wiphy,
+			ieee80211_channel_to_frequency(u32Chnl, IEEE80211_BAND_2GHZ));
+		if (NULL != apstrChnl[n_channels])
+			n_channels++;
+	}
+	priv->u8RoamScanNext = (priv->u8RoamScanNext + i) % SMART_SCAN_MAX_CHNL;
+
+	return n_channels;
+}
+
+/* Look for a BSS of our ESS that beats the link average by a clear margin */
+static bool roam_candidate_found(struct WILC_WFI_priv *priv, s32 s32LinkRssi)
+{
+	struct tstrShadowEntry *pstrCur, *pstrEntry;
+	bool bFound = false;
+
+	spin_lock_bh(&gsShadowLock);
+	pstrCur = shadow_find(priv->au8AssociatedBss);
+	if (NULL != pstrCur) {
+		list_for_each_entry(pstrEntry, &gstrShadowAgeList, strAgeNode) {
+			struct tstrNetworkInfo *pstrNetworkInfo = &pstrEntry->strNetworkInfo;
+
+			if (pstrEntry == pstrCur ||
+			    pstrNetworkInfo->u8SsidLen != pstrCur->strNetworkInfo.u8SsidLen ||
+			    memcmp(pstrNetworkInfo->au8ssid, pstrCur->strNetworkInfo.au8ssid,
+				   pstrNetworkInfo->u8SsidLen) ||
+			    time_before(pstrNetworkInfo->u32TimeRcvdInScan, priv->ulRoamScanStamp))
+				continue;
+			if (pstrNetworkInfo->s8rssi >= s32LinkRssi + ROAM_CANDIDATE_DELTA) {
+				PRINT_D(CFG80211_DBG, "Roam candidate %pM at %d dBm\n",
+					pstrNetworkInfo->au8bssid, pstrNetworkInfo->s8rssi);
+				bFound = true;
+				break;
 			}
-			PRINT_D(CFG80211_DBG, "Trigger Scan Request\n");
-			s32Error = host_int_scan(priv->hWILCWFIDrv, USER_SCAN, ACTIVE_SCAN,
-						 au8ScanChanList, request->n_channels,
-						 (const u8 *)request->ie, request->ie_len,
-						 CfgScanResult, (void *)priv, &strHiddenNetwork);
-		} else {
-			PRINT_D(CFG80211_DBG, "Trigger Scan Request\n");
-			s32Error = host_int_scan(priv->hWILCWFIDrv, USER_SCAN, ACTIVE_SCAN,
-						 au8ScanChanList, request->n_channels,
-						 (const u8 *)request->ie, request->ie_len,
-						 CfgScanResult, (void *)priv, NULL);
 		}
-	} else {
-		PRINT_ER("Requested num of scanned channels is greater than the max, supported channels\n");
 	}
+	spin_unlock_bh(&gsShadowLock);
 
-	if (s32Error != ATL_SUCCESS) {
-		s32Error = -EBUSY;
-		PRINT_WRN(CFG80211_DBG,"Device is busy: Error(%d)\n", s32Error);
+	return bFound;
+}
+
+static void CfgRoamScanResult(enum tenuScanEvent enuScanEvent,
+			      struct tstrNetworkInfo *pstrNetworkInfo,
+			      void *pUserVoid,
+			      void *pJoinParams)
+{
+	struct WILC_WFI_priv *priv = (struct WILC_WFI_priv *)pUserVoid;
+	s32 s32LinkRssi;
+
+	if (enuScanEvent == SCAN_EVENT_NETWORK_FOUND) {
+		if (NULL == pstrNetworkInfo) {
+			host_int_freeJoinParams(pJoinParams);
+			return;
+		}
+		scan_result_to_shadow(priv, pstrNetworkInfo, pJoinParams);
+		return;
 	}
 
-	return s32Error;
+	/* SCAN_EVENT_DONE or SCAN_EVENT_ABORTED */
+	priv->bRoamScanning = false;
+	if (enuScanEvent != SCAN_EVENT_DONE || priv->s32CqmRssiThold == 0)
+		return;
+
+	refresh_scan(priv, 0, false);
+	s32LinkRssi = rssi_avg(&priv->strLinkRssi);
+	if (s32LinkRssi < priv->s32CqmRssiThold && roam_candidate_found(priv, s32LinkRssi))
+		cqm_rssi_notify(priv, NL80211_CQM_RSSI_THRESHOLD_EVENT_LOW, s32LinkRssi);
+}
+
+static void roam_scan_start(struct WILC_WFI_priv *priv)
+{
+	struct ieee80211_channel *apstrChnl[ROAM_SCAN_CHNL_PER_PASS];
+	struct tstrShadowEntry *pstrCur;
+	struct cfg80211_ssid strSsid;
+	u32 n_channels;
+
+	memset(&strSsid, 0, sizeof(strSsid));
+	spin_lock_bh(&gsShadowLock);
+	pstrCur = shadow_find(priv->au8AssociatedBss);
+	if (NULL != pstrCur) {
+		strSsid.ssid_len = min_t(u8, pstrCur->strNetworkInfo.u8SsidLen,
+					 IEEE80211_MAX_SSID_LEN);
+		memcpy(strSsid.ssid, pstrCur->strNetworkInfo.au8ssid, strSsid.ssid_len);
+	}
+	spin_unlock_bh(&gsShadowLock);
+
+	n_channels = roam_scan_channels(priv, &strSsid, apstrChnl);
+	if (n_channels == 0)
+		return;
+
+	PRINT_D(CFG80211_DBG, "Roam scan on %d channels\n", n_channels);
+	/* Also spaces out retries when the scan cannot start or never ends */
+	priv->ulRoamScanStamp = jiffies;
+	priv->bRoamScanning = true;
+	if (wilc_scan_trigger(priv, apstrChnl, n_channels, &strSsid,
+			      strSsid.ssid_len ? 1 : 0, NULL, 0,
+			      CfgRoamScanResult) != ATL_SUCCESS) {
+		PRINT_D(CFG80211_DBG, "Roam scan could not start\n");
+		priv->bRoamScanning = false;
+	}
+}
+
+/* Called from the host interface thread with each statistics refresh */
+static void CfgRssiSample(struct tstrStatistics *pstrStatistics, void *pUserVoid)
+{
+	struct WILC_WFI_priv *priv = (struct WILC_WFI_priv *)pUserVoid;
+	u32 u32Frames, u32Delta;
+	s32 s32Rssi, s32Thold;
+
+	s32Thold = priv->s32CqmRssiThold;
+	if (s32Thold == 0)
+		return;
+
+	rssi_add(&priv->strLinkRssi, pstrStatistics->s8RSSI);
+	s32Rssi = rssi_avg(&priv->strLinkRssi);
+
+	if (s32Rssi < s32Thold - (s32)priv->u32CqmRssiHyst &&
+	    (!priv->bCqmReported || priv->enuCqmLast != NL80211_CQM_RSSI_THRESHOLD_EVENT_LOW))
+		cqm_rssi_notify(priv, NL80211_CQM_RSSI_THRESHOLD_EVENT_LOW, s32Rssi);
+	else if (s32Rssi > s32Thold + (s32)priv->u32CqmRssiHyst &&
+		 (!priv->bCqmReported || priv->enuCqmLast != NL80211_CQM_RSSI_THRESHOLD_EVENT_HIGH))
+		cqm_rssi_notify(priv, NL80211_CQM_RSSI_THRESHOLD_EVENT_HIGH, s32Rssi);
+
+	u32Frames = pstrStatistics->u32TxCount + pstrStatistics->u32RxCount;
+	u32Delta = u32Frames - priv->u32RoamFrameCount;
+	priv->u32RoamFrameCount = u32Frames;
+
+	if (s32Rssi >= s32Thold || priv->bCfgScanning || priv->bSchedScanning || priv->bRoamScanning ||
+	    time_before(jiffies, priv->ulRoamScanStamp + ROAM_SCAN_INTERVAL))
+		return;
+#ifdef DISABLE_PWRSAVE_AND_SCAN_DURING_IP
+	if (g_obtainingIP)
+		return;
+#endif
+
+	/* Wait for a gap in the traffic, but not for ever */
+	if (u32Delta > ROAM_SCAN_IDLE_FRAMES && ++priv->u8RoamScanDefer < ROAM_SCAN_MAX_DEFER)
+		return;
+	priv->u8RoamScanDefer = 0;
+
+	roam_scan_start(priv);
 }
 
 /*
@@ -779,6 +1920,10 @@ static int WILC_WFI_CfgConnect(struct wiphy *wiphy, struct net_device *dev,
 	struct WILC_WFI_priv *priv;
 	struct WILC_WFIDrv *pstrWFIDrv;
 	struct tstrNetworkInfo *pstrNetworkInfo = NULL;
+	struct tstrNetworkInfo strNetworkInfo;
+	struct tstrShadowEntry *pstrEntry;
+	unsigned int u32ShadowCount;
+	void *pJoinParams = NULL;
 
 	priv = wiphy_priv(wiphy);
 	pstrWFIDrv = (struct WILC_WFIDrv *)(priv->hWILCWFIDrv);
@@ -795,9 +1940,10 @@ static int WILC_WFI_CfgConnect(struct wiphy *wiphy, struct net_device *dev,
 #endif
 	PRINT_INFO(CFG80211_DBG, "Required SSID = %s\n , AuthType = %d\n", sme->ssid, sme->auth_type);
 
-	for (i = 0; i < u32LastScannedNtwrksCountShadow; i++) {
-		if ((sme->ssid_len == astrLastScannedNtwrksShadow[i].u8SsidLen) &&
-		    memcmp(astrLastScannedNtwrksShadow[i].au8ssid,
+	spin_lock_bh(&gsShadowLock);
+	list_for_each_entry(pstrEntry, &gstrShadowAgeList, strAgeNode) {
+		if ((sme->ssid_len == pstrEntry->strNetworkInfo.u8SsidLen) &&
+		    memcmp(pstrEntry->strNetworkInfo.au8ssid,
 			   sme->ssid,
 			   sme->ssid_len) == 0)	{
 			PRINT_INFO(CFG80211_DBG, "Network with required SSID is found %s\n", sme->ssid);
@@ -807,6 +1953,7 @@ static int WILC_WFI_CfgConnect(struct wiphy *wiphy, struct net_device *dev,
 				 * so decision of matching is done by SSID only
 				 */
 				PRINT_INFO(CFG80211_DBG, "BSSID is not passed from the user\n");
+				pstrNetworkInfo = &strNetworkInfo;
 				break;
 			} else {
 				/*
@@ -814,20 +1961,38 @@ static int WILC_WFI_CfgConnect(struct wiphy *wiphy, struct net_device *dev,
 				 * so decision of matching should consider also
 				 * this passed BSSID
 				 */
-				if (memcmp(astrLastScannedNtwrksShadow[i].au8bssid,
+				if (memcmp(pstrEntry->strNetworkInfo.au8bssid,
 					   sme->bssid,
 					   ETH_ALEN) == 0) {
 					PRINT_INFO(CFG80211_DBG, "BSSID is passed from the user and matched\n");
+					pstrNetworkInfo = &strNetworkInfo;
 					break;
 				}
 			}
 		}
 	}
+	/*
+	 * Work on a copy; the entry and its IEs and join params may be freed
+	 * by the next scan result, aging or a flush once the lock is dropped.
+	 * The join params copy is handed over to the CONNECT message.
+	 */
+	if (NULL != pstrNetworkInfo) {
+		strNetworkInfo = pstrEntry->strNetworkInfo;
+		strNetworkInfo.pu8IEs = NULL;
+		strNetworkInfo.pJoinParams = NULL;
+		pJoinParams = host_int_dupJoinParams(pstrEntry->strNetworkInfo.pJoinParams, NULL);
+	}
+	u32ShadowCount = u32LastScannedNtwrksCountShadow;
+	spin_unlock_bh(&gsShadowLock);
 
-	if (i < u32LastScannedNtwrksCountShadow) {
-		PRINT_D(CFG80211_DBG, "Required bss is in scan results\n");
+	if (NULL != pstrNetworkInfo && NULL == pJoinParams) {
+		PRINT_ER("No join params for the required bss\n");
+		s32Error = -ENOMEM;
+		goto done;
+	}
 
-		pstrNetworkInfo = &astrLastScannedNtwrksShadow[i];
+	if (NULL != pstrNetworkInfo) {
+		PRINT_D(CFG80211_DBG, "Required bss is in scan results\n");
 
 		PRINT_INFO(CFG80211_DBG, "network BSSID to be associated: %x%x%x%x%x%x\n",
 			   pstrNetworkInfo->au8bssid[0], pstrNetworkInfo->au8bssid[1],
@@ -835,7 +2000,7 @@ static int WILC_WFI_CfgConnect(struct wiphy *wiphy, struct net_device *dev,
 			   pstrNetworkInfo->au8bssid[4], pstrNetworkInfo->au8bssid[5]);
 	} else {
 		s32Error = -ENOENT;
-		if (u32LastScannedNtwrksCountShadow == 0)
+		if (u32ShadowCount == 0)
 			PRINT_D(CFG80211_DBG, "No Scan results yet\n");
 		else
 			PRINT_D(CFG80211_DBG, "Required bss not in scan results: Error(%d)\n", s32Error);
@@ -988,18 +2153,35 @@ static int WILC_WFI_CfgConnect(struct wiphy *wiphy, struct net_device *dev,
 
 	linux_wlan_set_bssid(dev, pstrNetworkInfo->au8bssid);
 
+	/*
+	 * Saved before the join is queued: the CONNECT message owns
+	 * pJoinParams once queued, and the connect result compares the
+	 * saved BSSID.
+	 */
+	if (!(u8security & WEP) && !pstrWFIDrv->u8P2PConnect)
+		fast_reconn_save(priv, pstrNetworkInfo->au8bssid, sme->ssid,
+				 sme->ssid_len, sme->ie, sme->ie_len, u8security,
+				 tenuAuth_type, pstrNetworkInfo->u8channel,
+				 pJoinParams);
+	else
+		fast_reconn_forget(priv);
+
 	s32Error = host_int_set_join_req(priv->hWILCWFIDrv, pstrNetworkInfo->au8bssid, sme->ssid,
 					 sme->ssid_len, sme->ie, sme->ie_len,
 					 CfgConnectResult, (void *)priv, u8security,
 					 tenuAuth_type, pstrNetworkInfo->u8channel,
-					 pstrNetworkInfo->pJoinParams);
+					 pJoinParams);
+	pJoinParams = NULL;
 	if (s32Error != ATL_SUCCESS) {
 		PRINT_ER("host_int_set_join_req(): Error(%d)\n", s32Error);
+		fast_reconn_forget(priv);
 		s32Error = -ENOENT;
 		goto done;
 	}
 
 done:
+	if (pJoinParams != NULL)
+		host_int_freeJoinParams(pJoinParams);
 	if(s32Error == ATL_SUCCESS)
 		connecting = 1;
 	return s32Error;
@@ -1021,6 +2203,7 @@ static int WILC_WFI_disconnect(struct wiphy *wiphy,
 
 	connecting = 0;
 	priv = wiphy_priv(wiphy);
+	fast_reconn_forget(priv);
 
 	/* Invalidate u8WLANChannel value on wlan0 disconnect */
 #ifdef WILC_P2P
@@ -2492,7 +3675,21 @@ void    WILC_WFI_frame_register(struct wiphy *wiphy,
 static int    WILC_WFI_set_cqm_rssi_config(struct wiphy *wiphy,
 					     struct net_device *dev,  s32 rssi_thold, u32 rssi_hyst)
 {
-	PRINT_D(CFG80211_DBG, "Setting CQM RSSi Function\n");
+	struct WILC_WFI_priv *priv = wiphy_priv(wiphy);
+
+	PRINT_D(CFG80211_DBG, "Setting CQM RSSI threshold %d hysteresis %d\n", rssi_thold, rssi_hyst);
+
+	/* Roaming assist is for the station link only */
+	if (dev != g_linux_wlan->strInterfaceInfo[0].wilc_netdev)
+		return -EOPNOTSUPP;
+
+	priv->s32CqmRssiThold = rssi_thold;
+	priv->u32CqmRssiHyst = rssi_hyst;
+	cqm_reset(priv);
+
+	/* A zero threshold disables the monitor */
+	host_int_set_rssi_monitor(priv->hWILCWFIDrv, rssi_thold ? CfgRssiSample : NULL, priv);
+
 	return 0;
 }
 
@@ -3328,6 +4525,10 @@ static struct cfg80211_ops WILC_WFI_cfg80211_ops = {
 	.set_channel = WILC_WFI_CfgSetChannel,
 #endif
 	.scan = WILC_WFI_CfgScan,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 4, 0)
+	.sched_scan_start = WILC_WFI_sched_scan_start,
+	.sched_scan_stop = WILC_WFI_sched_scan_stop,
+#endif
 	.connect = WILC_WFI_CfgConnect,
 	.disconnect = WILC_WFI_disconnect,
 	.add_key = WILC_WFI_add_key,
@@ -3552,6 +4753,13 @@ struct wireless_dev *WILC_WFI_WiphyRegister(struct net_device *net)
 
 	wdev->wiphy->max_scan_ie_len = 1000;
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 4, 0)
+	wdev->wiphy->flags |= WIPHY_FLAG_SUPPORTS_SCHED_SCAN;
+	wdev->wiphy->max_sched_scan_ssids = MAX_NUM_PROBED_SSID;
+	wdev->wiphy->max_match_sets = SCHED_SCAN_MAX_MATCH_SETS;
+	wdev->wiphy->max_sched_scan_ie_len = 1000;
+#endif
+
 	/*signal strength in mBm (100*dBm) */
 	wdev->wiphy->signal_type = CFG80211_SIGNAL_TYPE_MBM;
 
@@ -3612,6 +4820,28 @@ int WILC_WFI_InitHostInt(struct net_device *net)
 	priv = wdev_priv(net->ieee80211_ptr);
 	if (op_ifcs == 0) {
 		setup_timer(&(hAgingTimer), remove_network_from_shadow, 0);
+		shadow_debugfs_dir = debugfs_create_dir("wilc_scan_shadow", NULL);
+		if (!IS_ERR_OR_NULL(shadow_debugfs_dir)) {
+			debugfs_create_u32("max_bytes", S_IRUSR | S_IWUSR,
+					   shadow_debugfs_dir, &shadow_max_bytes);
+			debugfs_create_u32("bytes", S_IRUSR,
+					   shadow_debugfs_dir, &u32ShadowBytes);
+			debugfs_create_u32("entries", S_IRUSR, shadow_debugfs_dir,
+					   &u32LastScannedNtwrksCountShadow);
+		}
+		fast_reconn_debugfs_dir = debugfs_create_dir("wilc_fast_reconnect", NULL);
+		if (!IS_ERR_OR_NULL(fast_reconn_debugfs_dir)) {
+			debugfs_create_u32("enable", S_IRUSR | S_IWUSR,
+					   fast_reconn_debugfs_dir, &fast_reconn_enable);
+			debugfs_create_u32("attempts", S_IRUSR,
+					   fast_reconn_debugfs_dir, &u32FastReconnAttempts);
+			debugfs_create_u32("successes", S_IRUSR,
+					   fast_reconn_debugfs_dir, &u32FastReconnSuccesses);
+			debugfs_create_u32("failures", S_IRUSR,
+					   fast_reconn_debugfs_dir, &u32FastReconnFailures);
+			debugfs_create_u32("last_latency_ms", S_IRUSR,
+					   fast_reconn_debugfs_dir, &u32FastReconnLatencyMs);
+		}
 		#ifdef DISABLE_PWRSAVE_AND_SCAN_DURING_IP
 		setup_timer(&(hDuringIpTimer), clear_duringIP, 0);
 		#endif
@@ -3626,10 +4856,19 @@ int WILC_WFI_InitHostInt(struct net_device *net)
 	priv->bInP2PlistenState = false;
 
 	sema_init(&priv->hSemScanReq, 1);
+	priv->bRoamScanning = false;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 4, 0)
+	INIT_DELAYED_WORK(&priv->strSchedScanWork, sched_scan_work);
+	mutex_init(&priv->hSchedScanLock);
+	priv->pstrSchedScanReq = NULL;
+	priv->bSchedScanning = false;
+#endif
 	s32Error = host_int_init(&priv->hWILCWFIDrv);
 	/* s32Error = host_int_init(&priv->hWILCWFIDrv_2); */
 	if (s32Error)
 		PRINT_ER("Error while initializing hostinterface\n");
+	else if (priv->s32CqmRssiThold)
+		host_int_set_rssi_monitor(priv->hWILCWFIDrv, CfgRssiSample, priv);
 
 	return s32Error;
 }
@@ -3648,6 +4887,7 @@ int WILC_WFI_DeInitHostInt(struct net_device *net)
 	signed int s32Error = ATL_SUCCESS;
 	struct WILC_WFI_priv *priv;
 	struct perInterface_wlan *nic;
+	u8 NullBssid[ETH_ALEN] = {0};
 
 	priv = wdev_priv(net->ieee80211_ptr);
 	nic = netdev_priv(net);
@@ -3656,9 +4896,39 @@ int WILC_WFI_DeInitHostInt(struct net_device *net)
 
 	op_ifcs--;
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 4, 0)
+	/* cfg80211 stops the request itself when the interface goes down */
+	mutex_lock(&priv->hSchedScanLock);
+	priv->pstrSchedScanReq = NULL;
+	mutex_unlock(&priv->hSchedScanLock);
+	cancel_delayed_work_sync(&priv->strSchedScanWork);
+#endif
+
 	s32Error = host_int_deinit(priv->hWILCWFIDrv, net->name, nic->iftype);
 	/* s32Error = host_int_deinit(priv->hWILCWFIDrv_2); */
 
+	/* No pass can end through its callback any more */
+	priv->bSchedScanning = false;
+	priv->bRoamScanning = false;
+
+	/*
+	 * The cached join survives a close/open, only a rejoin in flight is
+	 * dropped. WILC_WFI_fast_reconn_recover() picks the link up again
+	 * after a recovery.
+	 */
+	priv->strFastReconn.bResume = priv->strFastReconn.bInProgress;
+	if (memcmp(priv->au8AssociatedBss, NullBssid, ETH_ALEN)) {
+		/* the link was up until now, the BSS is where we left it */
+		priv->strFastReconn.bResume = true;
+		priv->strFastReconn.ulSeen = jiffies;
+	}
+	priv->strFastReconn.bInProgress = false;
+	priv->strFastReconn.bAborted = false;
+	if (op_ifcs == 0) {
+		debugfs_remove_recursive(fast_reconn_debugfs_dir);
+		fast_reconn_debugfs_dir = NULL;
+	}
+
 	/* Clear the Shadow scan */
 	clear_shadow_scan(priv);
 	#ifdef DISABLE_PWRSAVE_AND_SCAN_DURING_IP
@@ -3674,6 +4944,30 @@ int WILC_WFI_DeInitHostInt(struct net_device *net)
 	return s32Error;
 }
 
+/*
+ * Called by the recovery thread once the interfaces are open again. The
+ * firmware came back without the link cfg80211 still holds, so rejoin it
+ * from the cached join or report it lost.
+ */
+void WILC_WFI_fast_reconn_recover(struct net_device *net)
+{
+	struct WILC_WFI_priv *priv = wdev_priv(net->ieee80211_ptr);
+	u8 NullBssid[ETH_ALEN] = {0};
+
+	if (!priv->strFastReconn.bResume)
+		return;
+	priv->strFastReconn.bResume = false;
+
+	memset(priv->au8AssociatedBss, 0, ETH_ALEN);
+	priv->strFastReconn.u16Reason = WLAN_REASON_UNSPECIFIED;
+	if (fast_reconn_start(priv))
+		return;
+
+	PRINT_D(CFG80211_DBG, "No rejoin after recovery, reporting the link loss\n");
+	linux_wlan_set_bssid(net, NullBssid);
+	cfg80211_disconnected(net, WLAN_REASON_UNSPECIFIED, NULL, 0, GFP_KERNEL);
+}
+
 /**
  *  @brief      WILC_WFI_WiphyFree
  *  @details    Freeing allocation of the wireless device structure
@@ -3685,6 +4979,8 @@ int WILC_WFI_DeInitHostInt(struct net_device *net)
  */
 void WILC_WFI_WiphyFree(struct net_device *net)
 {
+	struct WILC_WFI_priv *priv;
+
 	PRINT_D(CFG80211_DBG, "Unregistering wiphy\n");
 
 	if (NULL == net) {
@@ -3704,6 +5000,11 @@ void WILC_WFI_WiphyFree(struct net_device *net)
 
 	wiphy_unregister(net->ieee80211_ptr->wiphy);
 
+	priv = wiphy_priv(net->ieee80211_ptr->wiphy);
+	kfree(priv->strFastReconn.pu8IEs);
+	if (priv->strFastReconn.pJoinParams != NULL)
+		host_int_freeJoinParams(priv->strFastReconn.pJoinParams);
+
 	PRINT_D(INIT_DBG, "Freeing wiphy\n");
 	wiphy_free(net->ieee80211_ptr->wiphy);
 	kfree(net->ieee80211_ptr);
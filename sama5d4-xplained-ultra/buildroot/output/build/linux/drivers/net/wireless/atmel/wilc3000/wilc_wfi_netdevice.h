@@ -61,6 +61,7 @@
 #include "wilc_wlan.h"
 #include "wilc_wlan_if.h"
 #include <linux/wireless.h>
+#include <linux/workqueue.h>
 
 #define FLOW_CONTROL_LOWER_THRESHOLD	128
 #define FLOW_CONTROL_UPPER_THRESHOLD	256
@@ -134,6 +135,29 @@ struct wilc_buffered_eap {
 	u8 *pu8buff;
 };
 
+/* Last successful join, replayed to rejoin the same BSS on link loss */
+struct wilc_fast_reconn {
+	bool bValid;
+	bool bInProgress;
+	/* disconnected by the user while the rejoin was queued */
+	bool bAborted;
+	/* held a link when the interface was last closed */
+	bool bResume;
+	u8 au8bssid[ETH_ALEN];
+	u8 au8ssid[IEEE80211_MAX_SSID_LEN];
+	size_t ssidLen;
+	u8 *pu8IEs;
+	size_t IEsLen;
+	u8 u8security;
+	enum AUTHTYPE tenuAuth_type;
+	u8 u8channel;
+	void *pJoinParams;
+	u16 u16Reason;
+	unsigned long ulStart;
+	/* last time the BSS was known to be on u8channel */
+	unsigned long ulSeen;
+};
+
 struct WILC_WFI_priv {
 	struct wireless_dev *wdev;
 	struct cfg80211_scan_request *pstrScanReq;
@@ -143,6 +167,31 @@ struct WILC_WFI_priv {
 #endif
 	bool bCfgScanning;
 	unsigned int u32RcvdChCount;
+	/* channels still to scan after the first pass of a split scan */
+	u32 u32SmartScanRest;
+	bool bSmartScanHit;
+	/* scheduled scan */
+	struct cfg80211_sched_scan_request *pstrSchedScanReq;
+	struct delayed_work strSchedScanWork;
+	bool bSchedScanning;
+	bool bSchedScanMatched;
+	u32 u32SchedScanRest;
+	u8 u8SchedScanPlan;
+	unsigned int u32SchedScanIter;
+	/* held while the request is used, stop clears it under the lock */
+	struct mutex hSchedScanLock;
+	struct wilc_fast_reconn strFastReconn;
+	/* connection quality monitor and roaming assist */
+	s32 s32CqmRssiThold;
+	u32 u32CqmRssiHyst;
+	struct tstrRSSI strLinkRssi;
+	bool bCqmReported;
+	enum nl80211_cqm_rssi_threshold_event enuCqmLast;
+	u32 u32RoamFrameCount;
+	u8 u8RoamScanDefer;
+	u8 u8RoamScanNext;
+	unsigned long ulRoamScanStamp;
+	bool bRoamScanning;
 	u8 au8AssociatedBss[ETH_ALEN];
 	struct sta_info assoc_stainfo;
 	struct net_device_stats stats;
@@ -206,7 +255,6 @@ struct linux_wlan {
 	struct mutex rxq_cs;
 	struct mutex *hif_cs;
 	struct semaphore rxq_event;
-	struct semaphore cfg_event;
 	struct semaphore sync_event;
 	struct semaphore txq_event;
 #if (RX_BH_TYPE == RX_BH_WORK_QUEUE)
@@ -222,10 +270,15 @@ struct linux_wlan {
 	struct task_struct *txq_thread;
 	struct task_struct *wdt_thread;
 	u8 eth_src_address[NUM_CONCURRENT_IFC][6];
+	/* kept from the first open until the driver is removed */
 	const struct firmware *wilc_firmware;
 #ifdef DOWNLOAD_BT_FW
 	const struct firmware *wilc_bt_firmware;
 #endif
+	/* firmware fetch + download, run alongside the host side bring-up */
+	struct work_struct fw_dl_work;
+	struct perInterface_wlan *fw_dl_nic;
+	int fw_dl_ret;
 	struct net_device *real_ndev;
 #ifdef WILC_SDIO
 	int already_claim;
@@ -20,6 +20,8 @@
 #define WILC_WLAN_H
 
 #include "wilc_type.h"
+#include <linux/completion.h>
+#include <linux/workqueue.h>
 
 #define ISWILC3000(id)   (((id & 0xfffff000) == 0x300000) ? 1 : 0)
 
@@ -94,6 +96,8 @@ uint32_t wilc_get_chipid(uint8_t update);
 #define WILC_INTR_CLEAR			(WILC_INTR_REG_BASE + 0x30)
 #define WILC_INTR_STATUS		(WILC_INTR_REG_BASE + 0x40)
 #define WILC_VMM_TBL_SIZE		64
+/* TX aggregate limit while a higher priority bus user is waiting */
+#define WILC_TX_YIELD_SIZE		(16 * 1024)
 #define WILC_VMM_TX_TBL_BASE		(0x150400)
 #define WILC_VMM_RX_TBL_BASE		(0x150500)
 #define WILC_VMM_BASE			0x150000
@@ -119,6 +123,9 @@ uint32_t wilc_get_chipid(uint8_t update);
 	(WILC_SPI_PROTOCOL_CONFIG - WILC_SPI_REG_BASE)
 
 #define WILC_AHB_DATA_MEM_BASE		0x30000
+/* instruction RAM, firmware code and constants */
+#define WILC_AHB_IRAM_BASE		0x80000
+#define WILC_AHB_IRAM_END		0xd0000
 #define WILC_AHB_SHARE_MEM_BASE		0xd0000
 #define WILC_VMM_TBL_RX_SHADOW_BASE	WILC_AHB_SHARE_MEM_BASE
 #define WILC_VMM_TBL_RX_SHADOW_SIZE	(256)
@@ -271,6 +278,30 @@ struct wilc_cfg_rsp {
 	uint32_t seq_no;
 };
 
+/*
+ * In-flight configuration frames, matched to their response by sequence
+ * number. A request either has a waiter on done, or a callback that is
+ * run on the response or after CFG_PKTS_TIMEOUT.
+ */
+#define WILC_CFG_MAX_INFLIGHT	4
+
+#define WILC_CFG_REQ_FREE	0
+#define WILC_CFG_REQ_PENDING	1
+#define WILC_CFG_REQ_DONE	2
+#define WILC_CFG_REQ_CLAIMED	3
+
+struct wilc_cfg_req {
+	int state;
+	uint8_t seq_no;
+	int status;
+	struct completion done;
+	wilc_cfg_done_func_t func;
+	void *priv;
+	unsigned long deadline;
+	struct delayed_work timeout_work;
+	struct wilc_cfg_frame cfg;
+};
+
 struct wilc_cfg_func {
 	int (*cfg_wid_set)(uint8_t *, uint32_t, uint16_t, uint8_t *, int);
 	int (*cfg_wid_get)(uint8_t *, uint32_t, uint16_t);
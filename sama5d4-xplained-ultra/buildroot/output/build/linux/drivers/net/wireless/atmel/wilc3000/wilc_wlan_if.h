@@ -54,6 +54,7 @@ struct tx_complete_data {
 };
 
 typedef void (*wilc_tx_complete_func_t)(void *, int);
+typedef void (*wilc_cfg_done_func_t)(void *, int);
 
 struct wilc_wlan_oup {
 	int (*wlan_firmware_download)(const uint8_t *, uint32_t);
@@ -65,6 +66,7 @@ struct wilc_wlan_oup {
 	int (*bt_start)(void);
 #endif
 	int (*wlan_stop)(void);
+	void (*wlan_fw_snapshot)(const uint8_t *, uint32_t);
 	int (*wlan_add_to_tx_que)(void *, uint8_t *,
 				  uint32_t, wilc_tx_complete_func_t);
 	int (*wlan_handle_tx_que)(uint32_t *);
@@ -75,6 +77,8 @@ struct wilc_wlan_oup {
 			    uint32_t, int, uint32_t);
 	int (*wlan_cfg_get)(int, uint32_t, int, uint32_t);
 	int (*wlan_cfg_get_value)(uint32_t, uint8_t *, uint32_t);
+	int (*wlan_cfg_commit_async)(int, uint32_t,
+				     wilc_cfg_done_func_t, void *);
 #if defined(WILC_AP_EXTERNAL_MLME) || defined(WILC_P2P)
 	int (*wlan_add_mgmt_to_tx_que)(void *, uint8_t *,
 				       uint32_t, wilc_tx_complete_func_t);
@@ -92,6 +96,8 @@ struct wilc_wlan_oup {
 #ifdef WILC_PARSE_SCAN_IN_HOST
 enum BEACON_IE {
 	SUPP_RATES_IE		= 1,
+	DS_PARAMS_IE		= 3,
+	TIM_IE			= 5,
 	EXT_SUPP_RATES_IE	= 50,
 	HT_CAPABILITY_IE	= 45,
 	RSN_IE			= 48,